@@ -0,0 +1,1043 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/raycaster.h"
+
+#define BENCH_FRAMES 200
+#define NUM_VIEWPORTS 256
+#define VIEWPORT_WIDTH 160
+#define VIEWPORT_HEIGHT 120
+#define DOORS_MAP_SIZE 48
+#define DOORS_TOGGLE_FRAMES 20
+#define PORTALS_MAP_SIZE 8
+#define BODIES_MAP_SIZE 128
+#define NUM_BODIES 20000
+#define BODY_RADIUS 6
+#define BODY_SPEED 80
+#define NUM_QUERIES 200000
+#define FLOW_MAP_SIZE 1024
+#define FLOW_BUILD_TARGET_MS 4
+#define FLOW_CHANGES 16
+#define NUM_FLOW_AGENTS 10000
+#define FLOW_STEERING_FRAMES 100
+#define PVS_MAP_SIZE 256
+#define LIGHTS_MAP_SIZE 64
+#define LIGHTS_SPACING 8
+#define LIGHT_CHANGES 10
+#define NUM_MOVING_LIGHTS 32
+#define CAPTURE_BENCH_BUFFERS 4
+#define GRATE_SIZE 64
+
+typedef struct BenchScene {
+    const char *name;
+    float x;
+    float y;
+    float rotationAngle;
+} BenchScene;
+
+double secondsNow(void);
+void benchSingleView(const Scene *scene, const BenchScene *benchScene);
+void benchViewports(const Scene *scene);
+void benchDoors(const Texture *wallTexture);
+void benchWallHeights(const Texture *wallTexture);
+void benchTextureSizes(Map *map);
+void benchPortals(const Texture *wallTexture);
+void benchSeeThrough(const Texture *wallTexture);
+void benchBodies(void);
+void benchQueries(const Map *map);
+void benchFlowField(void);
+void benchPvs(const Texture *wallTexture);
+void benchLighting(const Texture *wallTexture);
+void benchMovingLights(const Texture *wallTexture);
+void benchCapture(const Scene *scene);
+bool benchStreaming(const Scene *scene);
+void benchInterleaved(const Scene *scene);
+bool benchInterleavedPipeline(const Scene *scene);
+int benchReplay(Map *map, const Scene *scene, const char *replayFilePath, const char *captureFilePath);
+uint32_t hashColorBuffer(uint32_t hash, const RenderContext *context);
+
+// usage: raycast-bench [--replay file [--capture file]] [map file]
+int main(int argc, char *argv[]) {
+    const char *replayFilePath = NULL;
+    const char *captureFilePath = NULL;
+    const char *mapFilePath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayFilePath = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            captureFilePath = argv[++i];
+        } else {
+            mapFilePath = argv[i];
+        }
+    }
+
+    Map *map = mapFilePath != NULL ? mapLoadFromFile(mapFilePath) : mapCreateDefault();
+    Texture wallTexture;
+    if (map == NULL || !textureLoad(&wallTexture, WOOD_TEXTURE_FILEPATH, NULL)) {
+        fprintf(stderr, "Error loading the benchmark assets, run from the repository root.\n");
+        return 1;
+    }
+    Scene scene = { map, &wallTexture, 1, MAX_PORTAL_HOPS };
+
+    if (replayFilePath != NULL) {
+        int status = benchReplay(map, &scene, replayFilePath, captureFilePath);
+        textureDestroy(&wallTexture);
+        mapDestroy(map);
+        return status;
+    }
+
+    // "near wall" puts the camera two units from the west wall so every column spans the full screen height
+    BenchScene benchScenes[] = {
+        { "open room", WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 0 },
+        { "near wall", TILE_SIZE + 2, WINDOW_HEIGHT / 2, M_PI },
+    };
+
+    printf("%-12s %10s %10s\n", "scene", "ms/frame", "frames/s");
+    for (int i = 0; i < (int)(sizeof(benchScenes) / sizeof(benchScenes[0])); i++) {
+        benchSingleView(&scene, &benchScenes[i]);
+    }
+    benchTextureSizes(map);
+    benchWallHeights(&wallTexture);
+    benchPortals(&wallTexture);
+    benchSeeThrough(&wallTexture);
+    benchViewports(&scene);
+    benchDoors(&wallTexture);
+    benchBodies();
+    benchQueries(map);
+    benchFlowField();
+    benchPvs(&wallTexture);
+    benchLighting(&wallTexture);
+    benchMovingLights(&wallTexture);
+    benchCapture(&scene);
+    // the checks that frames come out exactly as they should fail the run, so make bench catches them
+    bool framesMatched = benchStreaming(&scene);
+    benchInterleaved(&scene);
+    framesMatched = benchInterleavedPipeline(&scene) && framesMatched;
+
+    textureDestroy(&wallTexture);
+    mapDestroy(map);
+    if (!framesMatched) {
+        fprintf(stderr, "Some frames did not come out as they should, see the mismatches above.\n");
+        return 1;
+    }
+    return 0;
+}
+
+double secondsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void benchSingleView(const Scene *scene, const BenchScene *benchScene) {
+    RenderContext context = { 0 };
+    if (!renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        return;
+    }
+    context.camera.x = benchScene->x;
+    context.camera.y = benchScene->y;
+    context.camera.rotationAngle = benchScene->rotationAngle;
+
+    double start = secondsNow();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        renderView(&context, scene);
+    }
+    double elapsed = secondsNow() - start;
+    printf("%-12s %10.3f %10.1f\n", benchScene->name, elapsed * 1000 / BENCH_FRAMES, BENCH_FRAMES / elapsed);
+    renderContextDestroy(&context);
+}
+
+// aggregate throughput of many small cameras scattered around the map
+void benchViewports(const Scene *scene) {
+    Scheduler *scheduler = schedulerCreate(0);
+    RenderContext *contexts = (RenderContext*) calloc(NUM_VIEWPORTS, sizeof(RenderContext));
+    if (scheduler == NULL || contexts == NULL) {
+        schedulerDestroy(scheduler);
+        free(contexts);
+        return;
+    }
+    srand(1);
+    for (int i = 0; i < NUM_VIEWPORTS; i++) {
+        renderContextInit(&contexts[i], VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+        do {
+            contexts[i].camera.x = rand() % WINDOW_WIDTH;
+            contexts[i].camera.y = rand() % WINDOW_HEIGHT;
+        } while (mapHasWallAt(scene->map, contexts[i].camera.x, contexts[i].camera.y));
+        contexts[i].camera.rotationAngle = (rand() % 360) * (M_PI / 180);
+    }
+
+    double start = secondsNow();
+    for (int frame = 0; frame < BENCH_FRAMES / 10; frame++) {
+        renderViewports(scheduler, contexts, NUM_VIEWPORTS, scene);
+    }
+    double elapsed = secondsNow() - start;
+    printf("%-12s %10.3f %10.1f  (%d x %dx%d viewports, %d workers)\n", "viewports",
+        elapsed * 1000 / (BENCH_FRAMES / 10), NUM_VIEWPORTS * (BENCH_FRAMES / 10) / elapsed,
+        NUM_VIEWPORTS, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, schedulerWorkerCount(scheduler));
+
+    for (int i = 0; i < NUM_VIEWPORTS; i++) {
+        renderContextDestroy(&contexts[i]);
+    }
+    free(contexts);
+    schedulerDestroy(scheduler);
+}
+
+// the default map with half height walls inside and towers of one to three tiles around
+// them, so columns keep walking past the first wall they hit
+void benchWallHeights(const Texture *wallTexture) {
+    Map *map = mapCreateDefault();
+    if (map == NULL) {
+        return;
+    }
+    for (int row = 0; row < map->numRows; row++) {
+        for (int col = 0; col < map->numCols; col++) {
+            bool border = row == 0 || col == 0 || row == map->numRows - 1 || col == map->numCols - 1;
+            mapSetWallHeight(map, col, row, border ? 1 + (row + col) % 3 : 0.5f);
+        }
+    }
+    Scene scene = { map, wallTexture, 1 };
+    BenchScene benchScene = { "heights", WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 0 };
+    benchSingleView(&scene, &benchScene);
+    mapDestroy(map);
+}
+
+// a small room whose opposite walls are portals into each other, so it repeats endlessly in
+// every direction and most columns pass the full MAX_PORTAL_HOPS portals before they hit a pillar
+void benchPortals(const Texture *wallTexture) {
+    int cells[PORTALS_MAP_SIZE * PORTALS_MAP_SIZE];
+    for (int row = 0; row < PORTALS_MAP_SIZE; row++) {
+        for (int col = 0; col < PORTALS_MAP_SIZE; col++) {
+            bool border = row == 0 || col == 0 || row == PORTALS_MAP_SIZE - 1 || col == PORTALS_MAP_SIZE - 1;
+            cells[(row * PORTALS_MAP_SIZE) + col] = border || (row == 2 && col == 5) ? 1 : 0;
+        }
+    }
+    Map *map = mapCreate(PORTALS_MAP_SIZE, PORTALS_MAP_SIZE, cells);
+    if (map == NULL) {
+        return;
+    }
+    for (int i = 1; i < PORTALS_MAP_SIZE - 1; i++) {
+        mapLinkPortals(map, 0, i, PORTALS_MAP_SIZE - 1, i, 0);
+        mapLinkPortals(map, i, 0, i, PORTALS_MAP_SIZE - 1, 0);
+    }
+    RenderContext context = { 0 };
+    if (!renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        mapDestroy(map);
+        return;
+    }
+    Scene scene = { map, wallTexture, 1, MAX_PORTAL_HOPS };
+    context.camera.x = PORTALS_MAP_SIZE * TILE_SIZE / 2;
+    context.camera.y = PORTALS_MAP_SIZE * TILE_SIZE / 2;
+    context.camera.rotationAngle = 0.3;
+
+    double start = secondsNow();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        renderView(&context, &scene);
+    }
+    double elapsed = secondsNow() - start;
+    double frameTime = elapsed * 1000 / BENCH_FRAMES;
+    printf("%-12s %10.3f %10.1f  (%d portals, up to %d hops per ray, %.0f%% of the %d ms frame budget)\n", "portals",
+        frameTime, BENCH_FRAMES / elapsed, 4 * (PORTALS_MAP_SIZE - 2), MAX_PORTAL_HOPS,
+        100 * frameTime / FRAME_TIME_LENGTH, FRAME_TIME_LENGTH);
+
+    renderContextDestroy(&context);
+    mapDestroy(map);
+}
+
+// both scenes again with a generated texture of each size; power-of-two heights take the masked
+// wall kernels and the others the wrapping fallback, magnified walls fill runs either way
+void benchTextureSizes(Map *map) {
+    int sizes[] = { 16, 64, 100, 256, 1024 };
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        int size = sizes[i];
+        uint32_t *pixels = (uint32_t*) malloc(sizeof(uint32_t) * size * size);
+        Texture texture;
+        if (pixels == NULL) {
+            return;
+        }
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                pixels[(size * y) + x] = 0xFF000000 | (uint32_t)(x * 255 / size) | (uint32_t)(y * 255 / size) << 8;
+            }
+        }
+        bool created = textureFromPixels(&texture, pixels, size, size);
+        free(pixels);
+        if (!created) {
+            return;
+        }
+        Scene scene = { map, &texture, 1, MAX_PORTAL_HOPS };
+        char openName[32];
+        char nearName[32];
+        snprintf(openName, sizeof(openName), "open %d", size);
+        snprintf(nearName, sizeof(nearName), "near %d", size);
+        BenchScene openRoom = { openName, WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 0 };
+        BenchScene nearWall = { nearName, TILE_SIZE + 2, WINDOW_HEIGHT / 2, M_PI };
+        benchSingleView(&scene, &openRoom);
+        benchSingleView(&scene, &nearWall);
+        textureDestroy(&texture);
+    }
+}
+
+// the default map crossed by a fence of alpha-masked grates and a row of tinted glass behind it,
+// so most columns blend two see-through walls over the room beyond
+void benchSeeThrough(const Texture *wallTexture) {
+    uint32_t grate[GRATE_SIZE * GRATE_SIZE];
+    for (int y = 0; y < GRATE_SIZE; y++) {
+        for (int x = 0; x < GRATE_SIZE; x++) {
+            grate[(GRATE_SIZE * y) + x] = x % 16 < 4 || y % 16 < 4 ? 0xFF303030 : 0x00000000;
+        }
+    }
+    Texture textures[3] = { *wallTexture };
+    Map *map = mapCreateDefault();
+    if (map == NULL || !textureFromPixels(&textures[1], grate, GRATE_SIZE, GRATE_SIZE)
+        || !textureCreateSolid(&textures[2], 8, 8, 0x60FFC080)) {
+        textureDestroy(&textures[1]);
+        mapDestroy(map);
+        return;
+    }
+    for (int row = 1; row < map->numRows - 1; row++) {
+        mapSetCell(map, 12, row, 2);
+        mapSetCell(map, 14, row, 3);
+    }
+    Scene scene = { map, textures, 3, MAX_PORTAL_HOPS };
+    BenchScene benchScene = { "see-through", WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 0 };
+    benchSingleView(&scene, &benchScene);
+    textureDestroy(&textures[1]);
+    textureDestroy(&textures[2]);
+    mapDestroy(map);
+}
+
+// a room full of doors that keep sliding open and shut, with every frame rendered from a copy
+// of the map that is brought up to date from the journal first, the way the frame pipeline does
+void benchDoors(const Texture *wallTexture) {
+    int cells[DOORS_MAP_SIZE * DOORS_MAP_SIZE];
+    for (int row = 0; row < DOORS_MAP_SIZE; row++) {
+        for (int col = 0; col < DOORS_MAP_SIZE; col++) {
+            bool border = row == 0 || col == 0 || row == DOORS_MAP_SIZE - 1 || col == DOORS_MAP_SIZE - 1;
+            cells[(row * DOORS_MAP_SIZE) + col] = border ? 1 : (row % 3 == 1 && col % 3 == 1) ? -1 : 0;
+        }
+    }
+    Map *map = mapCreate(DOORS_MAP_SIZE, DOORS_MAP_SIZE, cells);
+    Map *copy = map != NULL ? mapCopy(map) : NULL;
+    RenderContext context = { 0 };
+    if (copy == NULL || !renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        mapDestroy(copy);
+        mapDestroy(map);
+        return;
+    }
+    Scene scene = { copy, wallTexture, 1 };
+    context.camera.x = DOORS_MAP_SIZE * TILE_SIZE / 2;
+    context.camera.y = DOORS_MAP_SIZE * TILE_SIZE / 2;
+    context.camera.rotationAngle = 0.3;
+
+    // two simulation ticks per frame, and doors take exactly DOORS_TOGGLE_FRAMES frames to travel
+    unsigned long revision = mapRevision(map);
+    double syncTime = 0;
+    double start = secondsNow();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        if (frame % DOORS_TOGGLE_FRAMES == 0) {
+            bool opening = (frame / DOORS_TOGGLE_FRAMES) % 2 == 0;
+            mapTriggerDoors(map, 0, 0, opening ? 2 * mapWidth(map) : 0);
+        }
+        mapUpdateDoors(map, TICK_LENGTH);
+        mapUpdateDoors(map, TICK_LENGTH);
+
+        double syncStart = secondsNow();
+        if (!mapUpdateCopy(copy, map, revision)) {
+            mapDestroy(copy);
+            copy = mapCopy(map);
+            if (copy == NULL) {
+                break;
+            }
+            scene.map = copy;
+        }
+        revision = mapRevision(map);
+        syncTime += secondsNow() - syncStart;
+
+        renderView(&context, &scene);
+    }
+    double elapsed = secondsNow() - start;
+    printf("%-12s %10.3f %10.1f  (%d doors, %.3f ms/frame syncing the copy)\n", "doors",
+        elapsed * 1000 / BENCH_FRAMES, BENCH_FRAMES / elapsed, map->numDoors, syncTime * 1000 / BENCH_FRAMES);
+
+    renderContextDestroy(&context);
+    mapDestroy(copy);
+    mapDestroy(map);
+}
+
+// a large map studded with pillars and crowded with bodies that bounce off whatever stops them,
+// timing only the collision step of each simulation tick
+void benchBodies(void) {
+    int *cells = (int*) calloc(BODIES_MAP_SIZE * BODIES_MAP_SIZE, sizeof(int));
+    Body *bodies = (Body*) malloc(sizeof(Body) * NUM_BODIES);
+    float *lastPositions = (float*) malloc(sizeof(float) * 2 * NUM_BODIES);
+    SpatialHash *hash = spatialHashCreate(4 * BODY_RADIUS);
+    Map *map = NULL;
+    if (cells != NULL) {
+        for (int row = 0; row < BODIES_MAP_SIZE; row++) {
+            for (int col = 0; col < BODIES_MAP_SIZE; col++) {
+                bool border = row == 0 || col == 0 || row == BODIES_MAP_SIZE - 1 || col == BODIES_MAP_SIZE - 1;
+                cells[(row * BODIES_MAP_SIZE) + col] = border || (row % 4 == 2 && col % 4 == 2) ? 1 : 0;
+            }
+        }
+        map = mapCreate(BODIES_MAP_SIZE, BODIES_MAP_SIZE, cells);
+    }
+    if (map == NULL || bodies == NULL || lastPositions == NULL || hash == NULL) {
+        free(cells);
+        free(bodies);
+        free(lastPositions);
+        spatialHashDestroy(hash);
+        mapDestroy(map);
+        return;
+    }
+    srand(1);
+    for (int i = 0; i < NUM_BODIES; i++) {
+        Body *body = &bodies[i];
+        do {
+            body->x = rand() % (int)mapWidth(map);
+            body->y = rand() % (int)mapHeight(map);
+        } while (mapHasWallAt(map, body->x, body->y));
+        collisionMoveCircle(map, &body->x, &body->y, BODY_RADIUS, 0, 0);
+        float angle = (rand() % 360) * (M_PI / 180);
+        body->radius = BODY_RADIUS;
+        body->velocityX = cos(angle) * BODY_SPEED;
+        body->velocityY = sin(angle) * BODY_SPEED;
+    }
+
+    double collisionTime = 0;
+    for (int tick = 0; tick < BENCH_FRAMES; tick++) {
+        for (int i = 0; i < NUM_BODIES; i++) {
+            lastPositions[2 * i] = bodies[i].x;
+            lastPositions[(2 * i) + 1] = bodies[i].y;
+        }
+        double start = secondsNow();
+        collisionStepBodies(map, hash, bodies, NUM_BODIES, TICK_LENGTH);
+        collisionTime += secondsNow() - start;
+        // a body that got less than halfway along an axis ran into something and turns around
+        for (int i = 0; i < NUM_BODIES; i++) {
+            Body *body = &bodies[i];
+            if (fabsf(body->x - lastPositions[2 * i]) < fabsf(body->velocityX) * TICK_LENGTH / 2) {
+                body->velocityX = -body->velocityX;
+            }
+            if (fabsf(body->y - lastPositions[(2 * i) + 1]) < fabsf(body->velocityY) * TICK_LENGTH / 2) {
+                body->velocityY = -body->velocityY;
+            }
+        }
+    }
+    double tickTime = collisionTime * 1000 / BENCH_FRAMES;
+    printf("%-12s %10.3f %10.1f  (ms and ticks/s, %d bodies, %.0f%% of a %.1f ms tick)\n", "bodies",
+        tickTime, BENCH_FRAMES / collisionTime, NUM_BODIES, 100 * tickTime / (TICK_LENGTH * 1000), TICK_LENGTH * 1000);
+
+    free(cells);
+    free(bodies);
+    free(lastPositions);
+    spatialHashDestroy(hash);
+    mapDestroy(map);
+}
+
+// line of sight and hitscan batches between random open points of the map, on every core
+void benchQueries(const Map *map) {
+    Scheduler *scheduler = schedulerCreate(0);
+    SightQuery *sightQueries = (SightQuery*) malloc(sizeof(SightQuery) * NUM_QUERIES);
+    HitscanQuery *hitscanQueries = (HitscanQuery*) malloc(sizeof(HitscanQuery) * NUM_QUERIES);
+    bool *visible = (bool*) malloc(sizeof(bool) * NUM_QUERIES);
+    Ray *hits = (Ray*) malloc(sizeof(Ray) * NUM_QUERIES);
+    if (scheduler == NULL || sightQueries == NULL || hitscanQueries == NULL || visible == NULL || hits == NULL) {
+        schedulerDestroy(scheduler);
+        free(sightQueries);
+        free(hitscanQueries);
+        free(visible);
+        free(hits);
+        return;
+    }
+    srand(1);
+    for (int i = 0; i < NUM_QUERIES; i++) {
+        SightQuery *sight = &sightQueries[i];
+        do {
+            sight->fromX = rand() % (int)mapWidth(map);
+            sight->fromY = rand() % (int)mapHeight(map);
+        } while (mapHasWallAt(map, sight->fromX, sight->fromY));
+        do {
+            sight->toX = rand() % (int)mapWidth(map);
+            sight->toY = rand() % (int)mapHeight(map);
+        } while (mapHasWallAt(map, sight->toX, sight->toY));
+        HitscanQuery hitscan = { sight->fromX, sight->fromY, (rand() % 360) * (M_PI / 180), 10 * TILE_SIZE };
+        hitscanQueries[i] = hitscan;
+    }
+
+    double start = secondsNow();
+    queryLineOfSight(scheduler, map, sightQueries, visible, NUM_QUERIES);
+    double sightTime = secondsNow() - start;
+    start = secondsNow();
+    queryHitscan(scheduler, map, hitscanQueries, hits, NUM_QUERIES);
+    double hitscanTime = secondsNow() - start;
+    int numVisible = 0;
+    for (int i = 0; i < NUM_QUERIES; i++) {
+        numVisible += visible[i];
+    }
+    printf("%-12s %10.3f %10.1f  (ms and Mqueries/s for %d queries, %d%% visible, %d workers)\n", "sight",
+        sightTime * 1000, NUM_QUERIES / sightTime / 1e6, NUM_QUERIES, numVisible * 100 / NUM_QUERIES, schedulerWorkerCount(scheduler));
+    printf("%-12s %10.3f %10.1f\n", "hitscan", hitscanTime * 1000, NUM_QUERIES / hitscanTime / 1e6);
+
+    schedulerDestroy(scheduler);
+    free(sightQueries);
+    free(hitscanQueries);
+    free(visible);
+    free(hits);
+}
+
+// builds a field over a large map with scattered walls, keeps it up to date while a few walls
+// come and go every frame and steers agents all over the map along it
+void benchFlowField(void) {
+    int *cells = (int*) malloc(sizeof(int) * FLOW_MAP_SIZE * FLOW_MAP_SIZE);
+    float *agents = (float*) malloc(sizeof(float) * 2 * NUM_FLOW_AGENTS);
+    FlowField *field = flowFieldCreate();
+    Map *map = NULL;
+    srand(1);
+    if (cells != NULL) {
+        for (int cell = 0; cell < FLOW_MAP_SIZE * FLOW_MAP_SIZE; cell++) {
+            cells[cell] = rand() % 4 == 0 ? 1 : 0;
+        }
+        cells[(FLOW_MAP_SIZE / 2) * FLOW_MAP_SIZE + (FLOW_MAP_SIZE / 2)] = 0;
+        map = mapCreate(FLOW_MAP_SIZE, FLOW_MAP_SIZE, cells);
+    }
+    if (map == NULL || agents == NULL || field == NULL) {
+        free(cells);
+        free(agents);
+        flowFieldDestroy(field);
+        mapDestroy(map);
+        return;
+    }
+
+    double start = secondsNow();
+    for (int frame = 0; frame < 10; frame++) {
+        flowFieldBuild(field, map, FLOW_MAP_SIZE / 2, FLOW_MAP_SIZE / 2);
+    }
+    double buildTime = (secondsNow() - start) / 10;
+
+    double updateTime = 0;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        for (int i = 0; i < FLOW_CHANGES; i++) {
+            int col = rand() % FLOW_MAP_SIZE;
+            int row = rand() % FLOW_MAP_SIZE;
+            if (col != FLOW_MAP_SIZE / 2 || row != FLOW_MAP_SIZE / 2) {
+                mapSetCell(map, col, row, 1 - mapContentAt(map, (col + 0.5f) * TILE_SIZE, (row + 0.5f) * TILE_SIZE));
+            }
+        }
+        start = secondsNow();
+        flowFieldUpdate(field, map);
+        updateTime += secondsNow() - start;
+    }
+    updateTime /= BENCH_FRAMES;
+
+    for (int i = 0; i < NUM_FLOW_AGENTS; i++) {
+        agents[2 * i] = rand() % (int)mapWidth(map);
+        agents[(2 * i) + 1] = rand() % (int)mapHeight(map);
+    }
+    start = secondsNow();
+    for (int frame = 0; frame < FLOW_STEERING_FRAMES; frame++) {
+        for (int i = 0; i < NUM_FLOW_AGENTS; i++) {
+            float directionX;
+            float directionY;
+            if (flowFieldDirection(field, agents[2 * i], agents[(2 * i) + 1], &directionX, &directionY)) {
+                agents[2 * i] += directionX * (TILE_SIZE / 4);
+                agents[(2 * i) + 1] += directionY * (TILE_SIZE / 4);
+            }
+        }
+    }
+    double steeringTime = secondsNow() - start;
+    int numArrived = 0;
+    for (int i = 0; i < NUM_FLOW_AGENTS; i++) {
+        numArrived += flowFieldDistance(field, agents[2 * i], agents[(2 * i) + 1]) == 0;
+    }
+    printf("%-12s %10.3f %10.1f  (ms and builds/s, %dx%d cells, %.1fx the %d ms target)\n", "flowfield", buildTime * 1000, 1 / buildTime,
+        FLOW_MAP_SIZE, FLOW_MAP_SIZE, buildTime * 1000 / FLOW_BUILD_TARGET_MS, FLOW_BUILD_TARGET_MS);
+    printf("%-12s %10.3f %10.1f  (ms and updates/s, %d cells changed per update)\n", "flow update", updateTime * 1000, 1 / updateTime, FLOW_CHANGES);
+    printf("%-12s %10.3f %10.1f  (ms and Mlookups/s, %d agents for %d frames, %d arrived)\n", "flow steer", steeringTime * 1000,
+        (double)NUM_FLOW_AGENTS * FLOW_STEERING_FRAMES / steeringTime / 1e6, NUM_FLOW_AGENTS, FLOW_STEERING_FRAMES, numArrived);
+
+    free(cells);
+    free(agents);
+    flowFieldDestroy(field);
+    mapDestroy(map);
+}
+
+// builds the visible sets of a large map with scattered walls and culls bodies all over it
+void benchPvs(const Texture *wallTexture) {
+    int *cells = (int*) malloc(sizeof(int) * PVS_MAP_SIZE * PVS_MAP_SIZE);
+    Body *bodies = (Body*) malloc(sizeof(Body) * NUM_BODIES);
+    int *visible = (int*) malloc(sizeof(int) * NUM_BODIES);
+    Scheduler *scheduler = schedulerCreate(0);
+    Map *map = NULL;
+    srand(1);
+    if (cells != NULL) {
+        for (int row = 0; row < PVS_MAP_SIZE; row++) {
+            for (int col = 0; col < PVS_MAP_SIZE; col++) {
+                bool border = row == 0 || col == 0 || row == PVS_MAP_SIZE - 1 || col == PVS_MAP_SIZE - 1;
+                cells[(row * PVS_MAP_SIZE) + col] = border || rand() % 5 == 0 ? 1 : 0;
+            }
+        }
+        map = mapCreate(PVS_MAP_SIZE, PVS_MAP_SIZE, cells);
+    }
+    if (map == NULL || bodies == NULL || visible == NULL || scheduler == NULL) {
+        free(cells);
+        free(bodies);
+        free(visible);
+        schedulerDestroy(scheduler);
+        mapDestroy(map);
+        return;
+    }
+    Scene scene = { map, wallTexture, 1, MAX_PORTAL_HOPS };
+
+    double start = secondsNow();
+    Pvs *pvs = pvsBuild(scheduler, &scene);
+    double buildTime = secondsNow() - start;
+    if (pvs != NULL) {
+        for (int i = 0; i < NUM_BODIES; i++) {
+            Body body = { rand() % (int)mapWidth(map), rand() % (int)mapHeight(map), BODY_RADIUS, 0, 0 };
+            bodies[i] = body;
+        }
+        int numVisible = 0;
+        start = secondsNow();
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            float x = (frame % (PVS_MAP_SIZE - 2) + 1.5f) * TILE_SIZE;
+            numVisible += pvsCullBodies(pvs, x, x, bodies, NUM_BODIES, visible);
+        }
+        double cullTime = (secondsNow() - start) / BENCH_FRAMES;
+        size_t memory = pvsMemoryUsage(pvs);
+        printf("%-12s %10.3f %10.1f  (ms and MB for %dx%d cells, %.1f bytes per cell, %d workers)\n", "pvs build", buildTime * 1000,
+            memory / 1e6, PVS_MAP_SIZE, PVS_MAP_SIZE, (double)memory / (PVS_MAP_SIZE * PVS_MAP_SIZE), schedulerWorkerCount(scheduler));
+        printf("%-12s %10.3f %10.1f  (ms and culls/s, %d bodies, %.1f%% left)\n", "pvs cull", cullTime * 1000, 1 / cullTime,
+            NUM_BODIES, 100.0 * numVisible / ((double)NUM_BODIES * BENCH_FRAMES));
+    }
+
+    pvsDestroy(pvs);
+    free(cells);
+    free(bodies);
+    free(visible);
+    schedulerDestroy(scheduler);
+    mapDestroy(map);
+}
+
+// the default map lit by a light in every corner of the room, against the unlit "open room";
+// then the lights of a large map with scattered walls, baked at once and rebaked by a light
+// baker while single cells change, polling it once per simulated frame
+void benchLighting(const Texture *wallTexture) {
+    Map *map = mapCreateDefault();
+    if (map == NULL) {
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        mapAddLight(map, (i % 2 == 0 ? 3.5f : 16.5f) * TILE_SIZE, (i < 2 ? 3.5f : 9.5f) * TILE_SIZE, 8 * TILE_SIZE, 1);
+    }
+    double start = secondsNow();
+    Lightmap *lightmap = lightmapBake(map);
+    double bakeTime = secondsNow() - start;
+    if (lightmap != NULL) {
+        Scene scene = { map, wallTexture, 1, MAX_PORTAL_HOPS, lightmap };
+        BenchScene benchScene = { "lit room", WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 0 };
+        benchSingleView(&scene, &benchScene);
+        printf("%-12s %10.3f %10.1f  (ms and KB, %d lights)\n", "room bake", bakeTime * 1000,
+            lightmapMemoryUsage(lightmap) / 1e3, map->numLights);
+    }
+    lightmapDestroy(lightmap);
+    mapDestroy(map);
+
+    int *cells = (int*) malloc(sizeof(int) * LIGHTS_MAP_SIZE * LIGHTS_MAP_SIZE);
+    if (cells == NULL) {
+        return;
+    }
+    srand(1);
+    for (int row = 0; row < LIGHTS_MAP_SIZE; row++) {
+        for (int col = 0; col < LIGHTS_MAP_SIZE; col++) {
+            bool border = row == 0 || col == 0 || row == LIGHTS_MAP_SIZE - 1 || col == LIGHTS_MAP_SIZE - 1;
+            bool lit = row % LIGHTS_SPACING == LIGHTS_SPACING / 2 && col % LIGHTS_SPACING == LIGHTS_SPACING / 2;
+            cells[(row * LIGHTS_MAP_SIZE) + col] = border || (!lit && rand() % 5 == 0) ? 1 : 0;
+        }
+    }
+    map = mapCreate(LIGHTS_MAP_SIZE, LIGHTS_MAP_SIZE, cells);
+    free(cells);
+    if (map == NULL) {
+        return;
+    }
+    for (int row = LIGHTS_SPACING / 2; row < LIGHTS_MAP_SIZE; row += LIGHTS_SPACING) {
+        for (int col = LIGHTS_SPACING / 2; col < LIGHTS_MAP_SIZE; col += LIGHTS_SPACING) {
+            mapAddLight(map, (col + 0.5f) * TILE_SIZE, (row + 0.5f) * TILE_SIZE, 6 * TILE_SIZE, 1);
+        }
+    }
+    start = secondsNow();
+    lightmap = lightmapBake(map);
+    bakeTime = secondsNow() - start;
+    if (lightmap != NULL) {
+        size_t memory = lightmapMemoryUsage(lightmap);
+        printf("%-12s %10.3f %10.1f  (ms and KB for %dx%d cells, %d lights, %.1f bytes per cell)\n", "lights bake",
+            bakeTime * 1000, memory / 1e3, LIGHTS_MAP_SIZE, LIGHTS_MAP_SIZE, map->numLights,
+            (double)memory / (LIGHTS_MAP_SIZE * LIGHTS_MAP_SIZE));
+    }
+    lightmapDestroy(lightmap);
+
+    FrameStats stats = { 0 };
+    LightBaker *baker = lightBakerCreate(map, &stats);
+    if (baker == NULL) {
+        mapDestroy(map);
+        return;
+    }
+    struct timespec frameWait = { 0, FRAME_TIME_LENGTH * 1000000L };
+    unsigned long frames = 0;
+    while (lightBakerPoll(baker, map, frames, frames) == NULL) {
+        nanosleep(&frameWait, NULL);
+        frames++;
+    }
+    memset(&stats, 0, sizeof(stats));
+    double maxPollTime = 0;
+    for (int change = 0; change < LIGHT_CHANGES; change++) {
+        const Lightmap *before = lightBakerPoll(baker, map, frames, frames);
+        int col = 1 + rand() % (LIGHTS_MAP_SIZE - 2);
+        int row = 1 + rand() % (LIGHTS_MAP_SIZE - 2);
+        mapSetCell(map, col, row, map->cells[(row * LIGHTS_MAP_SIZE) + col] != 0 ? 0 : 1);
+        for (;;) {
+            frames++;
+            start = secondsNow();
+            const Lightmap *after = lightBakerPoll(baker, map, frames, frames);
+            double pollTime = secondsNow() - start;
+            maxPollTime = pollTime > maxPollTime ? pollTime : maxPollTime;
+            if (after != before) {
+                break;
+            }
+            nanosleep(&frameWait, NULL);
+        }
+    }
+    const StatCounter *rebake = &stats.counters[STAT_LIGHT_BAKE];
+    printf("%-12s %10.3f %10.3f  (ms from change to new lightmap and worst ms per poll, %d changes)\n", "lights rebake",
+        rebake->count > 0 ? rebake->total / rebake->count : 0, maxPollTime * 1000, rebake->count);
+    lightBakerDestroy(baker);
+    mapDestroy(map);
+}
+
+// the default map, otherwise dark, lit by lights that all circle around every frame, so each
+// one has its shadows found again per frame; compare the frame time with the unlit "open room"
+void benchMovingLights(const Texture *wallTexture) {
+    Map *map = mapCreateDefault();
+    LightSet *lights = lightSetCreate();
+    RenderContext context = { 0 };
+    if (map == NULL || lights == NULL || !renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        renderContextDestroy(&context);
+        lightSetDestroy(lights);
+        mapDestroy(map);
+        return;
+    }
+    srand(1);
+    float centers[NUM_MOVING_LIGHTS][2];
+    for (int i = 0; i < NUM_MOVING_LIGHTS; i++) {
+        do {
+            centers[i][0] = rand() % WINDOW_WIDTH;
+            centers[i][1] = rand() % WINDOW_HEIGHT;
+        } while (mapHasWallAt(map, centers[i][0], centers[i][1]));
+        lightSetAdd(lights, centers[i][0], centers[i][1], 4 * TILE_SIZE, 0.5f);
+    }
+    context.camera.x = WINDOW_WIDTH / 2;
+    context.camera.y = WINDOW_HEIGHT / 2;
+    Scene scene = { map, wallTexture, 1, MAX_PORTAL_HOPS, NULL, lights };
+
+    FrameStats stats = { 0 };
+    double renderTime = 0;
+    double start = secondsNow();
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        for (int i = 0; i < NUM_MOVING_LIGHTS; i++) {
+            float angle = (frame + i) * 0.1f;
+            lightSetMove(lights, i, centers[i][0] + cosf(angle) * TILE_SIZE / 4, centers[i][1] + sinf(angle) * TILE_SIZE / 4);
+        }
+        lightSetUpdate(lights, map, &stats);
+        double renderStart = secondsNow();
+        renderView(&context, &scene);
+        renderTime += secondsNow() - renderStart;
+    }
+    double elapsed = secondsNow() - start;
+    const StatCounter *shadow = &stats.counters[STAT_LIGHT_SHADOW];
+    printf("%-12s %10.3f %10.1f  (render ms/frame, %d moving lights, %.3f ms/frame with their shadows)\n", "moving lights",
+        renderTime * 1000 / BENCH_FRAMES, BENCH_FRAMES / elapsed, lightSetCount(lights), elapsed * 1000 / BENCH_FRAMES);
+    printf("%-12s %10.3f %10.3f  (ms per light, average and worst, %d polygons)\n", "light shadow",
+        shadow->count > 0 ? shadow->total / shadow->count : 0, shadow->max, shadow->count);
+
+    renderContextDestroy(&context);
+    lightSetDestroy(lights);
+    mapDestroy(map);
+}
+
+// renders the "open room" while capturing every frame to /dev/null in each format, dropping
+// frames the encoder thread cannot keep up with; then times the png encoder on its own
+void benchCapture(const Scene *scene) {
+    RenderContext context = { 0 };
+    if (!renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        return;
+    }
+    context.camera.x = WINDOW_WIDTH / 2;
+    context.camera.y = WINDOW_HEIGHT / 2;
+    const char *names[] = { "capture raw", "capture y4m" };
+    CaptureFormat formats[] = { CAPTURE_RAW, CAPTURE_Y4M };
+    for (int i = 0; i < 2; i++) {
+        FrameStats stats = { 0 };
+        FrameCapture *capture = frameCaptureCreate("/dev/null", formats[i], WINDOW_WIDTH, WINDOW_HEIGHT, FPS,
+            CAPTURE_BENCH_BUFFERS, CAPTURE_DROP, &stats);
+        if (capture == NULL) {
+            continue;
+        }
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            renderView(&context, scene);
+            frameCaptureSubmit(capture, context.colorBuffer);
+        }
+        frameCaptureFlush(capture);
+        CaptureCounts counts = frameCaptureCounts(capture);
+        const StatCounter *submit = &stats.counters[STAT_CAPTURE];
+        printf("%-12s %10.3f %10.3f  (ms per submit and per frame encoded, %lu of %d frames dropped, %d buffers)\n", names[i],
+            submit->count > 0 ? submit->total / submit->count : 0, counts.written > 0 ? counts.encodeMilliseconds / counts.written : 0,
+            counts.dropped, BENCH_FRAMES, CAPTURE_BENCH_BUFFERS);
+        frameCaptureDestroy(capture);
+    }
+
+    double start = secondsNow();
+    for (int frame = 0; frame < BENCH_FRAMES / 10; frame++) {
+        pngWrite("/dev/null", context.colorBuffer, context.width, context.height);
+    }
+    printf("%-12s %10.3f\n", "png write", (secondsNow() - start) * 1000 / (BENCH_FRAMES / 10));
+    renderContextDestroy(&context);
+}
+
+// encodes each frame of a still, a turning and a walking camera against the one before it, as
+// the stream server does, and checks that decoding gives back every frame exactly. returns whether
+// it did, false as well when the check could not run.
+bool benchStreaming(const Scene *scene) {
+    RenderContext context = { 0 };
+    uint32_t *reference = (uint32_t*) calloc((size_t)WINDOW_WIDTH * WINDOW_HEIGHT, sizeof(uint32_t));
+    uint32_t *decoded = (uint32_t*) calloc((size_t)WINDOW_WIDTH * WINDOW_HEIGHT, sizeof(uint32_t));
+    unsigned char *encoded = (unsigned char*) malloc(deltaEncodeBound(WINDOW_WIDTH, WINDOW_HEIGHT));
+    if (reference == NULL || decoded == NULL || encoded == NULL || !renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        renderContextDestroy(&context);
+        free(encoded);
+        free(decoded);
+        free(reference);
+        return false;
+    }
+    size_t frameBytes = sizeof(uint32_t) * WINDOW_WIDTH * WINDOW_HEIGHT;
+    const char *names[] = { "stream still", "stream turn", "stream walk" };
+    int turnDirections[] = { 0, 1, 0 };
+    int walkDirections[] = { 0, 0, 1 };
+    int totalMismatches = 0;
+    for (int i = 0; i < 3; i++) {
+        Player camera = { WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 1, 1, turnDirections[i], walkDirections[i], 0, 100, 45 * (M_PI / 180) };
+        context.camera = camera;
+        renderView(&context, scene);
+        size_t keyframeSize = deltaEncode(context.colorBuffer, NULL, WINDOW_WIDTH, WINDOW_HEIGHT, encoded);
+        if (!deltaDecode(encoded, keyframeSize, decoded, WINDOW_WIDTH, WINDOW_HEIGHT) || memcmp(decoded, context.colorBuffer, frameBytes) != 0) {
+            totalMismatches++;
+        }
+        memcpy(reference, context.colorBuffer, frameBytes);
+        if (i == 0) {
+            printf("%-12s %10.1f %9.1f%%  (KB and share of the raw frame)\n", "keyframe",
+                keyframeSize / 1024.0, keyframeSize * 100.0 / frameBytes);
+        }
+
+        double encodeTime = 0;
+        double decodeTime = 0;
+        size_t totalSize = 0;
+        int mismatches = 0;
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            movePlayer(scene->map, &context.camera, TICK_LENGTH);
+            renderView(&context, scene);
+            double encodeStart = secondsNow();
+            size_t size = deltaEncode(context.colorBuffer, reference, WINDOW_WIDTH, WINDOW_HEIGHT, encoded);
+            encodeTime += secondsNow() - encodeStart;
+            double decodeStart = secondsNow();
+            bool decodedWhole = deltaDecode(encoded, size, decoded, WINDOW_WIDTH, WINDOW_HEIGHT);
+            decodeTime += secondsNow() - decodeStart;
+            if (!decodedWhole || memcmp(decoded, context.colorBuffer, frameBytes) != 0) {
+                mismatches++;
+            }
+            memcpy(reference, context.colorBuffer, frameBytes);
+            totalSize += size;
+        }
+        printf("%-12s %10.3f %10.1f  (encode ms/frame, KB/frame, %.1f%% of raw, %.3f ms to decode, %d frames mismatched)\n",
+            names[i], encodeTime * 1000 / BENCH_FRAMES, totalSize / 1024.0 / BENCH_FRAMES,
+            totalSize * 100.0 / ((double)frameBytes * BENCH_FRAMES), decodeTime * 1000 / BENCH_FRAMES, mismatches);
+        totalMismatches += mismatches;
+    }
+
+    renderContextDestroy(&context);
+    free(encoded);
+    free(decoded);
+    free(reference);
+    return totalMismatches == 0;
+}
+
+// renders a still, a turning and a walking camera interleaved and in full, side by side, and
+// compares the frames: how many pixels the rebuilt columns got wrong, and by how much
+void benchInterleaved(const Scene *scene) {
+    RenderContext interleaved = { 0 };
+    RenderContext full = { 0 };
+    if (!renderContextInit(&interleaved, WINDOW_WIDTH, WINDOW_HEIGHT) || !renderContextInit(&full, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        renderContextDestroy(&interleaved);
+        renderContextDestroy(&full);
+        return;
+    }
+    Scene interleavedScene = *scene;
+    interleavedScene.interleaved = true;
+    const char *names[] = { "half still", "half turn", "half walk" };
+    int turnDirections[] = { 0, 1, 0 };
+    int walkDirections[] = { 0, 0, 1 };
+    long numPixels = (long)WINDOW_WIDTH * WINDOW_HEIGHT;
+    for (int i = 0; i < 3; i++) {
+        Player camera = { WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 1, 1, turnDirections[i], walkDirections[i], 0, 100, 45 * (M_PI / 180) };
+        interleaved.camera = camera;
+        renderView(&interleaved, &interleavedScene);
+
+        double interleavedTime = 0;
+        double fullTime = 0;
+        long wrongPixels = 0;
+        double error = 0;
+        for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+            movePlayer(scene->map, &interleaved.camera, TICK_LENGTH);
+            full.camera = interleaved.camera;
+            double start = secondsNow();
+            renderView(&interleaved, &interleavedScene);
+            interleavedTime += secondsNow() - start;
+            start = secondsNow();
+            renderView(&full, scene);
+            fullTime += secondsNow() - start;
+            for (long p = 0; p < numPixels; p++) {
+                uint32_t rebuilt = interleaved.colorBuffer[p];
+                uint32_t cast = full.colorBuffer[p];
+                if (rebuilt == cast) {
+                    continue;
+                }
+                wrongPixels++;
+                for (int shift = 0; shift < 24; shift += 8) {
+                    error += abs((int)((rebuilt >> shift) & 0xFF) - (int)((cast >> shift) & 0xFF));
+                }
+            }
+        }
+        printf("%-12s %10.3f %10.3f  (ms/frame casting half the columns and all of them, %.2f%% of pixels off, mean error %.3f)\n", names[i],
+            interleavedTime * 1000 / BENCH_FRAMES, fullTime * 1000 / BENCH_FRAMES,
+            wrongPixels * 100.0 / ((double)numPixels * BENCH_FRAMES), error / (3.0 * numPixels * BENCH_FRAMES));
+    }
+    renderContextDestroy(&interleaved);
+    renderContextDestroy(&full);
+}
+
+// the walking camera again, interleaved through a two frame pipeline whose slots take turns: each
+// frame must rebuild from the one submitted before it and come out as from a single context.
+// returns whether every frame did, false as well when the check could not run.
+bool benchInterleavedPipeline(const Scene *scene) {
+    FramePipeline *pipeline = framePipelineCreate(2, WINDOW_WIDTH, WINDOW_HEIGHT, NULL);
+    RenderContext single = { 0 };
+    uint32_t *hashes = (uint32_t*) malloc(sizeof(uint32_t) * BENCH_FRAMES);
+    if (pipeline == NULL || hashes == NULL || !renderContextInit(&single, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        framePipelineDestroy(pipeline);
+        renderContextDestroy(&single);
+        free(hashes);
+        return false;
+    }
+    Scene interleavedScene = *scene;
+    interleavedScene.interleaved = true;
+    Player start = { WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2, 1, 1, 0, 1, 0, 100, 45 * (M_PI / 180) };
+    single.camera = start;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        movePlayer(scene->map, &single.camera, TICK_LENGTH);
+        renderView(&single, &interleavedScene);
+        hashes[frame] = hashColorBuffer(0, &single);
+    }
+
+    // one frame more than compared, to push the last one out
+    Player camera = start;
+    int presented = 0;
+    int identical = 0;
+    double startTime = secondsNow();
+    for (int frame = 0; frame <= BENCH_FRAMES; frame++) {
+        movePlayer(scene->map, &camera, TICK_LENGTH);
+        framePipelineSubmit(pipeline, &camera, &interleavedScene);
+        RenderContext *presentedFrame = framePipelineAcquire(pipeline);
+        if (presentedFrame != NULL) {
+            if (presented < BENCH_FRAMES && hashColorBuffer(0, presentedFrame) == hashes[presented]) {
+                identical++;
+            }
+            presented++;
+            framePipelineRelease(pipeline, presentedFrame);
+        }
+    }
+    double elapsed = secondsNow() - startTime;
+    printf("%-12s %10.3f %10.1f  (walking through a 2 frame pipeline, %d of %d frames as from one context)\n", "half piped",
+        elapsed * 1000 / presented, presented / elapsed, identical, BENCH_FRAMES);
+    framePipelineDestroy(pipeline);
+    renderContextDestroy(&single);
+    free(hashes);
+    return identical == BENCH_FRAMES;
+}
+
+// replays a recorded camera path as fast as possible, one frame per simulation tick.
+// the checksum covers every rendered pixel, so equal checksums mean bit-identical frames.
+// a capture gets every frame, the replay waiting for the encoder whenever it falls behind.
+int benchReplay(Map *map, const Scene *scene, const char *replayFilePath, const char *captureFilePath) {
+    Replay replay;
+    if (!replayLoad(&replay, replayFilePath)) {
+        fprintf(stderr, "Error loading replay %s.\n", replayFilePath);
+        return 1;
+    }
+    RenderContext context = { 0 };
+    if (!renderContextInit(&context, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        replayDestroy(&replay);
+        return 1;
+    }
+    FrameCapture *capture = NULL;
+    if (captureFilePath != NULL) {
+        capture = frameCaptureCreate(captureFilePath, captureFormatOf(captureFilePath), WINDOW_WIDTH, WINDOW_HEIGHT,
+            TICK_RATE, CAPTURE_BUFFERS, CAPTURE_BLOCK, NULL);
+        if (capture == NULL) {
+            fprintf(stderr, "Error creating capture %s.\n", captureFilePath);
+            renderContextDestroy(&context);
+            replayDestroy(&replay);
+            return 1;
+        }
+    }
+    context.camera = replay.start;
+
+    int numFrames = 0;
+    uint32_t checksum = 2166136261u;
+    double start = secondsNow();
+    while (replayNextTick(&replay, &context.camera)) {
+        mapTriggerDoors(map, context.camera.x, context.camera.y, DOOR_TRIGGER_DISTANCE);
+        mapUpdateDoors(map, TICK_LENGTH);
+        movePlayer(map, &context.camera, TICK_LENGTH);
+        renderView(&context, scene);
+        checksum = hashColorBuffer(checksum, &context);
+        if (capture != NULL) {
+            frameCaptureSubmit(capture, context.colorBuffer);
+        }
+        numFrames++;
+    }
+    double elapsed = secondsNow() - start;
+    int status = 0;
+    if (capture != NULL) {
+        frameCaptureFlush(capture);
+        CaptureCounts counts = frameCaptureCounts(capture);
+        if (counts.failed) {
+            fprintf(stderr, "Error writing capture %s.\n", captureFilePath);
+            status = 1;
+        }
+        frameCaptureDestroy(capture);
+    }
+
+    printf("replay: %d frames, %.3f ms/frame, checksum %08x\n",
+        numFrames, numFrames > 0 ? elapsed * 1000 / numFrames : 0, checksum);
+    renderContextDestroy(&context);
+    replayDestroy(&replay);
+    return status;
+}
+
+// FNV-1a over the pixels of one frame
+uint32_t hashColorBuffer(uint32_t hash, const RenderContext *context) {
+    for (int i = 0; i < context->width * context->height; i++) {
+        hash = (hash ^ context->colorBuffer[i]) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,97 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t capacity;
+    size_t used;
+    unsigned char *memory;
+} ArenaBlock;
+
+struct Arena {
+    ArenaBlock *blocks;
+    size_t totalCapacity;
+};
+
+static ArenaBlock *arenaBlockCreate(size_t capacity);
+
+Arena *arenaCreate(size_t capacity) {
+    Arena *arena = (Arena*) calloc(1, sizeof(Arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->blocks = arenaBlockCreate(capacity);
+    if (arena->blocks == NULL) {
+        free(arena);
+        return NULL;
+    }
+    arena->totalCapacity = capacity;
+    return arena;
+}
+
+void arenaDestroy(Arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
+    while (arena->blocks != NULL) {
+        ArenaBlock *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    free(arena);
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+    ArenaBlock *block = arena->blocks;
+    size_t offset = (block->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (offset > block->capacity || size > block->capacity - offset) {
+        // the current block is full: chain a new one in front, big enough for this request
+        size_t capacity = block->capacity > size ? block->capacity : size;
+        ArenaBlock *grown = arenaBlockCreate(capacity);
+        if (grown == NULL) {
+            return NULL;
+        }
+        grown->next = block;
+        arena->blocks = grown;
+        arena->totalCapacity += capacity;
+        block = grown;
+        offset = 0;
+    }
+    block->used = offset + size;
+    return block->memory + offset;
+}
+
+void arenaReset(Arena *arena) {
+    if (arena->blocks->next != NULL) {
+        ArenaBlock *merged = arenaBlockCreate(arena->totalCapacity);
+        if (merged != NULL) {
+            while (arena->blocks != NULL) {
+                ArenaBlock *next = arena->blocks->next;
+                free(arena->blocks);
+                arena->blocks = next;
+            }
+            arena->blocks = merged;
+        }
+    }
+    for (ArenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+        block->used = 0;
+    }
+}
+
+// PRIVATE
+
+static ArenaBlock *arenaBlockCreate(size_t capacity) {
+    // one allocation for header and memory, with room to align the first byte
+    ArenaBlock *block = (ArenaBlock*) malloc(sizeof(ArenaBlock) + capacity + ARENA_ALIGNMENT);
+    if (block == NULL) {
+        return NULL;
+    }
+    uintptr_t start = (uintptr_t)(block + 1);
+    start = (start + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    block->memory = (unsigned char*) start;
+    return block;
+}
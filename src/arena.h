@@ -0,0 +1,22 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+// bump allocator for short-lived scratch memory: allocations are never freed
+// one by one, the whole arena is reset at once and its memory reused
+typedef struct Arena Arena;
+
+Arena *arenaCreate(size_t capacity);
+void arenaDestroy(Arena *arena);
+
+// returns ARENA_ALIGNMENT-aligned memory, or NULL if the arena cannot grow
+void *arenaAlloc(Arena *arena, size_t size);
+
+// releases every allocation; memory that had to be added since the last reset
+// is folded into a single block so the next round fits without growing
+void arenaReset(Arena *arena);
+
+#define ARENA_ALIGNMENT 64
+
+#endif
@@ -0,0 +1,267 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "capture.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pngwrite.h"
+
+struct FrameCapture {
+    CaptureFormat format;
+    CapturePolicy policy;
+    int width;
+    int height;
+    FILE *file;                 // NULL for png, which opens a file per frame
+    char *pngPath;              // room for the path with the frame number put in
+    size_t pngStemLength;       // the path up to its .png
+    uint32_t *frames;           // numBuffers frames of width * height pixels
+    int numBuffers;
+    int head;                   // next buffer the caller fills
+    int tail;                   // next buffer the encoder writes
+    int count;                  // filled buffers the encoder has not finished with
+    unsigned char *planes;      // the encoder's conversion scratch
+    CaptureCounts counts;
+    FrameStats *stats;
+    bool shuttingDown;
+    bool threadStarted;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t frameQueued;
+    pthread_cond_t bufferFreed;
+};
+
+static void *encoderThreadMain(void *argument);
+static bool writeFrame(FrameCapture *capture, const uint32_t *pixels, unsigned long index);
+static bool writeY4mFrame(FrameCapture *capture, const uint32_t *pixels);
+static bool hasExtension(const char *path, const char *extension);
+
+CaptureFormat captureFormatOf(const char *path) {
+    if (hasExtension(path, ".y4m")) {
+        return CAPTURE_Y4M;
+    }
+    return hasExtension(path, ".png") ? CAPTURE_PNG : CAPTURE_RAW;
+}
+
+FrameCapture *frameCaptureCreate(const char *path, CaptureFormat format, int width, int height, int fps,
+    int numBuffers, CapturePolicy policy, FrameStats *stats) {
+    if (width <= 0 || height <= 0 || numBuffers < 1) {
+        return NULL;
+    }
+    FrameCapture *capture = (FrameCapture*) calloc(1, sizeof(FrameCapture));
+    if (capture == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->frameQueued, NULL);
+    pthread_cond_init(&capture->bufferFreed, NULL);
+    capture->format = format;
+    capture->policy = policy;
+    capture->width = width;
+    capture->height = height;
+    capture->numBuffers = numBuffers;
+    capture->stats = stats;
+    size_t frameSize = (size_t)width * height;
+    capture->frames = (uint32_t*) malloc(sizeof(uint32_t) * frameSize * numBuffers);
+    // y4m chroma planes cover 2x2 pixels each, rounding up
+    size_t chromaSize = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    capture->planes = format == CAPTURE_Y4M ? (unsigned char*) malloc(frameSize + 2 * chromaSize) : NULL;
+    if (capture->frames == NULL || (format == CAPTURE_Y4M && capture->planes == NULL)) {
+        frameCaptureDestroy(capture);
+        return NULL;
+    }
+
+    if (format == CAPTURE_PNG) {
+        // room for 20 digits of frame number
+        capture->pngStemLength = strlen(path) - (hasExtension(path, ".png") ? 4 : 0);
+        capture->pngPath = (char*) malloc(capture->pngStemLength + 20 + 5);
+        if (capture->pngPath == NULL) {
+            frameCaptureDestroy(capture);
+            return NULL;
+        }
+        memcpy(capture->pngPath, path, capture->pngStemLength);
+    } else {
+        capture->file = fopen(path, "wb");
+        bool opened = capture->file != NULL;
+        if (opened && format == CAPTURE_Y4M) {
+            opened = fprintf(capture->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps) > 0;
+        }
+        if (!opened) {
+            frameCaptureDestroy(capture);
+            return NULL;
+        }
+    }
+
+    capture->threadStarted = pthread_create(&capture->thread, NULL, encoderThreadMain, capture) == 0;
+    if (!capture->threadStarted) {
+        frameCaptureDestroy(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+void frameCaptureDestroy(FrameCapture *capture) {
+    if (capture == NULL) {
+        return;
+    }
+    if (capture->threadStarted) {
+        pthread_mutex_lock(&capture->lock);
+        capture->shuttingDown = true;
+        pthread_cond_signal(&capture->frameQueued);
+        pthread_mutex_unlock(&capture->lock);
+        pthread_join(capture->thread, NULL);
+    }
+    pthread_cond_destroy(&capture->bufferFreed);
+    pthread_cond_destroy(&capture->frameQueued);
+    pthread_mutex_destroy(&capture->lock);
+    if (capture->file != NULL) {
+        fclose(capture->file);
+    }
+    free(capture->pngPath);
+    free(capture->planes);
+    free(capture->frames);
+    free(capture);
+}
+
+bool frameCaptureSubmit(FrameCapture *capture, const uint32_t *pixels) {
+    double start = statsNow();
+    pthread_mutex_lock(&capture->lock);
+    if (capture->count == capture->numBuffers && capture->policy == CAPTURE_DROP) {
+        capture->counts.dropped++;
+        pthread_mutex_unlock(&capture->lock);
+        return false;
+    }
+    while (capture->count == capture->numBuffers) {
+        pthread_cond_wait(&capture->bufferFreed, &capture->lock);
+    }
+    // only this thread moves the head, so the buffer stays ours while the lock is released for the copy
+    int buffer = capture->head;
+    pthread_mutex_unlock(&capture->lock);
+
+    size_t frameSize = (size_t)capture->width * capture->height;
+    memcpy(&capture->frames[frameSize * buffer], pixels, sizeof(uint32_t) * frameSize);
+
+    pthread_mutex_lock(&capture->lock);
+    capture->head = (capture->head + 1) % capture->numBuffers;
+    capture->count++;
+    capture->counts.captured++;
+    pthread_cond_signal(&capture->frameQueued);
+    pthread_mutex_unlock(&capture->lock);
+    statsRecord(capture->stats, STAT_CAPTURE, statsNow() - start);
+    return true;
+}
+
+void frameCaptureFlush(FrameCapture *capture) {
+    pthread_mutex_lock(&capture->lock);
+    while (capture->count > 0) {
+        pthread_cond_wait(&capture->bufferFreed, &capture->lock);
+    }
+    pthread_mutex_unlock(&capture->lock);
+}
+
+CaptureCounts frameCaptureCounts(FrameCapture *capture) {
+    pthread_mutex_lock(&capture->lock);
+    CaptureCounts counts = capture->counts;
+    pthread_mutex_unlock(&capture->lock);
+    return counts;
+}
+
+// PRIVATE
+
+// writes queued frames in order until shut down with none left
+static void *encoderThreadMain(void *argument) {
+    FrameCapture *capture = (FrameCapture*) argument;
+    size_t frameSize = (size_t)capture->width * capture->height;
+    unsigned long index = 0;
+
+    pthread_mutex_lock(&capture->lock);
+    for (;;) {
+        while (capture->count == 0 && !capture->shuttingDown) {
+            pthread_cond_wait(&capture->frameQueued, &capture->lock);
+        }
+        if (capture->count == 0) {
+            break;
+        }
+        int buffer = capture->tail;
+        bool failed = capture->counts.failed;
+        pthread_mutex_unlock(&capture->lock);
+
+        double start = statsNow();
+        bool written = !failed && writeFrame(capture, &capture->frames[frameSize * buffer], index++);
+        double elapsed = statsNow() - start;
+
+        pthread_mutex_lock(&capture->lock);
+        capture->tail = (capture->tail + 1) % capture->numBuffers;
+        capture->count--;
+        capture->counts.written += written ? 1 : 0;
+        capture->counts.failed = capture->counts.failed || !written;
+        capture->counts.encodeMilliseconds += elapsed;
+        pthread_cond_signal(&capture->bufferFreed);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+// a frame counts as written once it left the stdio buffer, so a full disk shows up on the frame it hit
+static bool writeFrame(FrameCapture *capture, const uint32_t *pixels, unsigned long index) {
+    size_t frameSize = (size_t)capture->width * capture->height;
+    switch (capture->format) {
+    case CAPTURE_Y4M:
+        return writeY4mFrame(capture, pixels) && fflush(capture->file) == 0;
+    case CAPTURE_PNG:
+        snprintf(&capture->pngPath[capture->pngStemLength], 20 + 5, "%05lu.png", index);
+        return pngWrite(capture->pngPath, pixels, capture->width, capture->height);
+    default:
+        return fwrite(pixels, sizeof(uint32_t), frameSize, capture->file) == frameSize && fflush(capture->file) == 0;
+    }
+}
+
+// BT.601 studio range, each chroma sample from the average of the 2x2 pixels it covers
+static bool writeY4mFrame(FrameCapture *capture, const uint32_t *pixels) {
+    int width = capture->width;
+    int height = capture->height;
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    unsigned char *luma = capture->planes;
+    unsigned char *blueDifference = &luma[(size_t)width * height];
+    unsigned char *redDifference = &blueDifference[(size_t)chromaWidth * chromaHeight];
+
+    for (int y = 0; y < height; y++) {
+        const uint32_t *row = &pixels[(size_t)y * width];
+        for (int x = 0; x < width; x++) {
+            int red = row[x] & 0xFF;
+            int green = (row[x] >> 8) & 0xFF;
+            int blue = (row[x] >> 16) & 0xFF;
+            luma[(size_t)y * width + x] = (unsigned char)(((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16);
+        }
+    }
+    for (int y = 0; y < chromaHeight; y++) {
+        // the last row and column are repeated when the size is odd
+        const uint32_t *top = &pixels[(size_t)(2 * y) * width];
+        const uint32_t *bottom = 2 * y + 1 < height ? top + width : top;
+        for (int x = 0; x < chromaWidth; x++) {
+            int left = 2 * x;
+            int right = left + 1 < width ? left + 1 : left;
+            uint32_t quad[4] = { top[left], top[right], bottom[left], bottom[right] };
+            int red = 0;
+            int green = 0;
+            int blue = 0;
+            for (int i = 0; i < 4; i++) {
+                red += quad[i] & 0xFF;
+                green += (quad[i] >> 8) & 0xFF;
+                blue += (quad[i] >> 16) & 0xFF;
+            }
+            // sums of four pixels, so the rounding and shift take a factor of 4 along
+            blueDifference[(size_t)y * chromaWidth + x] = (unsigned char)(((-38 * red - 74 * green + 112 * blue + 512) >> 10) + 128);
+            redDifference[(size_t)y * chromaWidth + x] = (unsigned char)(((112 * red - 94 * green - 18 * blue + 512) >> 10) + 128);
+        }
+    }
+    size_t planesSize = (size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight;
+    return fputs("FRAME\n", capture->file) != EOF && fwrite(capture->planes, 1, planesSize, capture->file) == planesSize;
+}
+
+static bool hasExtension(const char *path, const char *extension) {
+    size_t length = strlen(path);
+    size_t extensionLength = strlen(extension);
+    return length >= extensionLength && strcmp(&path[length - extensionLength], extension) == 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stats.h"
+
+typedef enum CaptureFormat {
+    CAPTURE_RAW,    // every frame's pixels one after another, 4 bytes each in color buffer order
+    CAPTURE_Y4M,    // YUV4MPEG2 video, 4:2:0, which video players and encoders read directly
+    CAPTURE_PNG     // a numbered png per frame: shots/frame.png writes shots/frame00000.png onwards
+} CaptureFormat;
+
+typedef enum CapturePolicy {
+    CAPTURE_DROP,   // a frame arriving while every buffer is full is skipped; the game never waits
+    CAPTURE_BLOCK   // the caller waits for a free buffer; no frame is lost
+} CapturePolicy;
+
+typedef struct CaptureCounts {
+    unsigned long captured;     // handed over to the encoder
+    unsigned long dropped;
+    unsigned long written;
+    bool failed;                // a write failed; frames after it are counted but not written
+    double encodeMilliseconds;  // spent converting and writing on the encoder thread
+} CaptureCounts;
+
+// writes finished frames to disk on a thread of its own. frames are copied into one of a fixed
+// number of buffers allocated up front, so capturing costs the caller a memcpy per frame; the
+// encoder converts and writes them in order, and the buffer goes back to the ring.
+typedef struct FrameCapture FrameCapture;
+
+// by the path's extension: .y4m, .png, anything else is raw
+CaptureFormat captureFormatOf(const char *path);
+
+// returns NULL when out of memory, the file cannot be created or no thread could be started;
+// fps only goes into the header of a y4m file
+FrameCapture *frameCaptureCreate(const char *path, CaptureFormat format, int width, int height, int fps,
+    int numBuffers, CapturePolicy policy, FrameStats *stats);
+// writes every frame still queued, then closes the file
+void frameCaptureDestroy(FrameCapture *capture);
+
+// copies a width x height color buffer into the ring, recording the time it took as STAT_CAPTURE.
+// returns false when the frame was dropped.
+bool frameCaptureSubmit(FrameCapture *capture, const uint32_t *pixels);
+// waits until every frame submitted so far is written
+void frameCaptureFlush(FrameCapture *capture);
+CaptureCounts frameCaptureCounts(FrameCapture *capture);
+
+#endif
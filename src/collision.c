@@ -0,0 +1,240 @@
+#include "collision.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// bodies checked against each other per body and tick; a pile denser than this resolves over several ticks
+#define MAX_NEIGHBOURS 64
+// buckets a query remembers to skip repeats; wider queries may report some bodies twice
+#define MAX_QUERY_BUCKETS 16
+
+struct SpatialHash {
+    float cellSize;
+    float maxRadius;        // of the bodies the hash was last built from
+    int numBuckets;         // a power of two, at least twice the number of bodies
+    int capacity;           // bodies the arrays below have room for
+    int *bucketStart;       // numBuckets + 1 offsets into entries
+    int *entries;           // body indices sorted by bucket
+    int *bodyBuckets;       // bucket of every body
+};
+
+static void pushOutOfWalls(const Map *map, float *x, float *y, float radius);
+static bool growHash(SpatialHash *hash, int numBodies);
+static int bucketOf(const SpatialHash *hash, float x, float y);
+static int bucketAt(const SpatialHash *hash, int col, int row);
+static void separateBodies(const Map *map, Body *body, Body *other);
+
+void collisionMoveCircle(const Map *map, float *x, float *y, float radius, float dx, float dy) {
+    float length = sqrtf(dx * dx + dy * dy);
+    float maxStep = radius > 0 ? radius / 2 : TILE_SIZE / 4;
+    int numSteps = (int)(length / maxStep) + 1;
+    float stepX = dx / numSteps;
+    float stepY = dy / numSteps;
+    for (int step = 0; step < numSteps; step++) {
+        float nextX = *x + stepX;
+        float nextY = *y + stepY;
+        pushOutOfWalls(map, &nextX, &nextY, radius);
+        if (mapHasWallAt(map, nextX, nextY)) {
+            return;
+        }
+        *x = nextX;
+        *y = nextY;
+    }
+}
+
+SpatialHash *spatialHashCreate(float cellSize) {
+    SpatialHash *hash = (SpatialHash*) calloc(1, sizeof(SpatialHash));
+    if (hash != NULL) {
+        hash->cellSize = cellSize;
+    }
+    return hash;
+}
+
+void spatialHashDestroy(SpatialHash *hash) {
+    if (hash == NULL) {
+        return;
+    }
+    free(hash->bucketStart);
+    free(hash->entries);
+    free(hash->bodyBuckets);
+    free(hash);
+}
+
+// a counting sort: count the bodies per bucket, turn the counts into offsets, then place every body
+bool spatialHashBuild(SpatialHash *hash, const Body *bodies, int numBodies) {
+    // a hash never built for any bodies has no buckets yet, which queries already take as empty
+    if (hash->numBuckets == 0 && numBodies == 0) {
+        hash->maxRadius = 0;
+        return true;
+    }
+    if (numBodies > hash->capacity && !growHash(hash, numBodies)) {
+        return false;
+    }
+    for (int i = 0; i <= hash->numBuckets; i++) {
+        hash->bucketStart[i] = 0;
+    }
+    hash->maxRadius = 0;
+    for (int i = 0; i < numBodies; i++) {
+        int bucket = bucketOf(hash, bodies[i].x, bodies[i].y);
+        hash->bodyBuckets[i] = bucket;
+        hash->bucketStart[bucket + 1]++;
+        hash->maxRadius = bodies[i].radius > hash->maxRadius ? bodies[i].radius : hash->maxRadius;
+    }
+    for (int i = 0; i < hash->numBuckets; i++) {
+        hash->bucketStart[i + 1] += hash->bucketStart[i];
+    }
+    // placing every body advances its bucket's start to the next bucket's, so shift them back after
+    for (int i = 0; i < numBodies; i++) {
+        hash->entries[hash->bucketStart[hash->bodyBuckets[i]]++] = i;
+    }
+    for (int i = hash->numBuckets; i > 0; i--) {
+        hash->bucketStart[i] = hash->bucketStart[i - 1];
+    }
+    hash->bucketStart[0] = 0;
+    return true;
+}
+
+int spatialHashQuery(const SpatialHash *hash, float x, float y, float distance, int *results, int maxResults) {
+    if (hash->numBuckets == 0) {
+        return 0;
+    }
+    int firstCol = (int)floorf((x - distance) / hash->cellSize);
+    int lastCol = (int)floorf((x + distance) / hash->cellSize);
+    int firstRow = (int)floorf((y - distance) / hash->cellSize);
+    int lastRow = (int)floorf((y + distance) / hash->cellSize);
+    // squares that hash to a bucket already visited would report its bodies twice
+    int visited[MAX_QUERY_BUCKETS];
+    int numVisited = 0;
+    int numResults = 0;
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int col = firstCol; col <= lastCol; col++) {
+            int bucket = bucketAt(hash, col, row);
+            bool seen = false;
+            for (int v = 0; v < numVisited && !seen; v++) {
+                seen = visited[v] == bucket;
+            }
+            if (seen) {
+                continue;
+            }
+            if (numVisited < MAX_QUERY_BUCKETS) {
+                visited[numVisited++] = bucket;
+            }
+            for (int i = hash->bucketStart[bucket]; i < hash->bucketStart[bucket + 1] && numResults < maxResults; i++) {
+                results[numResults++] = hash->entries[i];
+            }
+        }
+    }
+    return numResults;
+}
+
+bool collisionStepBodies(const Map *map, SpatialHash *hash, Body *bodies, int numBodies, float deltaTime) {
+    for (int i = 0; i < numBodies; i++) {
+        Body *body = &bodies[i];
+        collisionMoveCircle(map, &body->x, &body->y, body->radius, body->velocityX * deltaTime, body->velocityY * deltaTime);
+    }
+    if (!spatialHashBuild(hash, bodies, numBodies)) {
+        return false;
+    }
+    // every overlapping pair is separated once, by the body with the lower index. bodies are
+    // visited bucket by bucket, so neighbouring queries find the same buckets still in cache.
+    int neighbours[MAX_NEIGHBOURS];
+    for (int sorted = 0; sorted < numBodies; sorted++) {
+        int i = hash->entries[sorted];
+        Body *body = &bodies[i];
+        int numNeighbours = spatialHashQuery(hash, body->x, body->y, body->radius + hash->maxRadius, neighbours, MAX_NEIGHBOURS);
+        for (int n = 0; n < numNeighbours; n++) {
+            if (neighbours[n] > i) {
+                separateBodies(map, body, &bodies[neighbours[n]]);
+            }
+        }
+    }
+    return true;
+}
+
+// PRIVATE
+
+// pushes the circle out of every solid cell it overlaps, along the line from the nearest point of the
+// cell to its center. walls meeting at a corner can push it back into each other, so a push is checked once more.
+static void pushOutOfWalls(const Map *map, float *x, float *y, float radius) {
+    bool pushed = true;
+    for (int pass = 0; pass < 2 && pushed; pass++) {
+        pushed = false;
+        int firstCol = (int)floorf((*x - radius) / TILE_SIZE);
+        int lastCol = (int)floorf((*x + radius) / TILE_SIZE);
+        int firstRow = (int)floorf((*y - radius) / TILE_SIZE);
+        int lastRow = (int)floorf((*y + radius) / TILE_SIZE);
+        for (int row = firstRow; row <= lastRow; row++) {
+            for (int col = firstCol; col <= lastCol; col++) {
+                float left = col * TILE_SIZE;
+                float top = row * TILE_SIZE;
+                if (!mapHasWallAt(map, left + TILE_SIZE / 2, top + TILE_SIZE / 2)) {
+                    continue;
+                }
+                float nearestX = *x < left ? left : *x > left + TILE_SIZE ? left + TILE_SIZE : *x;
+                float nearestY = *y < top ? top : *y > top + TILE_SIZE ? top + TILE_SIZE : *y;
+                float awayX = *x - nearestX;
+                float awayY = *y - nearestY;
+                float distanceSquared = awayX * awayX + awayY * awayY;
+                // a center inside the cell has no way out; the caller refuses that step
+                if (distanceSquared >= radius * radius || distanceSquared == 0) {
+                    continue;
+                }
+                float distance = sqrtf(distanceSquared);
+                *x += awayX / distance * (radius - distance);
+                *y += awayY / distance * (radius - distance);
+                pushed = true;
+            }
+        }
+    }
+}
+
+static bool growHash(SpatialHash *hash, int numBodies) {
+    int numBuckets = 16;
+    while (numBuckets < 2 * numBodies) {
+        numBuckets *= 2;
+    }
+    int *bucketStart = (int*) malloc(sizeof(int) * (size_t)(numBuckets + 1));
+    int *entries = (int*) malloc(sizeof(int) * (size_t)numBodies);
+    int *bodyBuckets = (int*) malloc(sizeof(int) * (size_t)numBodies);
+    if (bucketStart == NULL || entries == NULL || bodyBuckets == NULL) {
+        free(bucketStart);
+        free(entries);
+        free(bodyBuckets);
+        return false;
+    }
+    free(hash->bucketStart);
+    free(hash->entries);
+    free(hash->bodyBuckets);
+    hash->bucketStart = bucketStart;
+    hash->entries = entries;
+    hash->bodyBuckets = bodyBuckets;
+    hash->numBuckets = numBuckets;
+    hash->capacity = numBodies;
+    return true;
+}
+
+static int bucketOf(const SpatialHash *hash, float x, float y) {
+    return bucketAt(hash, (int)floorf(x / hash->cellSize), (int)floorf(y / hash->cellSize));
+}
+
+static int bucketAt(const SpatialHash *hash, int col, int row) {
+    uint32_t key = ((uint32_t)col * 73856093u) ^ ((uint32_t)row * 19349663u);
+    return (int)(key & (uint32_t)(hash->numBuckets - 1));
+}
+
+// moves both bodies half the overlap apart; bodies on the same spot part along x
+static void separateBodies(const Map *map, Body *body, Body *other) {
+    float awayX = other->x - body->x;
+    float awayY = other->y - body->y;
+    float minDistance = body->radius + other->radius;
+    float distanceSquared = awayX * awayX + awayY * awayY;
+    if (distanceSquared >= minDistance * minDistance) {
+        return;
+    }
+    float distance = sqrtf(distanceSquared);
+    float normalX = distance > 0 ? awayX / distance : 1;
+    float normalY = distance > 0 ? awayY / distance : 0;
+    float push = (minDistance - distance) / 2;
+    collisionMoveCircle(map, &body->x, &body->y, body->radius, -normalX * push, -normalY * push);
+    collisionMoveCircle(map, &other->x, &other->y, other->radius, normalX * push, normalY * push);
+}
@@ -0,0 +1,40 @@
+#ifndef _COLLISION_H_
+#define _COLLISION_H_
+
+#include <stdbool.h>
+#include "map.h"
+
+// a moving circle, e.g. a monster or a projectile
+typedef struct Body {
+    float x;
+    float y;
+    float radius;
+    float velocityX;    // units per second
+    float velocityY;
+} Body;
+
+// buckets bodies by the square of side cellSize their center lies in. the buckets are hashed
+// into a table sized to the number of bodies, and bodies are sorted by bucket when the hash is
+// built, so each bucket is one contiguous run of indices and the hash never allocates once it
+// has grown to the largest number of bodies it was built for.
+typedef struct SpatialHash SpatialHash;
+
+// moves a circle by (dx, dy), sliding along the walls it touches instead of stopping at them.
+// the move is split into steps of at most half the radius, so it cannot tunnel through a wall
+// or clip a corner. a circle that would end up with its center inside a wall stays put.
+void collisionMoveCircle(const Map *map, float *x, float *y, float radius, float dx, float dy);
+
+SpatialHash *spatialHashCreate(float cellSize);
+void spatialHashDestroy(SpatialHash *hash);
+// fails only when out of memory
+bool spatialHashBuild(SpatialHash *hash, const Body *bodies, int numBodies);
+// collects up to maxResults indices of bodies that may lie within distance of (x, y), plus
+// whatever else shares their buckets, and returns how many it found. queries spanning more than
+// 16 squares may report a body twice.
+int spatialHashQuery(const SpatialHash *hash, float x, float y, float distance, int *results, int maxResults);
+
+// one simulation tick: moves every body through the map, then pushes apart the bodies that
+// overlap, again sliding along walls. fails only when the hash cannot grow.
+bool collisionStepBodies(const Map *map, SpatialHash *hash, Body *bodies, int numBodies, float deltaTime);
+
+#endif
@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <math.h>
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 #define TILE_SIZE 64
 #define MAP_NUM_ROWS 13
 #define MAP_NUM_COLS 20
@@ -14,9 +18,6 @@
 #define WINDOW_WIDTH (MAP_NUM_COLS * TILE_SIZE)
 #define WINDOW_HEIGHT (MAP_NUM_ROWS * TILE_SIZE)
 
-#define TEXTURE_WIDTH 64
-#define TEXTURE_HEIGHT 64
-
 #define FOV_ANGLE (60 * (M_PI / 180))
 
 #define NUM_RAYS WINDOW_WIDTH
@@ -24,6 +25,32 @@
 #define FPS 30
 #define FRAME_TIME_LENGTH (1000 / FPS)
 
+// the simulation always advances in fixed steps so recorded input replays identically
+#define TICK_RATE 60
+#define TICK_LENGTH (1.0f / TICK_RATE)
+
+#define PIPELINE_DEPTH 2
+
+// --capture copies frames into this many buffers for the encoder thread to write out
+#define CAPTURE_BUFFERS 8
+
+// the player collides with walls as a circle of this radius
+#define PLAYER_RADIUS (TILE_SIZE / 6.0f)
+
+// doors slide open when the player comes this close and take 1 / DOOR_SPEED seconds to open
+#define DOOR_TRIGGER_DISTANCE (1.5f * TILE_SIZE)
+#define DOOR_SPEED 1.5f
+
+// a ray passes through at most this many portals, past that a portal shows as a wall
+#define MAX_PORTAL_HOPS 8
+
+// the light --torch has the player carry, reaching this far
+#define TORCH_RADIUS (5.0f * TILE_SIZE)
+#define TORCH_BRIGHTNESS 1.2f
+
+// see-through walls one screen column can show; any more in a column are drawn opaque
+#define MAX_COLUMN_HITS 16
+
 #define REDBRICK_TEXTURE_FILEPATH "./images/redbrick.png"
 #define PURPLESTONE_TEXTURE_FILEPATH "./images/purplestone.png"
 #define MOSSYSTONE_TEXTURE_FILEPATH "./images/mossystone.png"
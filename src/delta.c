@@ -0,0 +1,174 @@
+#include "delta.h"
+
+// every op is one byte: its type in the top two bits and its length, 1 to 64, in the rest
+#define DELTA_SAME 0        // pixels unchanged from the reference
+#define DELTA_FILL 1        // one color, given once, repeated
+#define DELTA_LITERAL 2     // a color per pixel
+#define DELTA_COLUMNS 3     // whole columns unchanged from the reference, only where a column starts
+#define DELTA_MAX_RUN 64
+
+#define COLOR_MASK 0x00FFFFFF
+
+static void findChangedColumns(const uint32_t *frame, const uint32_t *reference, int stride, int height, int numColumns, bool *changed);
+static unsigned char *encodeColumn(const uint32_t *column, const uint32_t *reference, int stride, int height, unsigned char *out);
+static bool startsRun(const uint32_t *column, const uint32_t *reference, int stride, int height, int y);
+static unsigned char *writeOp(unsigned char *out, int type, int count);
+static unsigned char *writeColor(unsigned char *out, uint32_t color);
+
+size_t deltaEncodeBound(int width, int height) {
+    // no op takes more than 4 bytes a pixel, and a column at most one op more
+    return (size_t)width * height * 4 + width;
+}
+
+size_t deltaEncode(const uint32_t *frame, const uint32_t *reference, int width, int height, unsigned char *out) {
+    unsigned char *start = out;
+    int unchangedColumns = 0;
+    bool changed[DELTA_MAX_RUN];
+    for (int x = 0; x < width; x++) {
+        if (reference != NULL && x % DELTA_MAX_RUN == 0) {
+            int numColumns = width - x < DELTA_MAX_RUN ? width - x : DELTA_MAX_RUN;
+            findChangedColumns(&frame[x], &reference[x], width, height, numColumns, changed);
+        }
+        if (reference != NULL && !changed[x % DELTA_MAX_RUN]) {
+            if (++unchangedColumns == DELTA_MAX_RUN) {
+                out = writeOp(out, DELTA_COLUMNS, unchangedColumns);
+                unchangedColumns = 0;
+            }
+            continue;
+        }
+        if (unchangedColumns > 0) {
+            out = writeOp(out, DELTA_COLUMNS, unchangedColumns);
+            unchangedColumns = 0;
+        }
+        out = encodeColumn(&frame[x], reference != NULL ? &reference[x] : NULL, width, height, out);
+    }
+    if (unchangedColumns > 0) {
+        out = writeOp(out, DELTA_COLUMNS, unchangedColumns);
+    }
+    return (size_t)(out - start);
+}
+
+bool deltaDecode(const unsigned char *data, size_t size, uint32_t *frame, int width, int height) {
+    const unsigned char *end = data + size;
+    int x = 0;
+    int y = 0;
+    while (data < end) {
+        int type = *data >> 6;
+        int count = (*data & (DELTA_MAX_RUN - 1)) + 1;
+        data++;
+        if (type == DELTA_COLUMNS) {
+            if (y != 0 || count > width - x) {
+                return false;
+            }
+            x += count;
+            continue;
+        }
+        if (x >= width || count > height - y) {
+            return false;
+        }
+        uint32_t *pixel = &frame[(size_t)y * width + x];
+        if (type == DELTA_FILL) {
+            if (end - data < 3) {
+                return false;
+            }
+            uint32_t color = 0xFF000000 | data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16);
+            for (int i = 0; i < count; i++) {
+                pixel[(size_t)i * width] = color;
+            }
+            data += 3;
+        } else if (type == DELTA_LITERAL) {
+            if (end - data < 3 * count) {
+                return false;
+            }
+            for (int i = 0; i < count; i++) {
+                pixel[(size_t)i * width] = 0xFF000000 | data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16);
+                data += 3;
+            }
+        }
+        y += count;
+        if (y == height) {
+            y = 0;
+            x++;
+        }
+    }
+    return x == width && y == 0;
+}
+
+// PRIVATE
+
+// compares a strip of columns row by row, which walks memory in order where comparing a column
+// at a time would touch a cache line per pixel
+static void findChangedColumns(const uint32_t *frame, const uint32_t *reference, int stride, int height, int numColumns, bool *changed) {
+    for (int x = 0; x < numColumns; x++) {
+        changed[x] = false;
+    }
+    for (int y = 0; y < height; y++) {
+        const uint32_t *row = &frame[(size_t)y * stride];
+        const uint32_t *referenceRow = &reference[(size_t)y * stride];
+        for (int x = 0; x < numColumns; x++) {
+            changed[x] |= ((row[x] ^ referenceRow[x]) & COLOR_MASK) != 0;
+        }
+    }
+}
+
+// takes the longest of the runs starting at each pixel, preferring unchanged pixels as the
+// cheapest, and gathers pixels that start no run of two into literals
+static unsigned char *encodeColumn(const uint32_t *column, const uint32_t *reference, int stride, int height, unsigned char *out) {
+    int y = 0;
+    while (y < height) {
+        uint32_t color = column[(size_t)y * stride] & COLOR_MASK;
+        int same = 0;
+        if (reference != NULL) {
+            while (y + same < height && same < DELTA_MAX_RUN
+                && ((column[(size_t)(y + same) * stride] ^ reference[(size_t)(y + same) * stride]) & COLOR_MASK) == 0) {
+                same++;
+            }
+        }
+        int fill = 1;
+        while (y + fill < height && fill < DELTA_MAX_RUN && (column[(size_t)(y + fill) * stride] & COLOR_MASK) == color) {
+            fill++;
+        }
+
+        if (same > 0 && same >= fill) {
+            out = writeOp(out, DELTA_SAME, same);
+            y += same;
+        } else if (fill > 1) {
+            out = writeOp(out, DELTA_FILL, fill);
+            out = writeColor(out, color);
+            y += fill;
+        } else {
+            int literal = 1;
+            while (y + literal < height && literal < DELTA_MAX_RUN && !startsRun(column, reference, stride, height, y + literal)) {
+                literal++;
+            }
+            out = writeOp(out, DELTA_LITERAL, literal);
+            for (int i = 0; i < literal; i++) {
+                out = writeColor(out, column[(size_t)(y + i) * stride]);
+            }
+            y += literal;
+        }
+    }
+    return out;
+}
+
+// whether pixel y is unchanged or has the color of the pixel below it
+static bool startsRun(const uint32_t *column, const uint32_t *reference, int stride, int height, int y) {
+    uint32_t color = column[(size_t)y * stride];
+    if (reference != NULL && ((color ^ reference[(size_t)y * stride]) & COLOR_MASK) == 0) {
+        return true;
+    }
+    return y + 1 < height && ((color ^ column[(size_t)(y + 1) * stride]) & COLOR_MASK) == 0;
+}
+
+static unsigned char *writeOp(unsigned char *out, int type, int count) {
+    *out = (unsigned char)((type << 6) | (count - 1));
+    return out + 1;
+}
+
+// red first, as in the color buffer's memory
+static unsigned char *writeColor(unsigned char *out, uint32_t color) {
+    out[0] = color & 0xFF;
+    out[1] = (color >> 8) & 0xFF;
+    out[2] = (color >> 16) & 0xFF;
+    return out + 3;
+}
@@ -0,0 +1,27 @@
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a lossless encoding of a color buffer against the frame before it, for sending frames over a
+// network. frames are walked column by column, the way they are cast: a column the camera did
+// not change costs a byte per 64 columns, and within a changed column runs of pixels that kept
+// their color, runs of one color such as ceiling and floor, and magnified wall texels collapse
+// into a byte or four each. everything else is sent as 3 byte pixels.
+//
+// only the color channels are sent; decoded pixels are opaque, as every presented frame is.
+
+// the most bytes deltaEncode can write for a frame of this size
+size_t deltaEncodeBound(int width, int height);
+
+// encodes frame against reference, the frame the decoder holds, or against nothing when
+// reference is NULL; returns the number of bytes written to out
+size_t deltaEncode(const uint32_t *frame, const uint32_t *reference, int width, int height, unsigned char *out);
+
+// applies an encoded frame to frame, which must hold the reference it was encoded against, unless
+// it was encoded against nothing; returns false when the data does not describe a whole frame
+bool deltaDecode(const unsigned char *data, size_t size, uint32_t *frame, int width, int height);
+
+#endif
@@ -0,0 +1,463 @@
+#include "flowfield.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FLOWFIELD_USE_SSE2
+#endif
+
+// distances of cells without one; walls are kept in the distances too, so the searches read one array
+#define WALL UINT32_MAX
+#define UNREACHABLE (UINT32_MAX - 1)
+#define NO_DIRECTION 8
+
+// cell flags
+#define QUEUED 1    // waiting in the repair queue
+#define DIRTY 2     // in the dirty list
+
+// the grid is stored with a border of unwalkable cells around it, so walking to a neighbour never
+// needs a bounds check; neighbour 0 to 3 share a side with the cell, 4 to 7 a corner.
+struct FlowField {
+    unsigned long serial;       // of the map the field was built for
+    unsigned long revision;     // of that map, the field is up to date with
+    int numRows;
+    int numCols;
+    int stride;                 // numCols plus the border
+    int goalCol;
+    int goalRow;
+    int capacity;               // cells the arrays below have room for
+    int offsets[8];             // from a cell to its neighbours
+    uint32_t *distances;        // steps to the goal per cell, UNREACHABLE or WALL
+    unsigned char *flags;
+    unsigned char *directions;  // neighbour to move on to, NO_DIRECTION at the goal or without a way there
+    int *queue;                 // search frontier, or cells that lost their way while updating
+    uint32_t *lostDistances;    // what those cells' distances were
+    int *dirty;                 // cells whose distance or walkability changed while updating
+    int numDirty;
+};
+
+typedef struct FieldUpdate {
+    FlowField *field;
+    const Map *map;
+    int numLost;
+} FieldUpdate;
+
+static const float directionX[8] = { 1, 0, -1, 0, 0.70710678f, -0.70710678f, -0.70710678f, 0.70710678f };
+static const float directionY[8] = { 0, 1, 0, -1, 0.70710678f, 0.70710678f, -0.70710678f, -0.70710678f };
+
+static bool fitGrid(FlowField *field, const Map *map);
+static bool isWalkableCell(const Map *map, int cell);
+static int cellOf(const FlowField *field, float x, float y);
+static void spreadFromGoal(FlowField *field);
+static void pointAllCells(FlowField *field);
+static int pointCellsSse2(unsigned char *directions, const uint32_t *here, int stride, int numCols);
+static void applyChange(void *user, int col, int row);
+static void markDirty(FlowField *field, int cell);
+static bool hasWayOn(const FlowField *field, int cell);
+static void loseWays(FlowField *field, int numLost);
+static void repairDistances(FlowField *field);
+static void pointCell(FlowField *field, int cell);
+static unsigned char directionOf(const uint32_t *distances, int cell, int stride);
+
+FlowField *flowFieldCreate(void) {
+    FlowField *field = (FlowField*) calloc(1, sizeof(FlowField));
+    if (field != NULL) {
+        field->goalCol = -1;
+        field->goalRow = -1;
+    }
+    return field;
+}
+
+void flowFieldDestroy(FlowField *field) {
+    if (field == NULL) {
+        return;
+    }
+    free(field->distances);
+    free(field->flags);
+    free(field->directions);
+    free(field->queue);
+    free(field->lostDistances);
+    free(field->dirty);
+    free(field);
+}
+
+bool flowFieldBuild(FlowField *field, const Map *map, int goalCol, int goalRow) {
+    if (!fitGrid(field, map)) {
+        return false;
+    }
+    field->serial = map->serial;
+    field->revision = mapRevision(map);
+    field->goalCol = goalCol;
+    field->goalRow = goalRow;
+    int numCells = field->stride * (field->numRows + 2);
+    memset(field->flags, 0, (size_t)numCells);
+    // the border is never pointed; pointAllCells covers everything inside it
+    for (int cell = 0; cell < field->stride; cell++) {
+        field->distances[cell] = WALL;
+        field->distances[numCells - 1 - cell] = WALL;
+        field->directions[cell] = NO_DIRECTION;
+        field->directions[numCells - 1 - cell] = NO_DIRECTION;
+    }
+    // empty cells first, without a branch on the maze, then the few doors that are open
+    for (int row = 0; row < map->numRows; row++) {
+        uint32_t *distances = &field->distances[(row + 1) * field->stride];
+        const int *cells = &map->cells[row * map->numCols];
+        distances[0] = WALL;
+        distances[map->numCols + 1] = WALL;
+        field->directions[(row + 1) * field->stride] = NO_DIRECTION;
+        field->directions[(row + 1) * field->stride + map->numCols + 1] = NO_DIRECTION;
+        for (int col = 0; col < map->numCols; col++) {
+            distances[col + 1] = cells[col] == 0 ? UNREACHABLE : WALL;
+        }
+    }
+    for (int i = 0; i < map->numDoors; i++) {
+        int cell = map->doorCells[i];
+        if (isWalkableCell(map, cell)) {
+            field->distances[(cell / map->numCols + 1) * field->stride + cell % map->numCols + 1] = UNREACHABLE;
+        }
+    }
+    spreadFromGoal(field);
+    pointAllCells(field);
+    return true;
+}
+
+// cells that became walls lose their distance, and so does every cell whose only ways to the goal
+// led through one of them. those cells and the cells that became walkable then take their distance
+// from their neighbours again, spreading outwards for as long as a distance shrinks.
+bool flowFieldUpdate(FlowField *field, const Map *map) {
+    if (field->distances == NULL || field->serial != map->serial || field->numRows != map->numRows || field->numCols != map->numCols) {
+        return flowFieldBuild(field, map, field->goalCol, field->goalRow);
+    }
+    FieldUpdate update = { field, map, 0 };
+    field->numDirty = 0;
+    if (!mapForEachChange(map, field->revision, applyChange, &update)) {
+        return flowFieldBuild(field, map, field->goalCol, field->goalRow);
+    }
+    field->revision = mapRevision(map);
+    loseWays(field, update.numLost);
+    repairDistances(field);
+
+    // a changed cell can change the way on of all of its neighbours, even without changing its distance
+    for (int i = 0; i < field->numDirty; i++) {
+        int cell = field->dirty[i];
+        field->flags[cell] &= ~DIRTY;
+        pointCell(field, cell);
+        for (int n = 0; n < 8; n++) {
+            pointCell(field, cell + field->offsets[n]);
+        }
+    }
+    return true;
+}
+
+int flowFieldDistance(const FlowField *field, float x, float y) {
+    int cell = cellOf(field, x, y);
+    return cell >= 0 && field->distances[cell] < UNREACHABLE ? (int)field->distances[cell] : -1;
+}
+
+bool flowFieldDirection(const FlowField *field, float x, float y, float *dirX, float *dirY) {
+    int cell = cellOf(field, x, y);
+    if (cell < 0 || field->directions[cell] == NO_DIRECTION) {
+        return false;
+    }
+    *dirX = directionX[field->directions[cell]];
+    *dirY = directionY[field->directions[cell]];
+    return true;
+}
+
+// PRIVATE
+
+static bool fitGrid(FlowField *field, const Map *map) {
+    int stride = map->numCols + 2;
+    int numCells = stride * (map->numRows + 2);
+    if (numCells > field->capacity) {
+        uint32_t *distances = (uint32_t*) malloc(sizeof(uint32_t) * (size_t)numCells);
+        unsigned char *flags = (unsigned char*) malloc((size_t)numCells);
+        unsigned char *directions = (unsigned char*) malloc((size_t)numCells);
+        int *queue = (int*) malloc(sizeof(int) * (size_t)numCells);
+        uint32_t *lostDistances = (uint32_t*) malloc(sizeof(uint32_t) * (size_t)numCells);
+        int *dirty = (int*) malloc(sizeof(int) * (size_t)numCells);
+        if (distances == NULL || flags == NULL || directions == NULL || queue == NULL || lostDistances == NULL || dirty == NULL) {
+            free(distances);
+            free(flags);
+            free(directions);
+            free(queue);
+            free(lostDistances);
+            free(dirty);
+            return false;
+        }
+        free(field->distances);
+        free(field->flags);
+        free(field->directions);
+        free(field->queue);
+        free(field->lostDistances);
+        free(field->dirty);
+        field->distances = distances;
+        field->flags = flags;
+        field->directions = directions;
+        field->queue = queue;
+        field->lostDistances = lostDistances;
+        field->dirty = dirty;
+        field->capacity = numCells;
+    }
+    field->numRows = map->numRows;
+    field->numCols = map->numCols;
+    field->stride = stride;
+    int offsets[8] = { 1, stride, -1, -stride, stride + 1, stride - 1, -stride - 1, -stride + 1 };
+    for (int n = 0; n < 8; n++) {
+        field->offsets[n] = offsets[n];
+    }
+    return true;
+}
+
+// mapHasWallAt on the cell's index, as looking the cell up by position for every cell of a
+// large map takes longer than the search itself. portal cells are never empty nor doors.
+static bool isWalkableCell(const Map *map, int cell) {
+    return map->cells[cell] == 0 || (map->doors[cell].orientation != DOOR_NONE && map->doors[cell].openAmount >= 1);
+}
+
+static int cellOf(const FlowField *field, float x, float y) {
+    if (field->distances == NULL) {
+        return -1;
+    }
+    int col = (int)floorf(x / TILE_SIZE);
+    int row = (int)floorf(y / TILE_SIZE);
+    if (col < 0 || col >= field->numCols || row < 0 || row >= field->numRows) {
+        return -1;
+    }
+    return (row + 1) * field->stride + col + 1;
+}
+
+// a breadth first search: the queue holds the cells in order of distance, so every cell is
+// reached first by one of its shortest ways and visited exactly once. whether a neighbour is new
+// is a coin toss on a random maze, so rather than branch on it, every neighbour is written to the
+// queue and its distance written back, and only the new ones move the queue's tail on.
+static void spreadFromGoal(FlowField *field) {
+    if (field->goalCol < 0 || field->goalCol >= field->numCols || field->goalRow < 0 || field->goalRow >= field->numRows) {
+        return;
+    }
+    int goal = (field->goalRow + 1) * field->stride + field->goalCol + 1;
+    if (field->distances[goal] == WALL) {
+        return;
+    }
+    uint32_t *distances = field->distances;
+    int *queue = field->queue;
+    distances[goal] = 0;
+    queue[0] = goal;
+    int tail = 1;
+    for (int head = 0; head < tail; head++) {
+        int cell = queue[head];
+        uint32_t distance = distances[cell] + 1;
+        for (int n = 0; n < 4; n++) {
+            int neighbour = cell + field->offsets[n];
+            uint32_t known = distances[neighbour];
+            bool reached = known == UNREACHABLE;
+            distances[neighbour] = reached ? distance : known;
+            // the queue has room: only cells with a distance are in it, and this one has none yet
+            queue[tail] = neighbour;
+            tail += reached;
+        }
+    }
+}
+
+// points every cell once all distances are known, row by row rather than in the order of the
+// search, which jumps between rows all over the map and would miss the cache for each cell
+static void pointAllCells(FlowField *field) {
+    for (int row = 1; row <= field->numRows; row++) {
+        int first = row * field->stride + 1;
+        int col = pointCellsSse2(&field->directions[first], &field->distances[first], field->stride, field->numCols);
+        for (; col < field->numCols; col++) {
+            field->directions[first + col] = directionOf(field->distances, first + col, field->stride);
+        }
+    }
+}
+
+// directionOf for four cells of a row at a time, returning how many cells of the row it pointed.
+// every lane goes through the same choices, and what a lane picks is what directionOf would:
+// the lowest closer side, overridden by the lowest diagonal two closer.
+static int pointCellsSse2(unsigned char *directions, const uint32_t *here, int stride, int numCols) {
+#ifdef FLOWFIELD_USE_SSE2
+    const uint32_t *above = here - stride;
+    const uint32_t *below = here + stride;
+    const __m128i zero = _mm_setzero_si128();
+    int col = 0;
+    for (; col + 4 <= numCols; col += 4) {
+        __m128i distance = _mm_loadu_si128((const __m128i*) &here[col]);
+        __m128i oneCloser = _mm_add_epi32(distance, _mm_set1_epi32(-1));
+        __m128i twoCloser = _mm_add_epi32(distance, _mm_set1_epi32(-2));
+        __m128i east = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &here[col + 1]), oneCloser);
+        __m128i south = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &below[col]), oneCloser);
+        __m128i west = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &here[col - 1]), oneCloser);
+        __m128i north = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &above[col]), oneCloser);
+        __m128i southEast = _mm_and_si128(_mm_and_si128(east, south), _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &below[col + 1]), twoCloser));
+        __m128i southWest = _mm_and_si128(_mm_and_si128(south, west), _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &below[col - 1]), twoCloser));
+        __m128i northWest = _mm_and_si128(_mm_and_si128(west, north), _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &above[col - 1]), twoCloser));
+        __m128i northEast = _mm_and_si128(_mm_and_si128(north, east), _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &above[col + 1]), twoCloser));
+        // later choices win, so the lowest of each kind goes last
+        __m128i choices[8] = { north, west, south, east, northEast, northWest, southWest, southEast };
+        static const int picked[8] = { 3, 2, 1, 0, 7, 6, 5, 4 };
+        __m128i direction = _mm_set1_epi32(NO_DIRECTION);
+        for (int i = 0; i < 8; i++) {
+            direction = _mm_or_si128(_mm_and_si128(choices[i], _mm_set1_epi32(picked[i])), _mm_andnot_si128(choices[i], direction));
+        }
+        // distances fit in 31 bits, so the goal, UNREACHABLE and WALL are the ones not above 0
+        __m128i pointed = _mm_cmpgt_epi32(distance, zero);
+        direction = _mm_or_si128(_mm_and_si128(pointed, direction), _mm_andnot_si128(pointed, _mm_set1_epi32(NO_DIRECTION)));
+        direction = _mm_packus_epi16(_mm_packs_epi32(direction, zero), zero);
+        int packed = _mm_cvtsi128_si32(direction);
+        memcpy(&directions[col], &packed, sizeof(packed));
+    }
+    return col;
+#else
+    (void) directions;
+    (void) here;
+    (void) stride;
+    (void) numCols;
+    return 0;
+#endif
+}
+
+// records a journaled cell whose walkability changed. a cell that became a wall is queued to take
+// the ways through it along; the queue cannot overflow, as only cells with a distance are queued
+// and they lose it on the way in.
+static void applyChange(void *user, int col, int row) {
+    FieldUpdate *update = (FieldUpdate*) user;
+    FlowField *field = update->field;
+    int cell = (row + 1) * field->stride + col + 1;
+    bool walkable = isWalkableCell(update->map, row * update->map->numCols + col);
+    if (walkable == (field->distances[cell] != WALL)) {
+        return;
+    }
+    markDirty(field, cell);
+    if (walkable) {
+        field->distances[cell] = UNREACHABLE;
+        return;
+    }
+    if (field->distances[cell] != UNREACHABLE) {
+        field->queue[update->numLost] = cell;
+        field->lostDistances[update->numLost++] = field->distances[cell];
+    }
+    field->distances[cell] = WALL;
+}
+
+static void markDirty(FlowField *field, int cell) {
+    if (!(field->flags[cell] & DIRTY)) {
+        field->flags[cell] |= DIRTY;
+        field->dirty[field->numDirty++] = cell;
+    }
+}
+
+// whether a neighbour one step closer to the goal still has a distance
+static bool hasWayOn(const FlowField *field, int cell) {
+    for (int n = 0; n < 4; n++) {
+        int neighbour = cell + field->offsets[n];
+        if (field->distances[neighbour] == field->distances[cell] - 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// every cell one step farther than a lost one may have relied on it. the order cells are lost in
+// does not matter: a cell kept for a way on that gets lost later is checked again from there.
+static void loseWays(FlowField *field, int numLost) {
+    for (int i = 0; i < numLost; i++) {
+        int cell = field->queue[i];
+        uint32_t distance = field->lostDistances[i] + 1;
+        for (int n = 0; n < 4; n++) {
+            int neighbour = cell + field->offsets[n];
+            if (field->distances[neighbour] == distance && !hasWayOn(field, neighbour)) {
+                field->queue[numLost] = neighbour;
+                field->lostDistances[numLost++] = distance;
+                field->distances[neighbour] = UNREACHABLE;
+                markDirty(field, neighbour);
+            }
+        }
+    }
+}
+
+// the dirty cells' neighbours that kept a distance pass it on again. the queue is a ring, and a cell
+// whose distance shrinks while it is queued is not queued twice, so it never holds more than every cell.
+static void repairDistances(FlowField *field) {
+    int capacity = field->stride * (field->numRows + 2);
+    int head = 0;
+    int tail = 0;
+    int numQueued = 0;
+    int numChanged = field->numDirty;
+    int goal = (field->goalRow + 1) * field->stride + field->goalCol + 1;
+    bool hasGoal = field->goalCol >= 0 && field->goalCol < field->numCols && field->goalRow >= 0 && field->goalRow < field->numRows;
+    for (int i = 0; i < numChanged; i++) {
+        int cell = field->dirty[i];
+        if (hasGoal && cell == goal && field->distances[cell] != WALL) {
+            field->distances[cell] = 0;
+        }
+        for (int n = -1; n < 4; n++) {
+            int seed = n < 0 ? cell : cell + field->offsets[n];
+            if (!(field->flags[seed] & QUEUED) && field->distances[seed] < UNREACHABLE) {
+                field->flags[seed] |= QUEUED;
+                field->queue[tail] = seed;
+                tail = (tail + 1) % capacity;
+                numQueued++;
+            }
+        }
+    }
+    while (numQueued > 0) {
+        int cell = field->queue[head];
+        head = (head + 1) % capacity;
+        numQueued--;
+        field->flags[cell] &= ~QUEUED;
+        uint32_t distance = field->distances[cell] + 1;
+        for (int n = 0; n < 4; n++) {
+            int neighbour = cell + field->offsets[n];
+            if (field->distances[neighbour] == WALL || field->distances[neighbour] <= distance) {
+                continue;
+            }
+            field->distances[neighbour] = distance;
+            markDirty(field, neighbour);
+            if (!(field->flags[neighbour] & QUEUED)) {
+                field->flags[neighbour] |= QUEUED;
+                field->queue[tail] = neighbour;
+                tail = (tail + 1) % capacity;
+                numQueued++;
+            }
+        }
+    }
+}
+
+// points a cell at a neighbour closer to the goal, preferring a diagonal one two steps closer, as
+// that covers more ground per unit moved. such a diagonal neighbour is one the two neighbours
+// between it and the cell both lead to, so neither of them is a wall and no corner is cut.
+static void pointCell(FlowField *field, int cell) {
+    // walls include the border, whose neighbours lie outside the arrays
+    field->directions[cell] = field->distances[cell] == WALL ? NO_DIRECTION : directionOf(field->distances, cell, field->stride);
+}
+
+// the direction pointCell picks for a cell that is not a wall. the neighbours it may move on to are
+// gathered as masks and turned into a direction by looking their lowest bit up, and the choices
+// between directions are masks as well, so searches do not branch on the maze.
+static unsigned char directionOf(const uint32_t *distances, int cell, int stride) {
+    static const unsigned char lowestSide[16] = { NO_DIRECTION, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+    static const unsigned char lowestDiagonal[16] = { 0, 4, 5, 4, 6, 4, 5, 4, 7, 4, 5, 4, 6, 4, 5, 4 };
+    const uint32_t *here = &distances[cell];
+    const uint32_t *above = here - stride;
+    const uint32_t *below = here + stride;
+    uint32_t oneCloser = here[0] - 1;
+    uint32_t twoCloser = here[0] - 2;
+    // bit n for neighbour n, in the order of the offsets
+    unsigned east = here[1] == oneCloser;
+    unsigned south = below[0] == oneCloser;
+    unsigned west = here[-1] == oneCloser;
+    unsigned north = above[0] == oneCloser;
+    unsigned closer = east | (south << 1) | (west << 2) | (north << 3);
+    unsigned diagonals = (east & south & (below[1] == twoCloser))
+        | ((south & west & (below[-1] == twoCloser)) << 1)
+        | ((west & north & (above[-1] == twoCloser)) << 2)
+        | ((north & east & (above[1] == twoCloser)) << 3);
+    unsigned sidesOnly = 0u - (unsigned)(diagonals == 0);
+    unsigned direction = lowestDiagonal[diagonals] | (lowestSide[closer] & sidesOnly);
+    // neither the goal, whose distance - 1 would be taken for a wall, nor cells without a distance
+    unsigned pointed = 0u - (unsigned)(oneCloser < UNREACHABLE - 1);
+    return (unsigned char)((direction & pointed) | (NO_DIRECTION & ~pointed));
+}
@@ -0,0 +1,381 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lightbaker.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "constants.h"
+
+// how long the baker works before it looks for new changes
+#define BAKE_SLICE_MS 1.0
+// how far around a changed cell the light of its neighbours' corners and walls may change
+#define CHANGE_REACH 2
+
+// a changed cell as the map had it when the change was handed over
+typedef struct PendingCell {
+    int cell;
+    int content;
+    MapDoor door;
+    MapPortal portal;
+    float height;
+} PendingCell;
+
+// a lightmap replaced by a newer one, kept alive until no frame uses it
+typedef struct RetiredLightmap {
+    Lightmap *lightmap;
+    unsigned long lastUsingFrame;
+    struct RetiredLightmap *next;
+} RetiredLightmap;
+
+typedef struct PendingQueue {
+    struct LightBaker *baker;
+    const Map *map;
+    bool failed;
+} PendingQueue;
+
+struct LightBaker {
+    // used by the render loop only
+    FrameStats *stats;
+    Lightmap *current;
+    RetiredLightmap *retired;
+    unsigned long serial;       // of the map changes are handed over from
+    unsigned long revision;     // of that map, handed over up to
+
+    // used by the baker thread only
+    Map *map;                   // the baker's copy, doors snapped open or closed
+    float *keys;                // what every cell of the copy does to light
+    Lightmap *working;
+    unsigned char *dirty;       // one flag per cell
+    int *dirtyCells;
+    int numDirty;
+    bool bakedSincePublish;
+    bool failed;                // out of memory, nothing is published until the next new map
+
+    // handed between the two, guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t workChanged;
+    Map *pendingMap;            // a new map to bake from scratch
+    PendingCell *pendingCells;
+    int numPending;
+    int pendingCapacity;
+    double changeTime;          // when the oldest change not yet published was handed over, 0 for none
+    Lightmap *published;
+    double publishedChangeTime;
+    bool shuttingDown;
+    pthread_t thread;
+    bool threadStarted;
+};
+
+static void *bakerThreadMain(void *argument);
+static bool adoptMap(LightBaker *baker, Map *map);
+static void applyPendingCells(LightBaker *baker);
+static void bakeSlice(LightBaker *baker);
+static void markDirty(LightBaker *baker, int minCol, int minRow, int maxCol, int maxRow);
+static void markLightChanged(LightBaker *baker, int col, int row);
+static float lightKey(const Map *map, int cell);
+static Map *copyForBaking(const Map *map);
+static bool handOverMap(LightBaker *baker, const Map *map);
+static void queueChangedCell(void *user, int col, int row);
+static void freeRetiredLightmaps(LightBaker *baker, unsigned long framesPresented);
+
+LightBaker *lightBakerCreate(const Map *map, FrameStats *stats) {
+    LightBaker *baker = (LightBaker*) calloc(1, sizeof(LightBaker));
+    if (baker == NULL) {
+        return NULL;
+    }
+    baker->stats = stats;
+    pthread_mutex_init(&baker->lock, NULL);
+    pthread_cond_init(&baker->workChanged, NULL);
+    if (!handOverMap(baker, map)) {
+        lightBakerDestroy(baker);
+        return NULL;
+    }
+    baker->threadStarted = pthread_create(&baker->thread, NULL, bakerThreadMain, baker) == 0;
+    if (!baker->threadStarted) {
+        lightBakerDestroy(baker);
+        return NULL;
+    }
+    return baker;
+}
+
+void lightBakerDestroy(LightBaker *baker) {
+    if (baker == NULL) {
+        return;
+    }
+    if (baker->threadStarted) {
+        pthread_mutex_lock(&baker->lock);
+        baker->shuttingDown = true;
+        pthread_cond_signal(&baker->workChanged);
+        pthread_mutex_unlock(&baker->lock);
+        pthread_join(baker->thread, NULL);
+    }
+    freeRetiredLightmaps(baker, (unsigned long)-1);
+    lightmapDestroy(baker->current);
+    lightmapDestroy(baker->published);
+    lightmapDestroy(baker->working);
+    mapDestroy(baker->pendingMap);
+    mapDestroy(baker->map);
+    free(baker->pendingCells);
+    free(baker->keys);
+    free(baker->dirty);
+    free(baker->dirtyCells);
+    pthread_cond_destroy(&baker->workChanged);
+    pthread_mutex_destroy(&baker->lock);
+    free(baker);
+}
+
+const Lightmap *lightBakerPoll(LightBaker *baker, const Map *map,
+    unsigned long framesSubmitted, unsigned long framesPresented) {
+    freeRetiredLightmaps(baker, framesPresented);
+    // the baker only holds the lock for a moment, whoever misses it tries again next frame
+    if (pthread_mutex_trylock(&baker->lock) != 0) {
+        return baker->current;
+    }
+    if (map->serial != baker->serial || map->revision != baker->revision) {
+        PendingQueue queue = { baker, map, false };
+        if (map->serial != baker->serial || !mapForEachChange(map, baker->revision, queueChangedCell, &queue)) {
+            handOverMap(baker, map);
+        } else if (!queue.failed) {
+            baker->revision = map->revision;
+            baker->changeTime = baker->changeTime == 0 ? statsNow() : baker->changeTime;
+            pthread_cond_signal(&baker->workChanged);
+        }
+    }
+    Lightmap *published = baker->published;
+    double changeTime = baker->publishedChangeTime;
+    baker->published = NULL;
+    pthread_mutex_unlock(&baker->lock);
+    if (published == NULL) {
+        return baker->current;
+    }
+
+    RetiredLightmap *retired = (RetiredLightmap*) malloc(sizeof(RetiredLightmap));
+    if (retired == NULL) {
+        // nowhere to park the old lightmap, so keep using it rather than free one in use
+        lightmapDestroy(published);
+        return baker->current;
+    }
+    retired->lightmap = baker->current;
+    retired->lastUsingFrame = framesSubmitted;
+    retired->next = baker->retired;
+    baker->retired = retired;
+    baker->current = published;
+    statsRecord(baker->stats, STAT_LIGHT_BAKE, statsNow() - changeTime);
+    return baker->current;
+}
+
+// PRIVATE
+
+static void *bakerThreadMain(void *argument) {
+    LightBaker *baker = (LightBaker*) argument;
+    pthread_mutex_lock(&baker->lock);
+    while (!baker->shuttingDown) {
+        if (baker->pendingMap != NULL) {
+            Map *map = baker->pendingMap;
+            // cells pending now were changed after the new map was copied
+            baker->pendingMap = NULL;
+            if (!adoptMap(baker, map)) {
+                fprintf(stderr, "Error baking the lights of a map, out of memory.\n");
+            }
+        }
+        applyPendingCells(baker);
+        if (baker->numDirty == 0) {
+            // changes that left the light as it was have nothing to publish
+            if (!baker->bakedSincePublish) {
+                baker->changeTime = 0;
+            }
+            pthread_cond_wait(&baker->workChanged, &baker->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&baker->lock);
+        bakeSlice(baker);
+        Lightmap *finished = baker->numDirty == 0 && !baker->failed ? lightmapCopy(baker->working) : NULL;
+        pthread_mutex_lock(&baker->lock);
+        if (finished != NULL) {
+            lightmapDestroy(baker->published);
+            baker->published = finished;
+            baker->publishedChangeTime = baker->changeTime;
+            baker->changeTime = 0;
+            baker->bakedSincePublish = false;
+        }
+    }
+    pthread_mutex_unlock(&baker->lock);
+    return NULL;
+}
+
+// starts over on a new map with every cell dirty
+static bool adoptMap(LightBaker *baker, Map *map) {
+    int numCells = map->numRows * map->numCols;
+    mapDestroy(baker->map);
+    lightmapDestroy(baker->working);
+    free(baker->keys);
+    free(baker->dirty);
+    free(baker->dirtyCells);
+    baker->map = map;
+    baker->working = lightmapCreate(map);
+    baker->keys = (float*) malloc(sizeof(float) * numCells);
+    baker->dirty = (unsigned char*) calloc(numCells, 1);
+    baker->dirtyCells = (int*) malloc(sizeof(int) * numCells);
+    baker->numDirty = 0;
+    baker->bakedSincePublish = false;
+    baker->failed = baker->working == NULL || baker->keys == NULL || baker->dirty == NULL || baker->dirtyCells == NULL;
+    if (baker->failed) {
+        return false;
+    }
+    for (int cell = 0; cell < numCells; cell++) {
+        baker->keys[cell] = lightKey(map, cell);
+    }
+    markDirty(baker, 0, 0, map->numCols - 1, map->numRows - 1);
+    return true;
+}
+
+// copies the handed over cells into the baker's map; called with the lock held
+static void applyPendingCells(LightBaker *baker) {
+    Map *map = baker->map;
+    for (int i = 0; i < baker->numPending && !baker->failed; i++) {
+        const PendingCell *pending = &baker->pendingCells[i];
+        int cell = pending->cell;
+        // only what light sees of the map is copied, the baker's map keeps no door list
+        map->cells[cell] = pending->content;
+        map->doors[cell] = pending->door;
+        map->doors[cell].openAmount = pending->door.openAmount > 0 ? 1 : 0;
+        map->doors[cell].direction = 0;
+        map->portals[cell] = pending->portal;
+        map->heights[cell] = pending->height;
+        map->maxWallHeight = pending->height > map->maxWallHeight ? pending->height : map->maxWallHeight;
+        float key = lightKey(map, cell);
+        if (key != baker->keys[cell]) {
+            baker->keys[cell] = key;
+            markLightChanged(baker, cell % map->numCols, cell / map->numCols);
+        }
+    }
+    baker->numPending = 0;
+}
+
+// bakes dirty cells until the slice is used up
+static void bakeSlice(LightBaker *baker) {
+    double sliceStart = statsNow();
+    while (baker->numDirty > 0 && statsNow() - sliceStart < BAKE_SLICE_MS) {
+        int cell = baker->dirtyCells[--baker->numDirty];
+        baker->dirty[cell] = 0;
+        if (!lightmapBakeCell(baker->working, baker->map, cell % baker->map->numCols, cell / baker->map->numCols)) {
+            fprintf(stderr, "Error baking the lights of a map, out of memory.\n");
+            baker->failed = true;
+            baker->numDirty = 0;
+            return;
+        }
+        baker->bakedSincePublish = true;
+    }
+}
+
+static void markDirty(LightBaker *baker, int minCol, int minRow, int maxCol, int maxRow) {
+    const Map *map = baker->map;
+    minCol = minCol < 0 ? 0 : minCol;
+    minRow = minRow < 0 ? 0 : minRow;
+    maxCol = maxCol >= map->numCols ? map->numCols - 1 : maxCol;
+    maxRow = maxRow >= map->numRows ? map->numRows - 1 : maxRow;
+    for (int row = minRow; row <= maxRow; row++) {
+        for (int col = minCol; col <= maxCol; col++) {
+            int cell = (row * map->numCols) + col;
+            if (!baker->dirty[cell]) {
+                baker->dirty[cell] = 1;
+                baker->dirtyCells[baker->numDirty++] = cell;
+            }
+        }
+    }
+}
+
+// a cell started or stopped blocking light or showing walls: its surroundings change, and so does
+// everything the lights reaching it shine on
+static void markLightChanged(LightBaker *baker, int col, int row) {
+    const Map *map = baker->map;
+    markDirty(baker, col - CHANGE_REACH, row - CHANGE_REACH, col + CHANGE_REACH, row + CHANGE_REACH);
+    for (int i = 0; i < map->numLights; i++) {
+        const MapLight *light = &map->lights[i];
+        float nearestX = light->x < col * TILE_SIZE ? col * TILE_SIZE : light->x > (col + 1) * TILE_SIZE ? (col + 1) * TILE_SIZE : light->x;
+        float nearestY = light->y < row * TILE_SIZE ? row * TILE_SIZE : light->y > (row + 1) * TILE_SIZE ? (row + 1) * TILE_SIZE : light->y;
+        float dx = nearestX - light->x;
+        float dy = nearestY - light->y;
+        if (dx * dx + dy * dy >= light->radius * light->radius) {
+            continue;
+        }
+        markDirty(baker, (int)floorf((light->x - light->radius) / TILE_SIZE) - 1, (int)floorf((light->y - light->radius) / TILE_SIZE) - 1,
+            (int)floorf((light->x + light->radius) / TILE_SIZE) + 1, (int)floorf((light->y + light->radius) / TILE_SIZE) + 1);
+    }
+}
+
+// what a cell does to light: 0 lets it through, -1 is a closed door, anything else is the height
+// of a wall
+static float lightKey(const Map *map, int cell) {
+    if (map->doors[cell].orientation != DOOR_NONE) {
+        return map->doors[cell].openAmount > 0 ? 0 : -1;
+    }
+    return map->cells[cell] != 0 ? map->heights[cell] : 0;
+}
+
+static Map *copyForBaking(const Map *map) {
+    Map *copy = mapCopy(map);
+    if (copy == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < copy->numDoors; i++) {
+        MapDoor *door = &copy->doors[copy->doorCells[i]];
+        door->openAmount = door->openAmount > 0 ? 1 : 0;
+        door->direction = 0;
+    }
+    return copy;
+}
+
+// queues the whole map to be baked from scratch; called with the lock held
+static bool handOverMap(LightBaker *baker, const Map *map) {
+    Map *copy = copyForBaking(map);
+    if (copy == NULL) {
+        return false;
+    }
+    mapDestroy(baker->pendingMap);
+    baker->pendingMap = copy;
+    baker->numPending = 0;
+    baker->serial = map->serial;
+    baker->revision = map->revision;
+    baker->changeTime = statsNow();
+    pthread_cond_signal(&baker->workChanged);
+    return true;
+}
+
+static void queueChangedCell(void *user, int col, int row) {
+    PendingQueue *queue = (PendingQueue*) user;
+    LightBaker *baker = queue->baker;
+    if (baker->numPending == baker->pendingCapacity) {
+        int capacity = baker->pendingCapacity > 0 ? baker->pendingCapacity * 2 : 64;
+        PendingCell *pendingCells = (PendingCell*) realloc(baker->pendingCells, sizeof(PendingCell) * capacity);
+        if (pendingCells == NULL) {
+            // handed over again next frame; cells already queued are simply copied twice
+            queue->failed = true;
+            return;
+        }
+        baker->pendingCells = pendingCells;
+        baker->pendingCapacity = capacity;
+    }
+    const Map *map = queue->map;
+    int cell = (row * map->numCols) + col;
+    PendingCell pending = { cell, map->cells[cell], map->doors[cell], map->portals[cell], map->heights[cell] };
+    baker->pendingCells[baker->numPending++] = pending;
+}
+
+// frees the lightmaps whose last user, the frame submitted right before the swap, has been presented
+static void freeRetiredLightmaps(LightBaker *baker, unsigned long framesPresented) {
+    RetiredLightmap **link = &baker->retired;
+    while (*link != NULL) {
+        RetiredLightmap *retired = *link;
+        if (framesPresented >= retired->lastUsingFrame) {
+            *link = retired->next;
+            lightmapDestroy(retired->lightmap);
+            free(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef _LIGHTBAKER_H_
+#define _LIGHTBAKER_H_
+
+#include "lightmap.h"
+#include "map.h"
+#include "stats.h"
+
+// keeps the lightmap of a changing map up to date on a background thread of its own. the render
+// loop only hands over the cells changed since the last frame and swaps in finished lightmaps,
+// so changes never cost a frame more than walking the journal.
+//
+// cells whose effect on light changed are baked again along with the cells the lights reaching
+// them shine on, in slices of a millisecond or so; a new lightmap is published once none are
+// left. doors count as closed until they start to open, so a sliding door rebakes twice.
+typedef struct LightBaker LightBaker;
+
+// starts baking the map's lights; returns NULL when out of memory or no thread could be started
+LightBaker *lightBakerCreate(const Map *map, FrameStats *stats);
+void lightBakerDestroy(LightBaker *baker);
+
+// call once per frame. hands over the changes made to the map since the last call, never waiting
+// for the baker, and returns the lightmap to render with, NULL until the first bake is done.
+// the map may be another one than before, which bakes it from scratch. a lightmap that is
+// replaced is freed once every frame submitted before the swap has been presented.
+const Lightmap *lightBakerPoll(LightBaker *baker, const Map *map,
+    unsigned long framesSubmitted, unsigned long framesPresented);
+
+#endif
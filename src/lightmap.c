@@ -0,0 +1,383 @@
+#include "lightmap.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "constants.h"
+#include "utils.h"
+
+// levels along one edge of a lumel grid, and in the grid of one wall face
+#define EDGE_LEVELS (LIGHTMAP_LUMELS + 1)
+#define FACE_LEVELS (EDGE_LEVELS * EDGE_LEVELS)
+// lights hang at the camera's height
+#define LIGHT_HEIGHT (TILE_SIZE / 2.0f)
+// light reaching everything, before occlusion
+#define AMBIENT_LIGHT 0.15f
+// points on a wall face are lit from this far in front of it, so they are not inside the wall
+#define FACE_NUDGE 1.0f
+// a wall this close to the point a light is traced to is the point's own
+#define OCCLUDER_SLACK 0.5f
+// how far the occlusion traces around a point reach, and how much they may take away
+#define OCCLUSION_RANGE ((float)TILE_SIZE)
+#define OCCLUSION_STRENGTH 0.6f
+#define NUM_OCCLUSION_TRACES 8
+// traces start this far behind the point, so one on a grid line also finds the wall right ahead
+#define TRACE_BACKSTEP (TILE_SIZE / 1024.0f)
+
+struct Lightmap {
+    int numRows;
+    int numCols;
+    int floorStride;                // levels per row of the floor grid
+    unsigned char *floorLevels;     // numRows * LIGHTMAP_LUMELS + 1 rows of floorStride levels
+    int *edgeFaces;                 // face of every edge, horizontal edges first, -1 for none
+    int numHorizontalEdges;
+    unsigned char *faceLevels;      // FACE_LEVELS per face, along the edge then up
+    int numFaces;
+    int faceCapacity;
+    unsigned short scales[256];     // light scale of every level
+};
+
+// a point the lightmap stores the light of, and the direction its surface faces
+typedef struct LightPoint {
+    float x;
+    float y;
+    float z;
+    float normalX;      // both 0 on the floor, which faces up
+    float normalY;
+} LightPoint;
+
+static bool bakeFace(Lightmap *lightmap, const Map *map, bool horizontal, int col, int row);
+static unsigned char bakeLevel(const Map *map, const LightPoint *point);
+static bool isOccluded(const Map *map, const MapLight *light, const LightPoint *point, float distance);
+static float ambientOcclusion(const Map *map, const LightPoint *point);
+static float faceHeight(const Map *map, int col, int row);
+static bool showsFloor(const Map *map, int col, int row);
+static bool showsFloorAround(const Map *map, int col, int row, int i, int j);
+static int edgeIndex(const Lightmap *lightmap, bool horizontal, int col, int row);
+static int interpolate(int from, int to, int fraction);
+
+Lightmap *lightmapCreate(const Map *map) {
+    Lightmap *lightmap = (Lightmap*) calloc(1, sizeof(Lightmap));
+    if (lightmap == NULL) {
+        return NULL;
+    }
+    lightmap->numRows = map->numRows;
+    lightmap->numCols = map->numCols;
+    lightmap->floorStride = map->numCols * LIGHTMAP_LUMELS + 1;
+    lightmap->numHorizontalEdges = (map->numRows + 1) * map->numCols;
+    size_t numEdges = (size_t)lightmap->numHorizontalEdges + (size_t)map->numRows * (map->numCols + 1);
+    lightmap->floorLevels = (unsigned char*) calloc((size_t)(map->numRows * LIGHTMAP_LUMELS + 1) * lightmap->floorStride, 1);
+    lightmap->edgeFaces = (int*) malloc(sizeof(int) * numEdges);
+    if (lightmap->floorLevels == NULL || lightmap->edgeFaces == NULL) {
+        lightmapDestroy(lightmap);
+        return NULL;
+    }
+    for (size_t i = 0; i < numEdges; i++) {
+        lightmap->edgeFaces[i] = -1;
+    }
+    for (int level = 0; level < 256; level++) {
+        float light = level / 255.0f;
+        lightmap->scales[level] = (unsigned short)(light * light * LIGHTMAP_FULL_SCALE + 0.5f);
+    }
+    return lightmap;
+}
+
+Lightmap *lightmapBake(const Map *map) {
+    Lightmap *lightmap = lightmapCreate(map);
+    if (lightmap == NULL) {
+        return NULL;
+    }
+    for (int row = 0; row < map->numRows; row++) {
+        for (int col = 0; col < map->numCols; col++) {
+            if (!lightmapBakeCell(lightmap, map, col, row)) {
+                lightmapDestroy(lightmap);
+                return NULL;
+            }
+        }
+    }
+    return lightmap;
+}
+
+Lightmap *lightmapCopy(const Lightmap *lightmap) {
+    Lightmap *copy = (Lightmap*) malloc(sizeof(Lightmap));
+    if (copy == NULL) {
+        return NULL;
+    }
+    *copy = *lightmap;
+    size_t floorSize = (size_t)(lightmap->numRows * LIGHTMAP_LUMELS + 1) * lightmap->floorStride;
+    size_t numEdges = (size_t)lightmap->numHorizontalEdges + (size_t)lightmap->numRows * (lightmap->numCols + 1);
+    copy->floorLevels = (unsigned char*) malloc(floorSize);
+    copy->edgeFaces = (int*) malloc(sizeof(int) * numEdges);
+    copy->faceLevels = (unsigned char*) malloc((size_t)FACE_LEVELS * (lightmap->numFaces > 0 ? lightmap->numFaces : 1));
+    copy->faceCapacity = lightmap->numFaces;
+    if (copy->floorLevels == NULL || copy->edgeFaces == NULL || copy->faceLevels == NULL) {
+        lightmapDestroy(copy);
+        return NULL;
+    }
+    memcpy(copy->floorLevels, lightmap->floorLevels, floorSize);
+    memcpy(copy->edgeFaces, lightmap->edgeFaces, sizeof(int) * numEdges);
+    if (lightmap->numFaces > 0) {
+        memcpy(copy->faceLevels, lightmap->faceLevels, (size_t)FACE_LEVELS * lightmap->numFaces);
+    }
+    return copy;
+}
+
+void lightmapDestroy(Lightmap *lightmap) {
+    if (lightmap == NULL) {
+        return;
+    }
+    free(lightmap->floorLevels);
+    free(lightmap->edgeFaces);
+    free(lightmap->faceLevels);
+    free(lightmap);
+}
+
+size_t lightmapMemoryUsage(const Lightmap *lightmap) {
+    size_t numEdges = (size_t)lightmap->numHorizontalEdges + (size_t)lightmap->numRows * (lightmap->numCols + 1);
+    return sizeof(Lightmap)
+        + (size_t)(lightmap->numRows * LIGHTMAP_LUMELS + 1) * lightmap->floorStride
+        + sizeof(int) * numEdges
+        + (size_t)FACE_LEVELS * lightmap->faceCapacity;
+}
+
+// a cell owns the levels along its top and left edges, the last row and column the far ones too
+bool lightmapBakeCell(Lightmap *lightmap, const Map *map, int col, int row) {
+    int lastI = col == map->numCols - 1 ? LIGHTMAP_LUMELS : LIGHTMAP_LUMELS - 1;
+    int lastJ = row == map->numRows - 1 ? LIGHTMAP_LUMELS : LIGHTMAP_LUMELS - 1;
+    for (int j = 0; j <= lastJ; j++) {
+        for (int i = 0; i <= lastI; i++) {
+            LightPoint point = {
+                (col + (float)i / LIGHTMAP_LUMELS) * TILE_SIZE,
+                (row + (float)j / LIGHTMAP_LUMELS) * TILE_SIZE,
+                0, 0, 0
+            };
+            int level = ((row * LIGHTMAP_LUMELS) + j) * lightmap->floorStride + (col * LIGHTMAP_LUMELS) + i;
+            lightmap->floorLevels[level] = showsFloorAround(map, col, row, i, j) ? bakeLevel(map, &point) : 0;
+        }
+    }
+    bool baked = bakeFace(lightmap, map, true, col, row) && bakeFace(lightmap, map, false, col, row);
+    if (baked && row == map->numRows - 1) {
+        baked = bakeFace(lightmap, map, true, col, row + 1);
+    }
+    if (baked && col == map->numCols - 1) {
+        baked = bakeFace(lightmap, map, false, col + 1, row);
+    }
+    return baked;
+}
+
+int lightmapFloorScale(const Lightmap *lightmap, float x, float y) {
+    float u = x * LIGHTMAP_LUMELS / TILE_SIZE;
+    float v = y * LIGHTMAP_LUMELS / TILE_SIZE;
+    float maxU = lightmap->numCols * LIGHTMAP_LUMELS;
+    float maxV = lightmap->numRows * LIGHTMAP_LUMELS;
+    u = u < 0 ? 0 : u > maxU ? maxU : u;
+    v = v < 0 ? 0 : v > maxV ? maxV : v;
+    int i = (int)u < lightmap->numCols * LIGHTMAP_LUMELS ? (int)u : lightmap->numCols * LIGHTMAP_LUMELS - 1;
+    int j = (int)v < lightmap->numRows * LIGHTMAP_LUMELS ? (int)v : lightmap->numRows * LIGHTMAP_LUMELS - 1;
+    int fractionU = (int)((u - i) * 256);
+    int fractionV = (int)((v - j) * 256);
+
+    const unsigned char *levels = &lightmap->floorLevels[(j * lightmap->floorStride) + i];
+    int top = interpolate(levels[0], levels[1], fractionU);
+    int bottom = interpolate(levels[lightmap->floorStride], levels[lightmap->floorStride + 1], fractionU);
+    return lightmap->scales[interpolate(top, bottom, fractionV)];
+}
+
+void lightmapWallScales(const Lightmap *lightmap, const Ray *hit, int *scales) {
+    // faces lie on grid lines, door slabs between them
+    float across = hit->wasHitVertical ? hit->wallHitX : hit->wallHitY;
+    float along = hit->wasHitVertical ? hit->wallHitY : hit->wallHitX;
+    int line = (int)floorf(across / TILE_SIZE + 0.5f);
+    int cell = (int)floorf(along / TILE_SIZE);
+    int face = -1;
+    if (fabsf(across - line * TILE_SIZE) < 0.5f) {
+        int edge = hit->wasHitVertical ? edgeIndex(lightmap, false, line, cell) : edgeIndex(lightmap, true, cell, line);
+        face = edge >= 0 ? lightmap->edgeFaces[edge] : -1;
+    }
+    if (face < 0) {
+        int scale = lightmapFloorScale(lightmap, hit->wallHitX, hit->wallHitY);
+        for (int up = 0; up < EDGE_LEVELS; up++) {
+            scales[up] = scale;
+        }
+        return;
+    }
+
+    float u = hit->wallHitOffset * LIGHTMAP_LUMELS / TILE_SIZE;
+    int i = (int)u < LIGHTMAP_LUMELS ? (int)u : LIGHTMAP_LUMELS - 1;
+    i = i < 0 ? 0 : i;
+    int fraction = (int)((u - i) * 256);
+    fraction = fraction < 0 ? 0 : fraction > 256 ? 256 : fraction;
+    const unsigned char *levels = &lightmap->faceLevels[(size_t)face * FACE_LEVELS];
+    for (int up = 0; up < EDGE_LEVELS; up++) {
+        scales[up] = lightmap->scales[interpolate(levels[(up * EDGE_LEVELS) + i], levels[(up * EDGE_LEVELS) + i + 1], fraction)];
+    }
+}
+
+// PRIVATE
+
+// bakes the face on an edge, if the cells on either side of it differ in height. the face
+// belongs to the taller cell and is lit from the lower one.
+static bool bakeFace(Lightmap *lightmap, const Map *map, bool horizontal, int col, int row) {
+    int beforeCol = horizontal ? col : col - 1;
+    int beforeRow = horizontal ? row - 1 : row;
+    float beforeHeight = faceHeight(map, beforeCol, beforeRow);
+    float afterHeight = faceHeight(map, col, row);
+    if (beforeHeight == afterHeight) {
+        // a face that is gone keeps its levels, in case it comes back
+        return true;
+    }
+
+    int edge = edgeIndex(lightmap, horizontal, col, row);
+    if (lightmap->edgeFaces[edge] < 0) {
+        if (lightmap->numFaces == lightmap->faceCapacity) {
+            int capacity = lightmap->faceCapacity > 0 ? lightmap->faceCapacity * 2 : 64;
+            unsigned char *faceLevels = (unsigned char*) realloc(lightmap->faceLevels, (size_t)FACE_LEVELS * capacity);
+            if (faceLevels == NULL) {
+                return false;
+            }
+            lightmap->faceLevels = faceLevels;
+            lightmap->faceCapacity = capacity;
+        }
+        lightmap->edgeFaces[edge] = lightmap->numFaces++;
+    }
+
+    // the normal points at the lower cell
+    float normal = beforeHeight < afterHeight ? -1 : 1;
+    unsigned char *levels = &lightmap->faceLevels[(size_t)lightmap->edgeFaces[edge] * FACE_LEVELS];
+    for (int up = 0; up < EDGE_LEVELS; up++) {
+        for (int i = 0; i < EDGE_LEVELS; i++) {
+            float along = (float)i / LIGHTMAP_LUMELS * TILE_SIZE;
+            LightPoint point;
+            point.x = horizontal ? col * TILE_SIZE + along : col * TILE_SIZE + normal * FACE_NUDGE;
+            point.y = horizontal ? row * TILE_SIZE + normal * FACE_NUDGE : row * TILE_SIZE + along;
+            point.z = (float)up / LIGHTMAP_LUMELS * TILE_SIZE;
+            point.normalX = horizontal ? 0 : normal;
+            point.normalY = horizontal ? normal : 0;
+            levels[(up * EDGE_LEVELS) + i] = bakeLevel(map, &point);
+        }
+    }
+    return true;
+}
+
+// the light at a point, square rooted into a level
+static unsigned char bakeLevel(const Map *map, const LightPoint *point) {
+    float light = AMBIENT_LIGHT;
+    for (int i = 0; i < map->numLights; i++) {
+        const MapLight *mapLight = &map->lights[i];
+        float dx = mapLight->x - point->x;
+        float dy = mapLight->y - point->y;
+        float dz = LIGHT_HEIGHT - point->z;
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        if (distance >= mapLight->radius) {
+            continue;
+        }
+        // how squarely the light falls on the surface
+        bool onFloor = point->normalX == 0 && point->normalY == 0;
+        float facing = (onFloor ? dz : dx * point->normalX + dy * point->normalY) / (distance > 0 ? distance : 1);
+        if (facing <= 0 || isOccluded(map, mapLight, point, sqrtf(dx * dx + dy * dy))) {
+            continue;
+        }
+        float falloff = 1 - distance / mapLight->radius;
+        light += mapLight->brightness * falloff * falloff * facing;
+    }
+    light *= ambientOcclusion(map, point);
+    light = light < 0 ? 0 : light > 1 ? 1 : light;
+    return (unsigned char)(sqrtf(light) * 255 + 0.5f);
+}
+
+// walks the grid from the light towards the point; a wall blocks the light when it rises above
+// the line between them where the line enters it
+static bool isOccluded(const Map *map, const MapLight *light, const LightPoint *point, float distance) {
+    if (distance < OCCLUDER_SLACK) {
+        return false;
+    }
+    Player origin = { 0 };
+    origin.x = light->x;
+    origin.y = light->y;
+    RayWalk walk;
+    rayWalkBegin(&walk, normalizeAngle(atan2f(point->y - light->y, point->x - light->x)), &origin, 0);
+    Ray hit;
+    while (rayWalkNext(&walk, map, &hit) && hit.distance < distance - OCCLUDER_SLACK) {
+        float lineHeight = LIGHT_HEIGHT + (point->z - LIGHT_HEIGHT) * hit.distance / distance;
+        if (hit.wallHitHeight * TILE_SIZE > lineHeight) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// how much of the light reaches into the point's surroundings, from short traces in the
+// directions the surface faces; walls close by and above the point take light away
+static float ambientOcclusion(const Map *map, const LightPoint *point) {
+    float occlusion = 0;
+    int numTraces = 0;
+    for (int i = 0; i < NUM_OCCLUSION_TRACES; i++) {
+        float angle = i * (float)(2 * M_PI / NUM_OCCLUSION_TRACES);
+        if (cosf(angle) * point->normalX + sinf(angle) * point->normalY < -0.01f) {
+            continue;
+        }
+        numTraces++;
+        Player origin = { 0 };
+        origin.x = point->x - cosf(angle) * TRACE_BACKSTEP;
+        origin.y = point->y - sinf(angle) * TRACE_BACKSTEP;
+        RayWalk walk;
+        rayWalkBegin(&walk, normalizeAngle(angle), &origin, 0);
+        Ray hit;
+        while (rayWalkNext(&walk, map, &hit) && hit.distance < OCCLUSION_RANGE) {
+            if (hit.wallHitHeight * TILE_SIZE > point->z) {
+                occlusion += 1 - hit.distance / OCCLUSION_RANGE;
+                break;
+            }
+        }
+    }
+    // creases fade on the way up a wall
+    float fade = 1 - 0.5f * (point->z < TILE_SIZE ? point->z : TILE_SIZE) / TILE_SIZE;
+    return 1 - OCCLUSION_STRENGTH * fade * occlusion / numTraces;
+}
+
+// height of the wall faces a cell shows, 0 for cells showing none; outside the grid is solid
+static float faceHeight(const Map *map, int col, int row) {
+    if (col < 0 || col >= map->numCols || row < 0 || row >= map->numRows) {
+        return 1;
+    }
+    int cell = (row * map->numCols) + col;
+    return map->cells[cell] != 0 && map->doors[cell].orientation == DOOR_NONE ? map->heights[cell] : 0;
+}
+
+static bool showsFloor(const Map *map, int col, int row) {
+    if (col < 0 || col >= map->numCols || row < 0 || row >= map->numRows) {
+        return false;
+    }
+    int cell = (row * map->numCols) + col;
+    return map->cells[cell] == 0 || map->doors[cell].orientation != DOOR_NONE;
+}
+
+// a level on the edge of a cell also lights the floor of the cells beyond that edge
+static bool showsFloorAround(const Map *map, int col, int row, int i, int j) {
+    for (int dr = j == 0 ? -1 : 0; dr <= (j == LIGHTMAP_LUMELS ? 1 : 0); dr++) {
+        for (int dc = i == 0 ? -1 : 0; dc <= (i == LIGHTMAP_LUMELS ? 1 : 0); dc++) {
+            if (showsFloor(map, col + dc, row + dr)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// horizontal edges run along the top of cell (col, row), vertical ones along its left; -1 off the grid
+static int edgeIndex(const Lightmap *lightmap, bool horizontal, int col, int row) {
+    if (horizontal) {
+        if (col < 0 || col >= lightmap->numCols || row < 0 || row > lightmap->numRows) {
+            return -1;
+        }
+        return (row * lightmap->numCols) + col;
+    }
+    if (col < 0 || col > lightmap->numCols || row < 0 || row >= lightmap->numRows) {
+        return -1;
+    }
+    return lightmap->numHorizontalEdges + (row * (lightmap->numCols + 1)) + col;
+}
+
+// blends two levels by a fraction out of 256
+static int interpolate(int from, int to, int fraction) {
+    return from + (((to - from) * fraction) >> 8);
+}
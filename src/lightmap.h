@@ -0,0 +1,47 @@
+#ifndef _LIGHTMAP_H_
+#define _LIGHTMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "map.h"
+#include "ray.h"
+
+// light levels per tile edge, on the floor and on walls up to one tile high
+#define LIGHTMAP_LUMELS 4
+// the light scale of a fully lit texel, 256 times the light in the range 0 to 1
+#define LIGHTMAP_FULL_SCALE 256
+
+// static lighting of a map, baked from its lights: a grid of light levels over the floor and one
+// over every wall face that borders open space, each LIGHTMAP_LUMELS + 1 levels to a tile edge
+// so neighbouring lumels share the levels along their edges and light blends across them.
+// levels are single bytes holding the square root of the light, which keeps the dark end
+// smooth, and turn back into scales through a table.
+//
+// light is blocked by walls tall enough to cross the line from a light to a lit point, by
+// closed doors and by portals, which light does not pass through. see-through walls block it
+// as well, as the map does not know which textures are see-through. corners and the floor
+// along walls are darkened by a few short traces around every point. walls taller than a tile
+// keep the light of their top edge above it.
+typedef struct Lightmap Lightmap;
+
+// an unlit lightmap of the map's size, every level dark until cells are baked
+Lightmap *lightmapCreate(const Map *map);
+// a lightmap with every cell baked; returns NULL only when out of memory
+Lightmap *lightmapBake(const Map *map);
+Lightmap *lightmapCopy(const Lightmap *lightmap);
+void lightmapDestroy(Lightmap *lightmap);
+// bytes taken by the levels and the index of the faces
+size_t lightmapMemoryUsage(const Lightmap *lightmap);
+
+// bakes the floor of a cell and the faces along its edges again, after anything lighting them
+// changed; the map has to be the size the lightmap was made for. fails only when out of memory.
+bool lightmapBakeCell(Lightmap *lightmap, const Map *map, int col, int row);
+
+// light scale on the floor at (x, y)
+int lightmapFloorScale(const Lightmap *lightmap, float x, float y);
+// light scales of the column of wall a ray hit, at LIGHTMAP_LUMELS + 1 heights evenly spaced from
+// the floor to one tile up. door slabs and faces the lightmap does not know of take the light of
+// the floor beneath them.
+void lightmapWallScales(const Lightmap *lightmap, const Ray *hit, int *scales);
+
+#endif
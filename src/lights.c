@@ -0,0 +1,394 @@
+#include "lights.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "constants.h"
+#include "utils.h"
+
+// rays pass this far to either side of a wall corner, in radians, to see past it and stop on it
+#define CORNER_EPSILON 0.0001f
+// rays cast at even angles on top of the corners, so the edge of a light's reach stays round
+#define NUM_ARC_RAYS 32
+// points are tested this far towards the light, so those on a wall or at its foot do not lie on the polygon's edge
+#define EDGE_NUDGE 1.0f
+// lights hang at the camera's height
+#define LIGHT_HEIGHT (TILE_SIZE / 2.0f)
+
+// a corner of a light's polygon, with the direction it lies in as seen from the light
+typedef struct LightVertex {
+    float x;
+    float y;
+    float angle;    // pseudo angle, see pseudoAngle
+} LightVertex;
+
+typedef struct ShadowLight {
+    float x;
+    float y;
+    float radius;
+    float brightness;
+    bool used;
+    bool stale;             // moved, or cells in reach changed, since its polygon was found
+    LightVertex *polygon;   // in increasing angle
+    int numVertices;
+    int vertexCapacity;
+} ShadowLight;
+
+struct LightSet {
+    ShadowLight *lights;
+    int numLights;          // including unused ones
+    int capacity;
+    unsigned long mapSerial;
+    unsigned long mapRevision;
+    float *angles;          // rays to cast while finding a polygon
+    int angleCapacity;
+};
+
+static void markChangedCell(void *user, int col, int row);
+static bool findPolygon(LightSet *set, ShadowLight *light, const Map *map);
+static bool addAngle(LightSet *set, int *numAngles, float angle);
+static bool isSolidCell(const Map *map, int col, int row);
+static bool lightReachesNear(const ShadowLight *light, float x, float y, float towardsX, float towardsY);
+static bool lightReaches(const ShadowLight *light, float x, float y);
+static float pseudoAngle(float dx, float dy);
+static int compareAngles(const void *a, const void *b);
+
+LightSet *lightSetCreate(void) {
+    return (LightSet*) calloc(1, sizeof(LightSet));
+}
+
+void lightSetDestroy(LightSet *set) {
+    if (set == NULL) {
+        return;
+    }
+    for (int i = 0; i < set->capacity; i++) {
+        free(set->lights[i].polygon);
+    }
+    free(set->lights);
+    free(set->angles);
+    free(set);
+}
+
+bool lightSetCopy(LightSet *copy, const LightSet *set) {
+    if (copy->capacity < set->numLights) {
+        ShadowLight *lights = (ShadowLight*) realloc(copy->lights, sizeof(ShadowLight) * set->numLights);
+        if (lights == NULL) {
+            return false;
+        }
+        memset(&lights[copy->capacity], 0, sizeof(ShadowLight) * (set->numLights - copy->capacity));
+        copy->lights = lights;
+        copy->capacity = set->numLights;
+    }
+    for (int i = 0; i < set->numLights; i++) {
+        const ShadowLight *light = &set->lights[i];
+        ShadowLight *copied = &copy->lights[i];
+        if (copied->vertexCapacity < light->numVertices) {
+            LightVertex *polygon = (LightVertex*) realloc(copied->polygon, sizeof(LightVertex) * light->numVertices);
+            if (polygon == NULL) {
+                return false;
+            }
+            copied->polygon = polygon;
+            copied->vertexCapacity = light->numVertices;
+        }
+        LightVertex *polygon = copied->polygon;
+        int vertexCapacity = copied->vertexCapacity;
+        *copied = *light;
+        copied->polygon = polygon;
+        copied->vertexCapacity = vertexCapacity;
+        if (light->numVertices > 0) {
+            memcpy(polygon, light->polygon, sizeof(LightVertex) * light->numVertices);
+        }
+    }
+    copy->numLights = set->numLights;
+    copy->mapSerial = set->mapSerial;
+    copy->mapRevision = set->mapRevision;
+    return true;
+}
+
+int lightSetAdd(LightSet *set, float x, float y, float radius, float brightness) {
+    int id = 0;
+    while (id < set->numLights && set->lights[id].used) {
+        id++;
+    }
+    if (id == set->capacity) {
+        int capacity = set->capacity > 0 ? set->capacity * 2 : 16;
+        ShadowLight *lights = (ShadowLight*) realloc(set->lights, sizeof(ShadowLight) * capacity);
+        if (lights == NULL) {
+            return -1;
+        }
+        memset(&lights[set->capacity], 0, sizeof(ShadowLight) * (capacity - set->capacity));
+        set->lights = lights;
+        set->capacity = capacity;
+    }
+    set->numLights = id == set->numLights ? id + 1 : set->numLights;
+    ShadowLight *light = &set->lights[id];
+    light->x = x;
+    light->y = y;
+    light->radius = radius;
+    light->brightness = brightness;
+    light->used = true;
+    light->stale = true;
+    light->numVertices = 0;
+    return id;
+}
+
+void lightSetRemove(LightSet *set, int id) {
+    if (id >= 0 && id < set->numLights) {
+        set->lights[id].used = false;
+        set->lights[id].numVertices = 0;
+    }
+}
+
+void lightSetMove(LightSet *set, int id, float x, float y) {
+    if (id < 0 || id >= set->numLights || (set->lights[id].x == x && set->lights[id].y == y)) {
+        return;
+    }
+    set->lights[id].x = x;
+    set->lights[id].y = y;
+    set->lights[id].stale = true;
+}
+
+void lightSetBrightness(LightSet *set, int id, float brightness) {
+    if (id >= 0 && id < set->numLights) {
+        set->lights[id].brightness = brightness;
+    }
+}
+
+int lightSetCount(const LightSet *set) {
+    int count = 0;
+    for (int i = 0; i < set->numLights; i++) {
+        count += set->lights[i].used ? 1 : 0;
+    }
+    return count;
+}
+
+void lightSetUpdate(LightSet *set, const Map *map, FrameStats *stats) {
+    if (map->serial != set->mapSerial || !mapForEachChange(map, set->mapRevision, markChangedCell, set)) {
+        for (int i = 0; i < set->numLights; i++) {
+            set->lights[i].stale = true;
+        }
+    }
+    set->mapSerial = map->serial;
+    set->mapRevision = mapRevision(map);
+
+    for (int i = 0; i < set->numLights; i++) {
+        ShadowLight *light = &set->lights[i];
+        if (!light->used || !light->stale) {
+            continue;
+        }
+        double start = statsNow();
+        if (!findPolygon(set, light, map)) {
+            light->numVertices = 0;
+        }
+        light->stale = false;
+        statsRecord(stats, STAT_LIGHT_SHADOW, statsNow() - start);
+    }
+}
+
+int lightSetFloorScale(const LightSet *set, float x, float y) {
+    float scale = 0;
+    for (int i = 0; i < set->numLights; i++) {
+        const ShadowLight *light = &set->lights[i];
+        float dx = light->x - x;
+        float dy = light->y - y;
+        float distanceSquared = dx * dx + dy * dy + LIGHT_HEIGHT * LIGHT_HEIGHT;
+        // a removed light keeps its place, and lightReachesNear would still light what is right next to it
+        if (!light->used || distanceSquared >= light->radius * light->radius || !lightReachesNear(light, x, y, dx, dy)) {
+            continue;
+        }
+        float distance = sqrtf(distanceSquared);
+        float falloff = 1 - distance / light->radius;
+        scale += light->brightness * falloff * falloff * (LIGHT_HEIGHT / distance);
+    }
+    return (int)(scale * 256);
+}
+
+int lightSetWallScale(const LightSet *set, const Ray *hit) {
+    float scale = 0;
+    for (int i = 0; i < set->numLights; i++) {
+        const ShadowLight *light = &set->lights[i];
+        float dx = light->x - hit->wallHitX;
+        float dy = light->y - hit->wallHitY;
+        float distanceSquared = dx * dx + dy * dy;
+        if (!light->used || distanceSquared >= light->radius * light->radius || !lightReachesNear(light, hit->wallHitX, hit->wallHitY, dx, dy)) {
+            continue;
+        }
+        float distance = sqrtf(distanceSquared);
+        // how squarely the light falls on the face, from whichever side it is on
+        float facing = fabsf(hit->wasHitVertical ? dx : dy) / distance;
+        float falloff = 1 - distance / light->radius;
+        scale += light->brightness * falloff * falloff * facing;
+    }
+    return (int)(scale * 256);
+}
+
+// PRIVATE
+
+static void markChangedCell(void *user, int col, int row) {
+    LightSet *set = (LightSet*) user;
+    for (int i = 0; i < set->numLights; i++) {
+        ShadowLight *light = &set->lights[i];
+        // the nearest point of the cell to the light
+        float x = light->x < col * TILE_SIZE ? col * TILE_SIZE : light->x > (col + 1) * TILE_SIZE ? (col + 1) * TILE_SIZE : light->x;
+        float y = light->y < row * TILE_SIZE ? row * TILE_SIZE : light->y > (row + 1) * TILE_SIZE ? (row + 1) * TILE_SIZE : light->y;
+        if ((x - light->x) * (x - light->x) + (y - light->y) * (y - light->y) < light->radius * light->radius) {
+            light->stale = true;
+        }
+    }
+}
+
+// casts rays just past every wall corner and door edge in reach, and some at even angles, and
+// joins where they stop in angle order
+static bool findPolygon(LightSet *set, ShadowLight *light, const Map *map) {
+    int numAngles = 0;
+    for (int i = 0; i < NUM_ARC_RAYS; i++) {
+        if (!addAngle(set, &numAngles, i * (float)(2 * M_PI / NUM_ARC_RAYS))) {
+            return false;
+        }
+    }
+    int minCol = (int)floorf((light->x - light->radius) / TILE_SIZE);
+    int maxCol = (int)floorf((light->x + light->radius) / TILE_SIZE);
+    int minRow = (int)floorf((light->y - light->radius) / TILE_SIZE);
+    int maxRow = (int)floorf((light->y + light->radius) / TILE_SIZE);
+    for (int row = minRow; row <= maxRow + 1; row++) {
+        for (int col = minCol; col <= maxCol + 1; col++) {
+            float dx = col * TILE_SIZE - light->x;
+            float dy = row * TILE_SIZE - light->y;
+            if (dx * dx + dy * dy >= light->radius * light->radius) {
+                continue;
+            }
+            // only corners between solid and open cells can cast the edge of a shadow
+            int numSolid = isSolidCell(map, col - 1, row - 1) + isSolidCell(map, col, row - 1)
+                + isSolidCell(map, col - 1, row) + isSolidCell(map, col, row);
+            if (numSolid == 0 || numSolid == 4) {
+                continue;
+            }
+            float angle = atan2f(dy, dx);
+            if (!addAngle(set, &numAngles, angle - CORNER_EPSILON) || !addAngle(set, &numAngles, angle + CORNER_EPSILON)) {
+                return false;
+            }
+        }
+    }
+    for (int i = 0; i < map->numDoors; i++) {
+        int cell = map->doorCells[i];
+        int col = cell % map->numCols;
+        int row = cell / map->numCols;
+        if (col < minCol || col > maxCol || row < minRow || row > maxRow) {
+            continue;
+        }
+        // the slab runs from where it has slid to, to the far side of the cell
+        const MapDoor *door = &map->doors[cell];
+        float centerX = (col + 0.5f) * TILE_SIZE;
+        float centerY = (row + 0.5f) * TILE_SIZE;
+        float edge = door->openAmount * TILE_SIZE;
+        float alongX = door->orientation == DOOR_ALONG_X;
+        float ends[2][2] = {
+            { alongX ? col * TILE_SIZE + edge : centerX, alongX ? centerY : row * TILE_SIZE + edge },
+            { alongX ? (col + 1) * TILE_SIZE : centerX, alongX ? centerY : (row + 1) * TILE_SIZE }
+        };
+        for (int end = 0; end < 2; end++) {
+            float angle = atan2f(ends[end][1] - light->y, ends[end][0] - light->x);
+            if (!addAngle(set, &numAngles, angle - CORNER_EPSILON) || !addAngle(set, &numAngles, angle + CORNER_EPSILON)) {
+                return false;
+            }
+        }
+    }
+    qsort(set->angles, numAngles, sizeof(float), compareAngles);
+
+    if (light->vertexCapacity < numAngles) {
+        LightVertex *polygon = (LightVertex*) realloc(light->polygon, sizeof(LightVertex) * numAngles);
+        if (polygon == NULL) {
+            return false;
+        }
+        light->polygon = polygon;
+        light->vertexCapacity = numAngles;
+    }
+    Player origin = { 0 };
+    origin.x = light->x;
+    origin.y = light->y;
+    for (int i = 0; i < numAngles; i++) {
+        float directionX = cosf(set->angles[i]);
+        float directionY = sinf(set->angles[i]);
+        RayWalk walk;
+        Ray hit;
+        rayWalkBegin(&walk, set->angles[i], &origin, 0);
+        float distance = rayWalkNext(&walk, map, &hit) && hit.distance < light->radius ? hit.distance : light->radius;
+        LightVertex vertex = { light->x + directionX * distance, light->y + directionY * distance, pseudoAngle(directionX, directionY) };
+        light->polygon[i] = vertex;
+    }
+    light->numVertices = numAngles;
+    return true;
+}
+
+// keeps angles in 0 to 2 pi, the range rays are cast in
+static bool addAngle(LightSet *set, int *numAngles, float angle) {
+    if (*numAngles == set->angleCapacity) {
+        int capacity = set->angleCapacity > 0 ? set->angleCapacity * 2 : 256;
+        float *angles = (float*) realloc(set->angles, sizeof(float) * capacity);
+        if (angles == NULL) {
+            return false;
+        }
+        set->angles = angles;
+        set->angleCapacity = capacity;
+    }
+    set->angles[(*numAngles)++] = normalizeAngle(angle);
+    return true;
+}
+
+// anything in a cell, or outside the grid; doors and portals stop light too
+static bool isSolidCell(const Map *map, int col, int row) {
+    return col < 0 || col >= map->numCols || row < 0 || row >= map->numRows || map->cells[(row * map->numCols) + col] != 0;
+}
+
+// whether the light reaches (x, y), tested a little way along (towardsX, towardsY), the direction to the light
+static bool lightReachesNear(const ShadowLight *light, float x, float y, float towardsX, float towardsY) {
+    float length = sqrtf(towardsX * towardsX + towardsY * towardsY);
+    if (length <= EDGE_NUDGE) {
+        return true;
+    }
+    return lightReaches(light, x + towardsX / length * EDGE_NUDGE, y + towardsY / length * EDGE_NUDGE);
+}
+
+// whether (x, y) lies inside the light's polygon: between two neighbouring vertices by angle,
+// and on the light's side of the edge joining them
+static bool lightReaches(const ShadowLight *light, float x, float y) {
+    if (light->numVertices < 3) {
+        return false;
+    }
+    float angle = pseudoAngle(x - light->x, y - light->y);
+    // the last vertex whose angle is not past the point's, wrapping around to the last one
+    int low = 0;
+    int high = light->numVertices;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (light->polygon[middle].angle <= angle) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    const LightVertex *from = &light->polygon[low > 0 ? low - 1 : light->numVertices - 1];
+    const LightVertex *to = &light->polygon[low < light->numVertices ? low : 0];
+    float edgeX = to->x - from->x;
+    float edgeY = to->y - from->y;
+    float pointSide = edgeX * (y - from->y) - edgeY * (x - from->x);
+    float lightSide = edgeX * (light->y - from->y) - edgeY * (light->x - from->x);
+    return pointSide * lightSide >= 0;
+}
+
+// a number from 0 to 4 that grows with the angle of (dx, dy) like atan2 does, without the trigonometry
+static float pseudoAngle(float dx, float dy) {
+    float sum = fabsf(dx) + fabsf(dy);
+    if (sum == 0) {
+        return 0;
+    }
+    if (dy >= 0) {
+        return dx >= 0 ? dy / sum : 1 - dx / sum;
+    }
+    return dx < 0 ? 2 - dy / sum : 3 + dx / sum;
+}
+
+static int compareAngles(const void *a, const void *b) {
+    float first = *(const float*) a;
+    float second = *(const float*) b;
+    return first < second ? -1 : first > second ? 1 : 0;
+}
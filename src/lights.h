@@ -0,0 +1,45 @@
+#ifndef _LIGHTS_H_
+#define _LIGHTS_H_
+
+#include <stdbool.h>
+#include "map.h"
+#include "ray.h"
+#include "stats.h"
+
+// light scale of what no light reaches, in scenes lit by moving lights alone
+#define LIGHTS_AMBIENT_SCALE 38
+
+// moving point lights, such as torches or muzzle flashes, that cast shadows. every light keeps
+// the polygon of what it reaches, found by casting rays from the light past the corners of the
+// walls around it in angle order, and only finds it again once the light moved or cells within
+// its reach changed. shading a point then takes a bounds check per light and, for the lights
+// reaching that far, a binary search through the light's polygon.
+//
+// shadows are flat: every wall blocks light whatever its height, doors block where their slab
+// is and portals block it as well. lights hang at the camera's height.
+typedef struct LightSet LightSet;
+
+LightSet *lightSetCreate(void);
+void lightSetDestroy(LightSet *set);
+// makes copy hold the same lights and polygons as set, reusing its memory; fails only when out of memory
+bool lightSetCopy(LightSet *copy, const LightSet *set);
+
+// returns the id of the new light, -1 when out of memory. ids of removed lights are reused.
+int lightSetAdd(LightSet *set, float x, float y, float radius, float brightness);
+void lightSetRemove(LightSet *set, int id);
+void lightSetMove(LightSet *set, int id, float x, float y);
+// 0 switches a light off without losing its polygon
+void lightSetBrightness(LightSet *set, int id, float brightness);
+int lightSetCount(const LightSet *set);
+
+// finds the polygons of the lights that moved, and of those reaching cells changed since the
+// last update, recording the time each one takes as STAT_LIGHT_SHADOW. a light whose polygon
+// cannot be stored for lack of memory lights nothing until it is found again.
+void lightSetUpdate(LightSet *set, const Map *map, FrameStats *stats);
+
+// light scale the lights add to the floor at (x, y)
+int lightSetFloorScale(const LightSet *set, float x, float y);
+// light scale the lights add to the wall a ray hit, taken at half a tile up
+int lightSetWallScale(const LightSet *set, const Ray *hit);
+
+#endif
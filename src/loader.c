@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "loader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+#include "scheduler.h"
+
+// a 64x64 texture needs the 32k deflate window plus two scanlines; larger
+// ones grow the arena once and keep the memory for the next decode
+#define LOADER_SCRATCH_SIZE (64 * 1024)
+
+typedef enum LoadState {
+    LOAD_PENDING,
+    LOAD_DECODED,
+    LOAD_FAILED,
+    LOAD_PUBLISHED
+} LoadState;
+
+// a texture array replaced by a newer one, kept alive until no frame uses it
+typedef struct RetiredTextures {
+    Texture *textures;
+    bool *ownsTexels;
+    unsigned long lastUsingFrame;
+    struct RetiredTextures *next;
+} RetiredTextures;
+
+struct TextureLoader {
+    const char *const *paths;
+    int count;
+    Texture *textures;
+    bool *ownsTexels;
+    RetiredTextures *retired;
+    int failures;
+
+    // written by the decode workers, guarded by lock
+    pthread_mutex_t lock;
+    Texture *decoded;
+    LoadState *states;
+
+    // decode requests for the background thread, guarded by lock
+    pthread_cond_t requestsChanged;
+    bool *requested;
+    double *requestTimes;       // of the pending reload of each texture, 0 while it has none
+    bool shuttingDown;
+
+    // indices decoded by the current parallel-for, only touched by the background thread
+    int *batch;
+    FrameStats *stats;
+    Arena **freeScratch;
+    int numFreeScratch;
+    int maxFreeScratch;
+
+    Scheduler *scheduler;
+    pthread_t thread;
+    bool threadStarted;
+};
+
+static void *loaderThreadMain(void *argument);
+static void decodeTask(void *data, int batchIndex);
+static void decodeTexture(TextureLoader *loader, int index);
+static Arena *acquireScratch(TextureLoader *loader);
+static void releaseScratch(TextureLoader *loader, Arena *scratch);
+static void freeTextureArray(Texture *textures, bool *ownsTexels, int count);
+static void freeRetired(TextureLoader *loader, unsigned long framesPresented);
+
+TextureLoader *textureLoaderCreate(const char *const *paths, int count, uint32_t placeholderColor, FrameStats *stats) {
+    TextureLoader *loader = (TextureLoader*) calloc(1, sizeof(TextureLoader));
+    if (loader == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->requestsChanged, NULL);
+    loader->paths = paths;
+    loader->count = count;
+    loader->stats = stats;
+    loader->textures = (Texture*) calloc(count, sizeof(Texture));
+    loader->ownsTexels = (bool*) calloc(count, sizeof(bool));
+    loader->decoded = (Texture*) calloc(count, sizeof(Texture));
+    loader->states = (LoadState*) calloc(count, sizeof(LoadState));
+    loader->requested = (bool*) calloc(count, sizeof(bool));
+    loader->requestTimes = (double*) calloc(count, sizeof(double));
+    loader->batch = (int*) calloc(count, sizeof(int));
+    if (loader->textures == NULL || loader->ownsTexels == NULL || loader->decoded == NULL || loader->states == NULL
+        || loader->requested == NULL || loader->requestTimes == NULL || loader->batch == NULL) {
+        textureLoaderDestroy(loader);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!textureCreateSolid(&loader->textures[i], 1, 1, placeholderColor)) {
+            textureLoaderDestroy(loader);
+            return NULL;
+        }
+        loader->ownsTexels[i] = true;
+        loader->requested[i] = true;
+    }
+
+    // the scheduler's parallel-for blocks its caller, so it runs on a thread of its own
+    loader->scheduler = schedulerCreate(0);
+    loader->maxFreeScratch = loader->scheduler != NULL ? schedulerWorkerCount(loader->scheduler) : 1;
+    loader->freeScratch = (Arena**) calloc(loader->maxFreeScratch, sizeof(Arena*));
+    if (loader->freeScratch == NULL) {
+        loader->maxFreeScratch = 0;
+    }
+    if (loader->scheduler != NULL) {
+        loader->threadStarted = pthread_create(&loader->thread, NULL, loaderThreadMain, loader) == 0;
+    }
+    if (!loader->threadStarted) {
+        for (int i = 0; i < count; i++) {
+            loader->requested[i] = false;
+            decodeTexture(loader, i);
+        }
+    }
+    return loader;
+}
+
+void textureLoaderDestroy(TextureLoader *loader) {
+    if (loader == NULL) {
+        return;
+    }
+    if (loader->threadStarted) {
+        pthread_mutex_lock(&loader->lock);
+        loader->shuttingDown = true;
+        pthread_cond_signal(&loader->requestsChanged);
+        pthread_mutex_unlock(&loader->lock);
+        pthread_join(loader->thread, NULL);
+    }
+    schedulerDestroy(loader->scheduler);
+    freeRetired(loader, (unsigned long)-1);
+    if (loader->states != NULL) {
+        for (int i = 0; i < loader->count; i++) {
+            if (loader->states[i] == LOAD_DECODED) {
+                textureDestroy(&loader->decoded[i]);
+            }
+        }
+    }
+    if (loader->textures != NULL && loader->ownsTexels != NULL) {
+        freeTextureArray(loader->textures, loader->ownsTexels, loader->count);
+    } else {
+        free(loader->textures);
+        free(loader->ownsTexels);
+    }
+    for (int i = 0; i < loader->numFreeScratch; i++) {
+        arenaDestroy(loader->freeScratch[i]);
+    }
+    free(loader->freeScratch);
+    free(loader->decoded);
+    free(loader->states);
+    free(loader->requested);
+    free(loader->requestTimes);
+    free(loader->batch);
+    pthread_cond_destroy(&loader->requestsChanged);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader);
+}
+
+const Texture *textureLoaderTextures(TextureLoader *loader) {
+    return loader->textures;
+}
+
+int textureLoaderCount(TextureLoader *loader) {
+    return loader->count;
+}
+
+bool textureLoaderPoll(TextureLoader *loader, unsigned long framesSubmitted, unsigned long framesPresented) {
+    freeRetired(loader, framesPresented);
+
+    Texture *textures = NULL;
+    bool *ownsTexels = NULL;
+    RetiredTextures *retired = NULL;
+    double now = statsNow();
+    pthread_mutex_lock(&loader->lock);
+    for (int i = 0; i < loader->count; i++) {
+        if (loader->states[i] == LOAD_FAILED) {
+            loader->states[i] = LOAD_PUBLISHED;
+            loader->requestTimes[i] = 0;
+            loader->failures++;
+        }
+        if (loader->states[i] != LOAD_DECODED) {
+            continue;
+        }
+        // everything the swap needs is allocated before any texture is taken, so running out of
+        // memory leaves the decoded ones for the next poll
+        if (textures == NULL) {
+            textures = (Texture*) malloc(sizeof(Texture) * loader->count);
+            ownsTexels = (bool*) calloc(loader->count, sizeof(bool));
+            retired = (RetiredTextures*) malloc(sizeof(RetiredTextures));
+            if (textures == NULL || ownsTexels == NULL || retired == NULL) {
+                free(textures);
+                free(ownsTexels);
+                free(retired);
+                textures = NULL;
+                break;
+            }
+            memcpy(textures, loader->textures, sizeof(Texture) * loader->count);
+        }
+        // the new array owns what it swapped in, the retired one keeps what it swapped out
+        textures[i] = loader->decoded[i];
+        ownsTexels[i] = true;
+        loader->states[i] = LOAD_PUBLISHED;
+        if (loader->requestTimes[i] > 0) {
+            statsRecord(loader->stats, STAT_RELOAD, now - loader->requestTimes[i]);
+            loader->requestTimes[i] = 0;
+        }
+    }
+    pthread_mutex_unlock(&loader->lock);
+
+    if (textures == NULL) {
+        return false;
+    }
+    for (int i = 0; i < loader->count; i++) {
+        if (ownsTexels[i]) {
+            continue;
+        }
+        // carried over unchanged: ownership moves to the new array
+        ownsTexels[i] = loader->ownsTexels[i];
+        loader->ownsTexels[i] = false;
+    }
+    retired->textures = loader->textures;
+    retired->ownsTexels = loader->ownsTexels;
+    retired->lastUsingFrame = framesSubmitted;
+    retired->next = loader->retired;
+    loader->retired = retired;
+
+    loader->textures = textures;
+    loader->ownsTexels = ownsTexels;
+    return true;
+}
+
+void textureLoaderReload(TextureLoader *loader, int index) {
+    if (index < 0 || index >= loader->count) {
+        return;
+    }
+    pthread_mutex_lock(&loader->lock);
+    loader->requestTimes[index] = statsNow();
+    if (loader->states[index] == LOAD_PUBLISHED) {
+        loader->states[index] = LOAD_PENDING;
+    }
+    loader->requested[index] = loader->threadStarted;
+    pthread_cond_signal(&loader->requestsChanged);
+    pthread_mutex_unlock(&loader->lock);
+
+    if (!loader->threadStarted) {
+        decodeTexture(loader, index);
+    }
+}
+
+int textureLoaderPending(TextureLoader *loader) {
+    int pending = 0;
+    pthread_mutex_lock(&loader->lock);
+    for (int i = 0; i < loader->count; i++) {
+        pending += loader->states[i] != LOAD_PUBLISHED;
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return pending;
+}
+
+int textureLoaderFailures(TextureLoader *loader) {
+    return loader->failures;
+}
+
+// PRIVATE
+
+// decodes whatever was requested since the last batch, then sleeps until the next request
+static void *loaderThreadMain(void *argument) {
+    TextureLoader *loader = (TextureLoader*) argument;
+    pthread_mutex_lock(&loader->lock);
+    while (!loader->shuttingDown) {
+        int batchSize = 0;
+        for (int i = 0; i < loader->count; i++) {
+            if (loader->requested[i]) {
+                loader->requested[i] = false;
+                loader->batch[batchSize++] = i;
+            }
+        }
+        if (batchSize == 0) {
+            pthread_cond_wait(&loader->requestsChanged, &loader->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&loader->lock);
+        schedulerParallelFor(loader->scheduler, batchSize, decodeTask, loader);
+        pthread_mutex_lock(&loader->lock);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+static void decodeTask(void *data, int batchIndex) {
+    TextureLoader *loader = (TextureLoader*) data;
+    decodeTexture(loader, loader->batch[batchIndex]);
+}
+
+// upng keeps all of its state in the upng_t, so decodes can run on any number of threads.
+// the first load decodes straight from a mapping of the file; a reload reads a copy instead, as
+// the file may still be being rewritten and a mapping of it would fault once it shrank
+static void decodeTexture(TextureLoader *loader, int index) {
+    pthread_mutex_lock(&loader->lock);
+    bool reload = loader->requestTimes[index] > 0;
+    pthread_mutex_unlock(&loader->lock);
+
+    Texture texture;
+    Arena *scratch = acquireScratch(loader);
+    bool loaded = reload ? textureLoad(&texture, loader->paths[index], scratch) : textureLoadMapped(&texture, loader->paths[index], scratch);
+    releaseScratch(loader, scratch);
+
+    pthread_mutex_lock(&loader->lock);
+    if (loaded) {
+        // a newer decode supersedes one that was never published
+        if (loader->states[index] == LOAD_DECODED) {
+            textureDestroy(&loader->decoded[index]);
+        }
+        loader->decoded[index] = texture;
+        loader->states[index] = LOAD_DECODED;
+    } else if (loader->states[index] != LOAD_DECODED) {
+        // a failed reload, e.g. of a half-written file, keeps the texture in use
+        loader->states[index] = LOAD_FAILED;
+    }
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// one scratch arena per concurrently running decode, reused across textures
+static Arena *acquireScratch(TextureLoader *loader) {
+    Arena *scratch = NULL;
+    pthread_mutex_lock(&loader->lock);
+    if (loader->numFreeScratch > 0) {
+        scratch = loader->freeScratch[--loader->numFreeScratch];
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return scratch != NULL ? scratch : arenaCreate(LOADER_SCRATCH_SIZE);
+}
+
+static void releaseScratch(TextureLoader *loader, Arena *scratch) {
+    if (scratch == NULL) {
+        return;
+    }
+    arenaReset(scratch);
+    pthread_mutex_lock(&loader->lock);
+    if (loader->numFreeScratch < loader->maxFreeScratch) {
+        loader->freeScratch[loader->numFreeScratch++] = scratch;
+        scratch = NULL;
+    }
+    pthread_mutex_unlock(&loader->lock);
+    arenaDestroy(scratch);
+}
+
+static void freeTextureArray(Texture *textures, bool *ownsTexels, int count) {
+    for (int i = 0; i < count; i++) {
+        if (ownsTexels[i]) {
+            textureDestroy(&textures[i]);
+        }
+    }
+    free(textures);
+    free(ownsTexels);
+}
+
+// frees the arrays whose last user, the frame submitted right before the swap, has been presented
+static void freeRetired(TextureLoader *loader, unsigned long framesPresented) {
+    RetiredTextures **link = &loader->retired;
+    while (*link != NULL) {
+        RetiredTextures *retired = *link;
+        if (framesPresented >= retired->lastUsingFrame) {
+            *link = retired->next;
+            freeTextureArray(retired->textures, retired->ownsTexels, loader->count);
+            free(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
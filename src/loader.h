@@ -0,0 +1,35 @@
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stats.h"
+#include "texture.h"
+
+// decodes a list of textures concurrently in the background. until a texture
+// is decoded its slot holds a 1x1 placeholder of the given color, so rendering
+// can start right away.
+//
+// finished textures are published by textureLoaderPoll, which builds a new
+// texture array instead of writing into the one frames in flight are reading.
+// the replaced array is freed once every frame submitted before the swap has
+// been presented, which is why the poll takes both frame counters.
+//
+// textureLoaderReload decodes a texture again, e.g. after its file changed on
+// disk; the old one stays in use until the new one is published the same way.
+// the time from request to publish is recorded as STAT_RELOAD.
+typedef struct TextureLoader TextureLoader;
+
+TextureLoader *textureLoaderCreate(const char *const *paths, int count, uint32_t placeholderColor, FrameStats *stats);
+void textureLoaderDestroy(TextureLoader *loader);
+
+const Texture *textureLoaderTextures(TextureLoader *loader);
+int textureLoaderCount(TextureLoader *loader);
+
+// returns true when the texture array changed
+bool textureLoaderPoll(TextureLoader *loader, unsigned long framesSubmitted, unsigned long framesPresented);
+void textureLoaderReload(TextureLoader *loader, int index);
+int textureLoaderPending(TextureLoader *loader);
+int textureLoaderFailures(TextureLoader *loader);
+
+#endif
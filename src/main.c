@@ -1,8 +1,21 @@
 #include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ray.h"
 #include "player.h"
+#include "capture.h"
+#include "lightbaker.h"
+#include "lights.h"
+#include "loader.h"
 #include "map.h"
-#include "upng.h"
+#include "minimap.h"
+#include "pipeline.h"
+#include "reload.h"
+#include "render.h"
+#include "replay.h"
+#include "stats.h"
+#include "stream.h"
+#include "texture.h"
 #include "utils.h"
 #include "constants.h"
 
@@ -10,34 +23,110 @@ SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
 int isGameRunning = false;
 int ticksLastFrame;
-uint32_t *colorBuffer = NULL;
 SDL_Texture *colorBufferTexture;
-uint32_t *wallTexture;
-upng_t *pngTexture;
 
+const char *wallTextureFilePaths[NUM_TEXTURES] = {
+    REDBRICK_TEXTURE_FILEPATH,
+    PURPLESTONE_TEXTURE_FILEPATH,
+    MOSSYSTONE_TEXTURE_FILEPATH,
+    GRAYSTONE_TEXTURE_FILEPATH,
+    COLORSTONE_TEXTURE_FILEPATH,
+    BLUESTONE_TEXTURE_FILEPATH,
+    WOOD_TEXTURE_FILEPATH,
+    EAGLE_TEXTURE_FILEPATH
+};
+TextureLoader *textureLoader = NULL;
+AssetReloader *assetReloader = NULL;
+LightBaker *lightBaker = NULL;
+LightSet *lights = NULL;
+bool carryTorch = false;
+bool interleaveColumns = false;
+int torchLight = -1;
+
+Map *map = NULL;
+Minimap minimap;
+Scene scene;
 Player player;
-Ray rays[NUM_RAYS];
+float simulationLag = 0;
+
+FramePipeline *pipeline = NULL;
+int pipelineDepth = PIPELINE_DEPTH;
+FrameStats stats;
+bool showStats = false;
+double lastStatsReport = 0;
+double startupTime = 0;
+unsigned long framesSubmitted = 0;
+unsigned long framesPresented = 0;
+bool texturesLoaded = false;
+
+const char *recordFilePath = NULL;
+const char *replayFilePath = NULL;
+const char *captureFilePath = NULL;
+CapturePolicy capturePolicy = CAPTURE_DROP;
+FrameCapture *capture = NULL;
+const char *serveAddress = NULL;
+FrameStreamServer *streamServer = NULL;
+ReplayRecorder recorder;
+Replay replay;
 
 int initializeWindow(void);
-void setup(void);
+void setup(const char *mapFilePath);
 void processInput(void);
 void update(void);
+void simulateTick(void);
 void render(void);
 void destroyWindow(void);
-void clearColorBuffer(uint32_t color);
-void renderColorBuffer(void);
-void generate3DProjection(void);
-void renderCeiling(int wallTop, int rayIndex);
-void renderWall(int wallTop, int wallBottom, int wallHeight, int rayIndex);
-void renderFloor(int wallBottom, int rayIndex);
-
-int main() {
+void renderColorBuffer(RenderContext *frame);
+void frameWait(int ticks);
+void updateAssets(void);
+void reportStats(void);
+int runViewer(const char *address);
+
+int main(int argc, char *argv[]) {
+    const char *mapFilePath = NULL;
+    const char *viewAddress = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordFilePath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayFilePath = argv[++i];
+        } else if (strcmp(argv[i], "--pipeline-depth") == 0 && i + 1 < argc) {
+            pipelineDepth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            showStats = true;
+        } else if (strcmp(argv[i], "--torch") == 0) {
+            carryTorch = true;
+        } else if (strcmp(argv[i], "--interleave") == 0) {
+            interleaveColumns = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            captureFilePath = argv[++i];
+        } else if (strcmp(argv[i], "--capture-block") == 0) {
+            capturePolicy = CAPTURE_BLOCK;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (strcmp(argv[i], "--view") == 0 && i + 1 < argc) {
+            viewAddress = argv[++i];
+        } else {
+            mapFilePath = argv[i];
+        }
+    }
+    if (viewAddress != NULL) {
+        return runViewer(viewAddress);
+    }
+
+    // start decoding right away so it overlaps window creation
+    startupTime = statsNow();
+    textureLoader = textureLoaderCreate(wallTextureFilePaths, NUM_TEXTURES, 0xFF555555, &stats);
+
     isGameRunning = initializeWindow();
-    setup();
+    setup(mapFilePath);
     while (isGameRunning) {
+        double frameStart = statsNow();
         processInput();
         update();
         render();
+        statsRecord(&stats, STAT_FRAME, statsNow() - frameStart);
+        reportStats();
     }
     destroyWindow();
     return 0;
@@ -46,7 +135,7 @@ int main() {
 // GAME LOOP
 
 int initializeWindow(void) {
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
         fprintf(stderr, "Error initializing SDL.\n");
         return false;
     }
@@ -72,9 +161,17 @@ int initializeWindow(void) {
     return true;
 }
 
-void setup(void) {
-    player.x = WINDOW_WIDTH / 2;
-    player.y = WINDOW_HEIGHT / 2;
+void setup(const char *mapFilePath) {
+    // use the built-in level unless a map file was given on the command line
+    map = mapFilePath != NULL ? mapLoadFromFile(mapFilePath) : mapCreateDefault();
+    if (map == NULL) {
+        fprintf(stderr, "Error loading the map.\n");
+        isGameRunning = false;
+        return;
+    }
+
+    player.x = mapWidth(map) / 2;
+    player.y = mapHeight(map) / 2;
     player.width = 1;
     player.height = 1;
     player.turnDirection = 0;
@@ -83,8 +180,19 @@ void setup(void) {
     player.walkSpeed = 100;
     player.turnSpeed = 45 * (M_PI / 180);
 
-    // allocate the total amount of bytes in memory to hold our colorbuffer
-    colorBuffer = (uint32_t*) malloc(sizeof(uint32_t) * (uint32_t)WINDOW_WIDTH * (uint32_t)WINDOW_HEIGHT);
+    // a replay drives the camera from its recorded start, a recording starts from ours
+    if (replayFilePath != NULL) {
+        if (!replayLoad(&replay, replayFilePath)) {
+            fprintf(stderr, "Error loading replay %s.\n", replayFilePath);
+            isGameRunning = false;
+            return;
+        }
+        player = replay.start;
+    } else if (recordFilePath != NULL && !replayRecorderOpen(&recorder, recordFilePath, &player)) {
+        fprintf(stderr, "Error creating recording %s.\n", recordFilePath);
+        isGameRunning = false;
+        return;
+    }
 
     // create an SDL_Texture to display the colorbuffer
     colorBufferTexture = SDL_CreateTexture(
@@ -95,17 +203,62 @@ void setup(void) {
         WINDOW_HEIGHT
     );
 
-    // allocate the total amount of bytes in memory to hold our wall texture
-    wallTexture = (uint32_t*) malloc(sizeof(uint32_t) * (uint32_t)TEXTURE_WIDTH * (uint32_t)TEXTURE_HEIGHT);
+    // walls show flat placeholders until their textures finish decoding in the background
+    if (textureLoader == NULL) {
+        fprintf(stderr, "Error starting the texture loader.\n");
+        isGameRunning = false;
+        return;
+    }
+    scene.map = map;
+    scene.wallTextures = textureLoaderTextures(textureLoader);
+    scene.numWallTextures = textureLoaderCount(textureLoader);
+    scene.maxPortalHops = MAX_PORTAL_HOPS;
+    // half the columns are cast each frame, the rest carried over from the frame before
+    scene.interleaved = interleaveColumns;
 
-    // load an external texture using the upng library to decode the file
-    pngTexture = upng_new_from_file(WOOD_TEXTURE_FILEPATH);
-    if (pngTexture != NULL) {
-        upng_decode(pngTexture);
-        if (upng_get_error(pngTexture) == UPNG_EOK) {
-            wallTexture = (uint32_t*) upng_get_buffer(pngTexture);
+    // the torch follows the player around, lighting the way and casting shadows
+    if (carryTorch) {
+        lights = lightSetCreate();
+        torchLight = lights != NULL ? lightSetAdd(lights, player.x, player.y, TORCH_RADIUS, TORCH_BRIGHTNESS) : -1;
+        if (torchLight < 0) {
+            fprintf(stderr, "Error creating the torch.\n");
+            isGameRunning = false;
+            return;
+        }
+    }
+
+    // edited textures and map files are picked up without a restart; not available everywhere
+    assetReloader = assetReloaderCreate(textureLoader, wallTextureFilePaths, NUM_TEXTURES, mapFilePath, &stats);
+
+    // frames are cast and rasterized on a worker while the main thread presents
+    pipeline = framePipelineCreate(pipelineDepth, WINDOW_WIDTH, WINDOW_HEIGHT, &stats);
+    if (pipeline == NULL) {
+        fprintf(stderr, "Error creating a frame pipeline of depth %d.\n", pipelineDepth);
+        isGameRunning = false;
+        return;
+    }
+
+    // presented frames are copied aside and written to disk by an encoder thread
+    if (captureFilePath != NULL) {
+        capture = frameCaptureCreate(captureFilePath, captureFormatOf(captureFilePath), WINDOW_WIDTH, WINDOW_HEIGHT,
+            FPS, CAPTURE_BUFFERS, capturePolicy, &stats);
+        if (capture == NULL) {
+            fprintf(stderr, "Error creating capture %s.\n", captureFilePath);
+            isGameRunning = false;
+            return;
         }
     }
+
+    // presented frames are sent as deltas to a viewer started with --view, whenever one connects
+    if (serveAddress != NULL) {
+        streamServer = streamServerCreate(serveAddress, WINDOW_WIDTH, WINDOW_HEIGHT, &stats);
+        if (streamServer == NULL) {
+            fprintf(stderr, "Error serving frames on %s.\n", serveAddress);
+            isGameRunning = false;
+            return;
+        }
+    }
+    lastStatsReport = statsNow();
 }
 
 void processInput(void) {
@@ -156,25 +309,148 @@ void update(void) {
     frameWait(ticksLastFrame);
     float deltaTime = (SDL_GetTicks() - ticksLastFrame) / 1000.0f;
     ticksLastFrame = SDL_GetTicks();
-    movePlayer(&player, deltaTime);
-    castAllRays(rays, &player);
+
+    // advance the simulation in fixed ticks and carry the remainder over to the next frame
+    simulationLag += deltaTime > 0.25f ? 0.25f : deltaTime;
+    while (simulationLag >= TICK_LENGTH && isGameRunning) {
+        simulateTick();
+        simulationLag -= TICK_LENGTH;
+    }
+}
+
+void simulateTick(void) {
+    if (replayFilePath != NULL) {
+        if (!replayNextTick(&replay, &player)) {
+            isGameRunning = false;
+            return;
+        }
+    } else if (recordFilePath != NULL) {
+        replayRecordTick(&recorder, &player);
+    }
+    mapTriggerDoors(map, player.x, player.y, DOOR_TRIGGER_DISTANCE);
+    mapUpdateDoors(map, TICK_LENGTH);
+    double collisionStart = statsNow();
+    movePlayer(map, &player, TICK_LENGTH);
+    statsRecord(&stats, STAT_COLLISION, statsNow() - collisionStart);
+    if (lights != NULL) {
+        lightSetMove(lights, torchLight, player.x, player.y);
+    }
 }
 
 void render(void) {
+    updateAssets();
+
+    // queue the newest camera, then present the oldest finished frame while the worker renders
+    framePipelineSubmit(pipeline, &player, &scene);
+    framesSubmitted++;
+    RenderContext *frame = framePipelineAcquire(pipeline);
+    if (frame == NULL) {
+        return;
+    }
+
+    double presentStart = statsNow();
+    if (capture != NULL) {
+        frameCaptureSubmit(capture, frame->colorBuffer);
+    }
+    if (streamServer != NULL) {
+        streamServerSend(streamServer, frame->colorBuffer);
+    }
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
-    generate3DProjection();
-    renderColorBuffer();
-    clearColorBuffer(0xFF000000);
-    renderMap(renderer);
-    renderRays(renderer, rays, &player);
-    renderPlayer(renderer, &player);
+    renderColorBuffer(frame);
+    renderMap(renderer, &minimap, map);
+    renderRays(renderer, frame->rays, frame->width, &frame->camera);
+    renderPlayer(renderer, &frame->camera);
     SDL_RenderPresent(renderer);
+    framePipelineRelease(pipeline, frame);
+    statsRecord(&stats, STAT_PRESENT, statsNow() - presentStart);
+
+    if (framesPresented++ == 0) {
+        printf("time to first frame: %.1f ms\n", statsNow() - startupTime);
+    }
+}
+
+// swaps in textures that finished decoding and reloaded files; only new frames see them
+void updateAssets(void) {
+    double swapStart = statsNow();
+    bool swapped = false;
+    if (assetReloader != NULL) {
+        Map *reloadedMap = assetReloaderPoll(assetReloader, map, framesSubmitted, framesPresented);
+        if (reloadedMap != NULL) {
+            map = reloadedMap;
+            scene.map = map;
+            swapped = true;
+        }
+    }
+    if (textureLoaderPoll(textureLoader, framesSubmitted, framesPresented)) {
+        scene.wallTextures = textureLoaderTextures(textureLoader);
+        swapped = true;
+    }
+    // maps with lights are lit once their lightmap is baked, and rebaked as they change
+    if (lightBaker == NULL && map->numLights > 0) {
+        lightBaker = lightBakerCreate(map, &stats);
+    }
+    if (lightBaker != NULL) {
+        const Lightmap *lightmap = lightBakerPoll(lightBaker, map, framesSubmitted, framesPresented);
+        scene.lightmap = map->numLights > 0 ? lightmap : NULL;
+    }
+    // only the lights that moved, or whose surroundings changed, have their shadows found again
+    if (lights != NULL) {
+        lightSetUpdate(lights, map, &stats);
+        scene.lights = lights;
+    }
+    if (swapped) {
+        statsRecord(&stats, STAT_ASSET_SWAP, statsNow() - swapStart);
+    }
+    if (!texturesLoaded && textureLoaderPending(textureLoader) == 0) {
+        texturesLoaded = true;
+        printf("time to fully loaded: %.1f ms (%d of %d textures failed)\n",
+            statsNow() - startupTime, textureLoaderFailures(textureLoader), NUM_TEXTURES);
+    }
+}
+
+void frameWait(int ticks) {
+    int waitTime = FRAME_TIME_LENGTH - (SDL_GetTicks() - ticks);
+    if (waitTime > 0 && waitTime <= FRAME_TIME_LENGTH) {
+        SDL_Delay(waitTime);
+    }
+}
+
+void reportStats(void) {
+    if (showStats && statsNow() - lastStatsReport >= 1000) {
+        statsReport(&stats, stdout);
+        lastStatsReport = statsNow();
+    }
 }
 
 void destroyWindow(void) {
-    free(wallTexture);
-    free(colorBuffer);
+    if (capture != NULL) {
+        frameCaptureFlush(capture);
+        CaptureCounts counts = frameCaptureCounts(capture);
+        printf("captured %lu frames to %s, %lu dropped\n", counts.written, captureFilePath, counts.dropped);
+        if (counts.failed) {
+            fprintf(stderr, "Error writing capture %s, %lu frames were lost.\n", captureFilePath, counts.captured - counts.written);
+        }
+        frameCaptureDestroy(capture);
+    }
+    if (streamServer != NULL) {
+        StreamCounts counts = streamServerCounts(streamServer);
+        printf("streamed %lu frames to %lu viewers, %.1f KB per frame, %.3f ms to encode (%lu skipped)\n",
+            counts.framesSent, counts.viewers,
+            counts.framesSent > 0 ? counts.bytesSent / 1024.0 / counts.framesSent : 0,
+            counts.framesSent > 0 ? counts.encodeMilliseconds / counts.framesSent : 0,
+            counts.framesSkipped);
+        streamServerDestroy(streamServer);
+    }
+    framePipelineDestroy(pipeline);
+    lightBakerDestroy(lightBaker);
+    lightSetDestroy(lights);
+    assetReloaderDestroy(assetReloader);
+    textureLoaderDestroy(textureLoader);
+    mapDestroy(map);
+    minimapDestroy(&minimap);
+    replayRecorderClose(&recorder);
+    replayDestroy(&replay);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -182,72 +458,57 @@ void destroyWindow(void) {
 
 // RENDERING
 
-void clearColorBuffer(uint32_t color) {
-    for (int x = 0; x < WINDOW_WIDTH; x++) {
-        for (int y = 0; y < WINDOW_HEIGHT; y++) {
-            colorBuffer[(WINDOW_WIDTH * y) + x] = color;
-        }
-    }
-}
-
-void renderColorBuffer(void) {
+void renderColorBuffer(RenderContext *frame) {
     SDL_UpdateTexture(
         colorBufferTexture,
         NULL,
-        colorBuffer,
-        (int)((uint32_t)WINDOW_WIDTH * sizeof(uint32_t))
+        frame->colorBuffer,
+        (int)((uint32_t)frame->width * sizeof(uint32_t))
     );
     SDL_RenderCopy(renderer, colorBufferTexture, NULL, NULL);
 }
 
-void generate3DProjection(void) {
-    for (int i = 0; i < NUM_RAYS; i++) {
-        float perpendicularDistance = rays[i].distance * cos(rays[i].angle - player.rotationAngle);
-        float projectionPlaneDistance = (WINDOW_WIDTH / 2) / tan(FOV_ANGLE / 2);
-        float projectedWallHeight = (TILE_SIZE / perpendicularDistance) * projectionPlaneDistance;
-
-        int wallStripHeight = (int)projectedWallHeight;
-
-        int wallTopPixel = (WINDOW_HEIGHT / 2) - (wallStripHeight / 2);
-        wallTopPixel = wallTopPixel < 0 ? 0 : wallTopPixel;
-
-        int wallBottomPixel = (WINDOW_HEIGHT / 2) + (wallStripHeight / 2);
-        wallBottomPixel = wallBottomPixel > WINDOW_HEIGHT ? WINDOW_HEIGHT : wallBottomPixel;
+// REMOTE VIEWING
 
-        renderCeiling(wallTopPixel, i);
-        renderWall(wallTopPixel, wallBottomPixel, wallStripHeight, i);
-        renderFloor(wallBottomPixel, i);
-    }
-}
-
-void renderCeiling(int wallTop, int rayIndex) {
-    for (int y = 0; y < wallTop; y++) {
-        colorBuffer[(WINDOW_WIDTH * y) + rayIndex] = 0xFF444444;
-    }
-}
-
-void renderWall(int wallTop, int wallBottom, int wallHeight, int rayIndex) {
-    int textureOffsetX;
-    if (rays[rayIndex].wasHitVertical) {
-        textureOffsetX = (int)rays[rayIndex].wallHitY % TILE_SIZE;
-    }
-    else {
-        textureOffsetX = (int)rays[rayIndex].wallHitX % TILE_SIZE;
+// shows the frames a game started with --serve sends, until either side quits
+int runViewer(const char *address) {
+    isGameRunning = initializeWindow();
+    FrameStreamViewer *viewer = isGameRunning ? streamViewerConnect(address) : NULL;
+    if (isGameRunning && viewer == NULL) {
+        fprintf(stderr, "Error connecting to %s.\n", address);
+        isGameRunning = false;
     }
-
-    // render the wall from wallTopPixel to wallBottomPixel
-    for (int y = wallTop; y < wallBottom; y++) {
-        int distanceFromTop = y + (wallHeight / 2) - (WINDOW_HEIGHT / 2);
-        int textureOffsetY = distanceFromTop * ((float)TEXTURE_HEIGHT / wallHeight);
-
-        // set the color of the wall texture based on the color from the texture in memory
-        uint32_t texelColor = wallTexture[(TEXTURE_WIDTH * textureOffsetY) + textureOffsetX];
-        colorBuffer[(WINDOW_WIDTH * y) + rayIndex] = texelColor;
+    int textureWidth = 0;
+    int textureHeight = 0;
+    unsigned long framesReceived = 0;
+    while (isGameRunning) {
+        processInput();
+        int width;
+        int height;
+        const uint32_t *pixels = streamViewerReceive(viewer, &width, &height);
+        if (pixels == NULL) {
+            break;
+        }
+        if (width != textureWidth || height != textureHeight) {
+            if (colorBufferTexture != NULL) {
+                SDL_DestroyTexture(colorBufferTexture);
+            }
+            colorBufferTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, width, height);
+            textureWidth = width;
+            textureHeight = height;
+        }
+        SDL_UpdateTexture(colorBufferTexture, NULL, pixels, (int)((uint32_t)width * sizeof(uint32_t)));
+        SDL_RenderCopy(renderer, colorBufferTexture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+        framesReceived++;
     }
-}
-
-void renderFloor(int wallBottom, int rayIndex) {
-    for (int y = wallBottom; y < WINDOW_HEIGHT; y++) {
-        colorBuffer[(WINDOW_WIDTH * y) + rayIndex] = 0xFF888888;
+    printf("received %lu frames from %s\n", framesReceived, address);
+    streamViewerDestroy(viewer);
+    if (colorBufferTexture != NULL) {
+        SDL_DestroyTexture(colorBufferTexture);
     }
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
 }
@@ -1,8 +1,24 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "map.h"
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "utils.h"
 
-const int map[MAP_NUM_ROWS][MAP_NUM_COLS] = {
+typedef struct CopyUpdate {
+    Map *copy;
+    const Map *map;
+    bool complete;
+} CopyUpdate;
+
+// maps are created on the main and the reload thread alike
+static pthread_mutex_t serialLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long nextSerial = 1;
+
+static const int defaultMap[MAP_NUM_ROWS][MAP_NUM_COLS] = {
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 ,1, 1, 1, 1, 1, 1, 1},
     {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1},
     {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1},
@@ -18,35 +34,173 @@ const int map[MAP_NUM_ROWS][MAP_NUM_COLS] = {
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 ,1, 1, 1, 1, 1, 1, 1},
 };
 
-bool mapHasWallAt(float x, float y) {
-    if (x < 0 || x > WINDOW_WIDTH || y < 0 || y > WINDOW_HEIGHT) {
-        return true;
+static unsigned long newSerial(void);
+static int cellIndex(const Map *map, int col, int row);
+static int cellAt(const Map *map, float x, float y);
+static bool isSolidCell(const Map *map, int col, int row);
+static bool createDoors(Map *map);
+static bool assignCell(Map *map, int cell, int content, MapDoor door, MapPortal portal);
+static void removeDoorCell(Map *map, int cell);
+static void recordChange(Map *map, int cell);
+static void copyChangedCell(void *user, int col, int row);
+
+Map *mapCreate(int numRows, int numCols, const int *cells) {
+    if (numRows <= 0 || numCols <= 0) {
+        return NULL;
+    }
+    Map *map = (Map*) calloc(1, sizeof(Map));
+    if (map == NULL) {
+        return NULL;
+    }
+    map->numRows = numRows;
+    map->numCols = numCols;
+    map->serial = newSerial();
+    map->cells = (int*) calloc((size_t)numRows * numCols, sizeof(int));
+    map->doors = (MapDoor*) calloc((size_t)numRows * numCols, sizeof(MapDoor));
+    map->portals = (MapPortal*) calloc((size_t)numRows * numCols, sizeof(MapPortal));
+    map->heights = (float*) malloc(sizeof(float) * (size_t)numRows * numCols);
+    if (map->cells == NULL || map->doors == NULL || map->portals == NULL || map->heights == NULL) {
+        mapDestroy(map);
+        return NULL;
+    }
+    for (int i = 0; i < numRows * numCols; i++) {
+        map->portals[i].target = -1;
+        map->heights[i] = 1;
     }
-    int mapGridIndexX = floor(x / TILE_SIZE);
-    int mapGridIndexY = floor(y / TILE_SIZE);
-    return map[mapGridIndexY][mapGridIndexX] != 0;
+    map->maxWallHeight = 1;
+    if (cells != NULL) {
+        memcpy(map->cells, cells, sizeof(int) * (size_t)numRows * numCols);
+        if (!createDoors(map)) {
+            mapDestroy(map);
+            return NULL;
+        }
+    }
+    return map;
+}
+
+Map *mapCreateDefault(void) {
+    return mapCreate(MAP_NUM_ROWS, MAP_NUM_COLS, &defaultMap[0][0]);
 }
 
-void renderMap(SDL_Renderer *renderer) {
-    for (int i = 0; i < MAP_NUM_ROWS; i++) {
-        for (int j = 0; j < MAP_NUM_COLS; j++) {
-            int tileX = j * TILE_SIZE;
-            int tileY = i * TILE_SIZE;
-            int tileColor = map[i][j] != 0 ? 255 : 0;
-            SDL_SetRenderDrawColor(renderer, tileColor, tileColor, tileColor, 255);
-            SDL_Rect mapTileRect = {
-                tileX * MINIMAP_SCALE_FACTOR,
-                tileY * MINIMAP_SCALE_FACTOR,
-                TILE_SIZE * MINIMAP_SCALE_FACTOR,
-                TILE_SIZE * MINIMAP_SCALE_FACTOR
-            };
-            SDL_RenderFillRect(renderer, &mapTileRect);
+// text format: "<columns> <rows>" followed by columns * rows cell values, negative values are doors,
+// optionally followed by columns * rows wall heights in tiles, then by any number of
+// "portal <column> <row> <target column> <target row> <quarter turns>" links, then by any number
+// of "light <x> <y> <radius> <brightness>" lights, with position and radius in tiles
+Map *mapLoadFromFile(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    int numCols, numRows;
+    if (fscanf(file, "%d %d", &numCols, &numRows) != 2) {
+        fclose(file);
+        return NULL;
+    }
+    Map *map = mapCreate(numRows, numCols, NULL);
+    if (map == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    for (int i = 0; i < numRows * numCols; i++) {
+        if (fscanf(file, "%d", &map->cells[i]) != 1) {
+            mapDestroy(map);
+            fclose(file);
+            return NULL;
         }
     }
+    float height;
+    for (int i = 0; i < numRows * numCols && fscanf(file, "%f", &height) == 1; i++) {
+        map->heights[i] = height > 0 ? height : 1;
+        map->maxWallHeight = map->heights[i] > map->maxWallHeight ? map->heights[i] : map->maxWallHeight;
+    }
+    int col, row, targetCol, targetRow, quarterTurns;
+    while (fscanf(file, " portal %d %d %d %d %d", &col, &row, &targetCol, &targetRow, &quarterTurns) == 5) {
+        mapLinkPortals(map, col, row, targetCol, targetRow, quarterTurns);
+    }
+    float lightX, lightY, radius, brightness;
+    while (fscanf(file, " light %f %f %f %f", &lightX, &lightY, &radius, &brightness) == 4) {
+        if (!mapAddLight(map, lightX * TILE_SIZE, lightY * TILE_SIZE, radius * TILE_SIZE, brightness)) {
+            mapDestroy(map);
+            fclose(file);
+            return NULL;
+        }
+    }
+    fclose(file);
+    if (!createDoors(map)) {
+        mapDestroy(map);
+        return NULL;
+    }
+    return map;
 }
 
-bool inScreenBounds(float x, float y) {
-    return x >= 0 && x <= WINDOW_WIDTH && y >= 0 && y <= WINDOW_HEIGHT;
+// the copy starts a journal of its own
+Map *mapCopy(const Map *map) {
+    Map *copy = mapCreate(map->numRows, map->numCols, NULL);
+    if (copy == NULL) {
+        return NULL;
+    }
+    size_t numCells = (size_t)map->numRows * map->numCols;
+    memcpy(copy->cells, map->cells, sizeof(int) * numCells);
+    memcpy(copy->doors, map->doors, sizeof(MapDoor) * numCells);
+    memcpy(copy->portals, map->portals, sizeof(MapPortal) * numCells);
+    memcpy(copy->heights, map->heights, sizeof(float) * numCells);
+    copy->maxWallHeight = map->maxWallHeight;
+    if (map->numDoors > 0) {
+        copy->doorCells = (int*) malloc(sizeof(int) * map->numDoors);
+        if (copy->doorCells == NULL) {
+            mapDestroy(copy);
+            return NULL;
+        }
+        memcpy(copy->doorCells, map->doorCells, sizeof(int) * map->numDoors);
+        copy->numDoors = map->numDoors;
+        copy->doorCapacity = map->numDoors;
+    }
+    if (map->numLights > 0) {
+        copy->lights = (MapLight*) malloc(sizeof(MapLight) * map->numLights);
+        if (copy->lights == NULL) {
+            mapDestroy(copy);
+            return NULL;
+        }
+        memcpy(copy->lights, map->lights, sizeof(MapLight) * map->numLights);
+        copy->numLights = map->numLights;
+    }
+    return copy;
+}
+
+void mapDestroy(Map *map) {
+    if (map == NULL) {
+        return;
+    }
+    free(map->cells);
+    free(map->doors);
+    free(map->portals);
+    free(map->heights);
+    free(map->doorCells);
+    free(map->journal);
+    free(map->lights);
+    free(map);
+}
+
+float mapWidth(const Map *map) {
+    return map->numCols * TILE_SIZE;
+}
+
+float mapHeight(const Map *map) {
+    return map->numRows * TILE_SIZE;
+}
+
+bool mapHasWallAt(const Map *map, float x, float y) {
+    int cell = cellAt(map, x, y);
+    if (cell < 0) {
+        return true;
+    }
+    // a door only lets anything through once it is fully open, a portal always does
+    const MapDoor *door = &map->doors[cell];
+    return map->cells[cell] != 0 && (door->orientation == DOOR_NONE || door->openAmount < 1) && map->portals[cell].target < 0;
+}
+
+bool inMapBounds(const Map *map, float x, float y) {
+    return x >= 0 && x <= mapWidth(map) && y >= 0 && y <= mapHeight(map);
 }
 
 float calculateHitDistance(Player *player, GridIntersection *intersection) {
@@ -55,6 +209,285 @@ float calculateHitDistance(Player *player, GridIntersection *intersection) {
         : INT_MAX;
 }
 
-int mapContentAt(float x, float y) {
-    return map[(int)floor(y / TILE_SIZE)][(int)floor(x / TILE_SIZE)];
+int mapContentAt(const Map *map, float x, float y) {
+    // everything outside the grid behaves like a solid wall
+    int cell = cellAt(map, x, y);
+    return cell >= 0 ? map->cells[cell] : 1;
+}
+
+const MapDoor *mapDoorAt(const Map *map, float x, float y) {
+    int cell = cellAt(map, x, y);
+    return cell >= 0 && map->doors[cell].orientation != DOOR_NONE ? &map->doors[cell] : NULL;
+}
+
+float mapWallHeightAt(const Map *map, float x, float y) {
+    int cell = cellAt(map, x, y);
+    return cell >= 0 ? map->heights[cell] : 1;
+}
+
+int mapPortalAt(const Map *map, float x, float y) {
+    int cell = cellAt(map, x, y);
+    return cell >= 0 && map->portals[cell].target >= 0 ? cell : -1;
+}
+
+float mapCrossPortal(const Map *map, int cell, float *x, float *y, int *normalX, int *normalY) {
+    const MapPortal *portal = &map->portals[cell];
+    // relative to the portal's center the point comes out as far past the opposite face as it got in
+    float localX = *x - (cell % map->numCols + 0.5f) * TILE_SIZE + *normalX * TILE_SIZE;
+    float localY = *y - (cell / map->numCols + 0.5f) * TILE_SIZE + *normalY * TILE_SIZE;
+    for (int turn = 0; turn < portal->quarterTurns; turn++) {
+        float localSwap = localX;
+        localX = -localY;
+        localY = localSwap;
+        int normalSwap = *normalX;
+        *normalX = -*normalY;
+        *normalY = normalSwap;
+    }
+    *x = (portal->target % map->numCols + 0.5f) * TILE_SIZE + localX;
+    *y = (portal->target / map->numCols + 0.5f) * TILE_SIZE + localY;
+    return portal->quarterTurns * (float)(M_PI / 2);
+}
+
+void mapSetCell(Map *map, int col, int row, int content) {
+    int cell = cellIndex(map, col, row);
+    if (cell < 0 || (map->cells[cell] == content && map->doors[cell].orientation == DOOR_NONE && map->portals[cell].target < 0)) {
+        return;
+    }
+    MapDoor noDoor = { 0 };
+    MapPortal noPortal = { -1, 0 };
+    assignCell(map, cell, content, noDoor, noPortal);
+    recordChange(map, cell);
+}
+
+bool mapSetDoor(Map *map, int col, int row, int content) {
+    int cell = cellIndex(map, col, row);
+    if (cell < 0) {
+        return false;
+    }
+    // the slab runs between the walls the door is set into
+    MapDoor door = { 0 };
+    door.orientation = isSolidCell(map, col - 1, row) && isSolidCell(map, col + 1, row) ? DOOR_ALONG_X : DOOR_ALONG_Y;
+    MapPortal noPortal = { -1, 0 };
+    if (!assignCell(map, cell, content, door, noPortal)) {
+        return false;
+    }
+    recordChange(map, cell);
+    return true;
+}
+
+void mapSetDoorOpen(Map *map, int col, int row, float openAmount) {
+    int cell = cellIndex(map, col, row);
+    if (cell < 0 || map->doors[cell].orientation == DOOR_NONE) {
+        return;
+    }
+    MapDoor *door = &map->doors[cell];
+    openAmount = openAmount < 0 ? 0 : openAmount > 1 ? 1 : openAmount;
+    door->direction = 0;
+    if (door->openAmount != openAmount) {
+        door->openAmount = openAmount;
+        recordChange(map, cell);
+    }
+}
+
+void mapSetWallHeight(Map *map, int col, int row, float height) {
+    int cell = cellIndex(map, col, row);
+    if (cell < 0 || height <= 0 || map->heights[cell] == height) {
+        return;
+    }
+    map->heights[cell] = height;
+    map->maxWallHeight = height > map->maxWallHeight ? height : map->maxWallHeight;
+    recordChange(map, cell);
+}
+
+bool mapLinkPortals(Map *map, int col, int row, int targetCol, int targetRow, int quarterTurns) {
+    int cell = cellIndex(map, col, row);
+    int target = cellIndex(map, targetCol, targetRow);
+    if (cell < 0 || target < 0 || cell == target) {
+        return false;
+    }
+    MapDoor noDoor = { 0 };
+    MapPortal portal = { target, (unsigned char)(((quarterTurns % 4) + 4) % 4) };
+    MapPortal backPortal = { cell, (unsigned char)((4 - portal.quarterTurns) % 4) };
+    // a portal keeps the texture of the cell it replaces
+    assignCell(map, cell, map->cells[cell] != 0 ? abs(map->cells[cell]) : 1, noDoor, portal);
+    assignCell(map, target, map->cells[target] != 0 ? abs(map->cells[target]) : 1, noDoor, backPortal);
+    recordChange(map, cell);
+    recordChange(map, target);
+    return true;
+}
+
+bool mapAddLight(Map *map, float x, float y, float radius, float brightness) {
+    MapLight *lights = (MapLight*) realloc(map->lights, sizeof(MapLight) * (map->numLights + 1));
+    if (lights == NULL) {
+        return false;
+    }
+    MapLight light = { x, y, radius, brightness };
+    lights[map->numLights++] = light;
+    map->lights = lights;
+    return true;
+}
+
+void mapOpenDoor(Map *map, int col, int row) {
+    int cell = cellIndex(map, col, row);
+    if (cell >= 0 && map->doors[cell].orientation != DOOR_NONE) {
+        map->doors[cell].direction = map->doors[cell].openAmount < 1 ? 1 : 0;
+    }
+}
+
+void mapCloseDoor(Map *map, int col, int row) {
+    int cell = cellIndex(map, col, row);
+    if (cell >= 0 && map->doors[cell].orientation != DOOR_NONE) {
+        map->doors[cell].direction = map->doors[cell].openAmount > 0 ? -1 : 0;
+    }
+}
+
+void mapTriggerDoors(Map *map, float x, float y, float radius) {
+    for (int i = 0; i < map->numDoors; i++) {
+        int cell = map->doorCells[i];
+        float doorX = (cell % map->numCols + 0.5f) * TILE_SIZE;
+        float doorY = (cell / map->numCols + 0.5f) * TILE_SIZE;
+        if (distanceBetweenPoints(x, y, doorX, doorY) < radius) {
+            mapOpenDoor(map, cell % map->numCols, cell / map->numCols);
+        } else {
+            mapCloseDoor(map, cell % map->numCols, cell / map->numCols);
+        }
+    }
+}
+
+void mapUpdateDoors(Map *map, float deltaTime) {
+    for (int i = 0; i < map->numDoors; i++) {
+        int cell = map->doorCells[i];
+        MapDoor *door = &map->doors[cell];
+        if (door->direction == 0) {
+            continue;
+        }
+        float openAmount = door->openAmount + door->direction * DOOR_SPEED * deltaTime;
+        if (openAmount >= 1 || openAmount <= 0) {
+            openAmount = openAmount >= 1 ? 1 : 0;
+            door->direction = 0;
+        }
+        door->openAmount = openAmount;
+        recordChange(map, cell);
+    }
+}
+
+unsigned long mapRevision(const Map *map) {
+    return map->revision;
+}
+
+bool mapForEachChange(const Map *map, unsigned long revision, MapChangeVisitor visit, void *user) {
+    if (revision > map->revision || revision < map->journalStart || map->revision - revision > MAP_JOURNAL_CAPACITY) {
+        return false;
+    }
+    for (unsigned long r = revision; r < map->revision; r++) {
+        int cell = map->journal[r % MAP_JOURNAL_CAPACITY];
+        visit(user, cell % map->numCols, cell / map->numCols);
+    }
+    return true;
+}
+
+bool mapUpdateCopy(Map *copy, const Map *map, unsigned long revision) {
+    if (copy->numRows != map->numRows || copy->numCols != map->numCols) {
+        return false;
+    }
+    CopyUpdate update = { copy, map, true };
+    return mapForEachChange(map, revision, copyChangedCell, &update) && update.complete;
+}
+
+// PRIVATE
+
+static unsigned long newSerial(void) {
+    pthread_mutex_lock(&serialLock);
+    unsigned long serial = nextSerial++;
+    pthread_mutex_unlock(&serialLock);
+    return serial;
+}
+
+static int cellIndex(const Map *map, int col, int row) {
+    if (col < 0 || col >= map->numCols || row < 0 || row >= map->numRows) {
+        return -1;
+    }
+    return row * map->numCols + col;
+}
+
+static int cellAt(const Map *map, float x, float y) {
+    if (x < 0 || x >= mapWidth(map) || y < 0 || y >= mapHeight(map)) {
+        return -1;
+    }
+    return ((int)floor(y / TILE_SIZE) * map->numCols) + (int)floor(x / TILE_SIZE);
+}
+
+static bool isSolidCell(const Map *map, int col, int row) {
+    int cell = cellIndex(map, col, row);
+    return cell < 0 || map->cells[cell] != 0;
+}
+
+// turns the negative cells of a freshly filled grid into closed doors
+static bool createDoors(Map *map) {
+    for (int cell = 0; cell < map->numRows * map->numCols; cell++) {
+        if (map->cells[cell] < 0 && !mapSetDoor(map, cell % map->numCols, cell / map->numCols, -map->cells[cell])) {
+            return false;
+        }
+    }
+    // nothing has changed yet as far as anyone using the map is concerned
+    free(map->journal);
+    map->journal = NULL;
+    map->revision = 0;
+    map->journalStart = 0;
+    return true;
+}
+
+// sets a cell and keeps the door list in step; fails only when the door list cannot grow
+static bool assignCell(Map *map, int cell, int content, MapDoor door, MapPortal portal) {
+    bool wasDoor = map->doors[cell].orientation != DOOR_NONE;
+    bool isDoor = door.orientation != DOOR_NONE;
+    if (isDoor && !wasDoor) {
+        if (map->numDoors == map->doorCapacity) {
+            int capacity = map->doorCapacity > 0 ? map->doorCapacity * 2 : 16;
+            int *doorCells = (int*) realloc(map->doorCells, sizeof(int) * capacity);
+            if (doorCells == NULL) {
+                return false;
+            }
+            map->doorCells = doorCells;
+            map->doorCapacity = capacity;
+        }
+        map->doorCells[map->numDoors++] = cell;
+    } else if (wasDoor && !isDoor) {
+        removeDoorCell(map, cell);
+    }
+    map->cells[cell] = content;
+    map->doors[cell] = door;
+    map->portals[cell] = portal;
+    return true;
+}
+
+static void removeDoorCell(Map *map, int cell) {
+    for (int i = 0; i < map->numDoors; i++) {
+        if (map->doorCells[i] == cell) {
+            map->doorCells[i] = map->doorCells[--map->numDoors];
+            return;
+        }
+    }
+}
+
+static void recordChange(Map *map, int cell) {
+    if (map->journal == NULL) {
+        map->journal = (int*) malloc(sizeof(int) * MAP_JOURNAL_CAPACITY);
+        // without a journal, consumers older than this change can only start over
+        map->journalStart = map->journal != NULL ? map->revision : map->revision + 1;
+    }
+    if (map->journal != NULL) {
+        map->journal[map->revision % MAP_JOURNAL_CAPACITY] = cell;
+    }
+    map->revision++;
+}
+
+static void copyChangedCell(void *user, int col, int row) {
+    CopyUpdate *update = (CopyUpdate*) user;
+    int cell = row * update->map->numCols + col;
+    if (!assignCell(update->copy, cell, update->map->cells[cell], update->map->doors[cell], update->map->portals[cell])) {
+        update->complete = false;
+    }
+    update->copy->heights[cell] = update->map->heights[cell];
+    update->copy->maxWallHeight = update->map->maxWallHeight;
 }
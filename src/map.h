@@ -2,23 +2,128 @@
 #define _MAP_H_
 
 #include <stdbool.h>
-#include <SDL2/SDL.h>
 #include "player.h"
 #include "constants.h"
 
-extern const int map[MAP_NUM_ROWS][MAP_NUM_COLS];
+// how many changes the journal remembers; a consumer that falls further behind rebuilds from scratch
+#define MAP_JOURNAL_CAPACITY 16384
+
+typedef enum DoorOrientation {
+    DOOR_NONE,      // the cell is not a door
+    DOOR_ALONG_X,   // slab along the cell's horizontal center line, blocks north-south travel
+    DOOR_ALONG_Y    // slab along the cell's vertical center line, blocks east-west travel
+} DoorOrientation;
+
+// a sliding door is a slab through the middle of its cell that slides sideways into the wall as it opens
+typedef struct MapDoor {
+    float openAmount;           // 0 closed to 1 fully open
+    signed char direction;      // +1 opening, -1 closing, 0 at rest
+    unsigned char orientation;  // DoorOrientation
+} MapDoor;
+
+// a portal cell takes up no space: whatever enters it through one face comes out of the opposite
+// face of its target cell, turned by quarterTurns. links are made in pairs, so both ways work.
+typedef struct MapPortal {
+    int target;                 // linked cell, -1 when the cell is no portal
+    unsigned char quarterTurns; // 0 to 3, each turns a direction by +90 degrees on the way through
+} MapPortal;
+
+// a point light baked into the lightmaps, hanging at the camera's height of half a tile.
+// position and radius are in world units, brightness is the light it adds right next to it,
+// where 1 lights a wall fully.
+typedef struct MapLight {
+    float x;
+    float y;
+    float radius;
+    float brightness;
+} MapLight;
+
+// cells are stored row by row, 0 is empty space and any other value is a wall texture id.
+// door cells keep their texture id in cells and their state in doors, portal cells keep the
+// texture shown once a ray runs out of portal hops. walls are one tile tall unless heights says otherwise.
+//
+// every change made through the setters below is numbered and recorded in a journal, so
+// anything derived from the map can catch up by revisiting only the cells changed since the
+// revision it was built from, instead of rebuilding from the whole grid.
+typedef struct Map {
+    int numRows;
+    int numCols;
+    int *cells;
+    MapDoor *doors;             // one per cell
+    MapPortal *portals;         // one per cell
+    float *heights;             // one per cell, wall height in tiles
+    float maxWallHeight;        // no wall is taller; may overestimate after walls were lowered
+    int *doorCells;             // indices of the door cells, so animating doors never scans the grid
+    int numDoors;
+    int doorCapacity;
+    unsigned long serial;       // unique per map object, tells copies of different maps apart
+    unsigned long revision;     // number of changes made so far
+    unsigned long journalStart; // oldest revision the journal still covers
+    int *journal;               // changed cell of revision r at r % MAP_JOURNAL_CAPACITY, allocated on first change
+    MapLight *lights;           // static lights, not journaled
+    int numLights;
+} Map;
 
 typedef struct GridIntersection {
     float wallHitX;
     float wallHitY;
+    float wallHitOffset;
+    float wallHeight;
     bool foundWallHit;
+    bool wasHitVertical;
     int content;
 } GridIntersection;
 
-bool mapHasWallAt(float x, float y);
-void renderMap(SDL_Renderer *renderer);
-bool inScreenBounds(float x, float y);
+typedef void (*MapChangeVisitor)(void *user, int col, int row);
+
+// a negative cell value creates a closed door using wall texture -value, oriented between its solid neighbours
+Map *mapCreate(int numRows, int numCols, const int *cells);
+Map *mapCreateDefault(void);
+Map *mapLoadFromFile(const char *path);
+Map *mapCopy(const Map *map);
+void mapDestroy(Map *map);
+float mapWidth(const Map *map);
+float mapHeight(const Map *map);
+bool mapHasWallAt(const Map *map, float x, float y);
+bool inMapBounds(const Map *map, float x, float y);
 float calculateHitDistance(Player *player, GridIntersection *intersection);
-int mapContentAt(float x, float y);
+int mapContentAt(const Map *map, float x, float y);
+const MapDoor *mapDoorAt(const Map *map, float x, float y);
+float mapWallHeightAt(const Map *map, float x, float y);
+// index of the portal cell at (x, y), or -1
+int mapPortalAt(const Map *map, float x, float y);
+// (x, y) entered portal cell `cell` moving along the unit grid direction (normalX, normalY). moves the
+// point to where it comes out beyond the target cell, turns the direction the same way and returns
+// the turn in radians.
+float mapCrossPortal(const Map *map, int cell, float *x, float *y, int *normalX, int *normalY);
+
+// mutation, all journaled; cells outside the grid are ignored. mapSetCell removes any door or
+// portal, mapSetDoor places a closed door and fails outside the grid or when out of memory.
+// mapLinkPortals turns two distinct cells into portals leading into each other and fails outside
+// the grid; the partner of a portal that is overwritten later keeps leading one way.
+void mapSetCell(Map *map, int col, int row, int content);
+bool mapSetDoor(Map *map, int col, int row, int content);
+void mapSetDoorOpen(Map *map, int col, int row, float openAmount);
+void mapSetWallHeight(Map *map, int col, int row, float height);
+bool mapLinkPortals(Map *map, int col, int row, int targetCol, int targetRow, int quarterTurns);
+// lights are fixed once anything derived from the map exists: they are not journaled, so copies
+// and lightmaps made earlier never see them. fails only when out of memory.
+bool mapAddLight(Map *map, float x, float y, float radius, float brightness);
+void mapOpenDoor(Map *map, int col, int row);
+void mapCloseDoor(Map *map, int col, int row);
+// opens the doors within radius of (x, y) and closes the others
+void mapTriggerDoors(Map *map, float x, float y, float radius);
+// slides every moving door by one step of deltaTime
+void mapUpdateDoors(Map *map, float deltaTime);
+
+// visits the cells changed after the given revision, oldest first, possibly the same cell more
+// than once. returns false without visiting anything when the journal no longer reaches back
+// that far, in which case the caller has to treat every cell as changed.
+unsigned long mapRevision(const Map *map);
+bool mapForEachChange(const Map *map, unsigned long revision, MapChangeVisitor visit, void *user);
+
+// brings a copy of the map, made with mapCopy at the given revision, up to date by copying only the
+// changed cells. returns false when that is not possible and the copy has to be made again.
+bool mapUpdateCopy(Map *copy, const Map *map, unsigned long revision);
 
 #endif
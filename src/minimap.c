@@ -0,0 +1,147 @@
+#include "minimap.h"
+#include <stdlib.h>
+#include "constants.h"
+
+typedef struct MinimapUpdate {
+    Minimap *minimap;
+    const Map *map;
+    int minCol;
+    int minRow;
+    int maxCol;
+    int maxRow;
+} MinimapUpdate;
+
+static bool resizeMinimap(SDL_Renderer *renderer, Minimap *minimap, const Map *map);
+static void drawCell(Minimap *minimap, const Map *map, int col, int row);
+static void drawChangedCell(void *user, int col, int row);
+
+void minimapDestroy(Minimap *minimap) {
+    if (minimap->texture != NULL) {
+        SDL_DestroyTexture(minimap->texture);
+    }
+    free(minimap->pixels);
+    minimap->texture = NULL;
+    minimap->pixels = NULL;
+}
+
+void renderMap(SDL_Renderer *renderer, Minimap *minimap, const Map *map) {
+    MinimapUpdate update = { minimap, map, map->numCols, map->numRows, -1, -1 };
+    bool sameMap = minimap->texture != NULL && minimap->mapSerial == map->serial;
+    if (!sameMap || !mapForEachChange(map, minimap->mapRevision, drawChangedCell, &update)) {
+        if (!resizeMinimap(renderer, minimap, map)) {
+            return;
+        }
+        for (int row = 0; row < map->numRows; row++) {
+            for (int col = 0; col < map->numCols; col++) {
+                drawCell(minimap, map, col, row);
+            }
+        }
+        update.minCol = 0;
+        update.minRow = 0;
+        update.maxCol = map->numCols - 1;
+        update.maxRow = map->numRows - 1;
+    }
+    minimap->mapSerial = map->serial;
+    minimap->mapRevision = mapRevision(map);
+
+    // upload the bounding box of everything redrawn
+    if (update.maxCol >= update.minCol) {
+        SDL_Rect dirtyRect = {
+            update.minCol,
+            update.minRow,
+            update.maxCol - update.minCol + 1,
+            update.maxRow - update.minRow + 1
+        };
+        SDL_UpdateTexture(
+            minimap->texture,
+            &dirtyRect,
+            &minimap->pixels[(update.minRow * minimap->numCols) + update.minCol],
+            minimap->numCols * (int)sizeof(uint32_t)
+        );
+    }
+    SDL_Rect mapRect = {
+        0,
+        0,
+        map->numCols * TILE_SIZE * MINIMAP_SCALE_FACTOR,
+        map->numRows * TILE_SIZE * MINIMAP_SCALE_FACTOR
+    };
+    SDL_RenderCopy(renderer, minimap->texture, NULL, &mapRect);
+}
+
+void renderRays(SDL_Renderer *renderer, Ray *rays, int numRays, Player *player) {
+    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
+    for (int i = 0; i < numRays; i++) {
+        SDL_RenderDrawLine(
+            renderer,
+            MINIMAP_SCALE_FACTOR * player->x,
+            MINIMAP_SCALE_FACTOR * player->y,
+            MINIMAP_SCALE_FACTOR * (rays + i)->wallHitX,
+            MINIMAP_SCALE_FACTOR * (rays + i)->wallHitY
+        );
+    }
+}
+
+void renderPlayer(SDL_Renderer *renderer, Player *player) {
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_Rect playerRect = {
+        player->x * MINIMAP_SCALE_FACTOR,
+        player->y * MINIMAP_SCALE_FACTOR,
+        player->width * MINIMAP_SCALE_FACTOR,
+        player->height * MINIMAP_SCALE_FACTOR
+    };
+    SDL_RenderFillRect(renderer, &playerRect);
+    SDL_RenderDrawLine(
+        renderer,
+        MINIMAP_SCALE_FACTOR * player->x,
+        MINIMAP_SCALE_FACTOR * player->y,
+        MINIMAP_SCALE_FACTOR * player->x + cos(player->rotationAngle) * 40,
+        MINIMAP_SCALE_FACTOR * player->y + sin(player->rotationAngle) * 40
+    );
+}
+
+// PRIVATE
+
+static bool resizeMinimap(SDL_Renderer *renderer, Minimap *minimap, const Map *map) {
+    if (minimap->texture != NULL && minimap->numRows == map->numRows && minimap->numCols == map->numCols) {
+        return true;
+    }
+    minimapDestroy(minimap);
+    minimap->pixels = (uint32_t*) malloc(sizeof(uint32_t) * (size_t)map->numRows * map->numCols);
+    minimap->texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STATIC,
+        map->numCols,
+        map->numRows
+    );
+    if (minimap->pixels == NULL || minimap->texture == NULL) {
+        minimapDestroy(minimap);
+        return false;
+    }
+    minimap->numRows = map->numRows;
+    minimap->numCols = map->numCols;
+    return true;
+}
+
+// walls are white and empty space black; doors fade from white to black as they open, portals are blue
+static void drawCell(Minimap *minimap, const Map *map, int col, int row) {
+    int cell = (row * map->numCols) + col;
+    if (map->portals[cell].target >= 0) {
+        minimap->pixels[cell] = 0xFF4080FF;
+        return;
+    }
+    uint32_t tileColor = map->cells[cell] != 0 ? 255 : 0;
+    if (map->doors[cell].orientation != DOOR_NONE) {
+        tileColor = (uint32_t)(255 * (1 - map->doors[cell].openAmount));
+    }
+    minimap->pixels[cell] = 0xFF000000 | (tileColor << 16) | (tileColor << 8) | tileColor;
+}
+
+static void drawChangedCell(void *user, int col, int row) {
+    MinimapUpdate *update = (MinimapUpdate*) user;
+    drawCell(update->minimap, update->map, col, row);
+    update->minCol = col < update->minCol ? col : update->minCol;
+    update->minRow = row < update->minRow ? row : update->minRow;
+    update->maxCol = col > update->maxCol ? col : update->maxCol;
+    update->maxRow = row > update->maxRow ? row : update->maxRow;
+}
@@ -0,0 +1,27 @@
+#ifndef _MINIMAP_H_
+#define _MINIMAP_H_
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include "map.h"
+#include "player.h"
+#include "ray.h"
+
+// the grid drawn into a texture with one texel per cell. it is drawn in full once per map
+// and afterwards only the cells the map's journal reports as changed are redrawn and uploaded.
+// zero initialized is a valid empty minimap.
+typedef struct Minimap {
+    SDL_Texture *texture;
+    uint32_t *pixels;
+    int numRows;
+    int numCols;
+    unsigned long mapSerial;
+    unsigned long mapRevision;
+} Minimap;
+
+void minimapDestroy(Minimap *minimap);
+void renderMap(SDL_Renderer *renderer, Minimap *minimap, const Map *map);
+void renderRays(SDL_Renderer *renderer, Ray *rays, int numRays, Player *player);
+void renderPlayer(SDL_Renderer *renderer, Player *player);
+
+#endif
@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pipeline.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef enum FrameState {
+    FRAME_FREE,
+    FRAME_QUEUED,
+    FRAME_READY,
+    FRAME_PRESENTING
+} FrameState;
+
+typedef struct FrameSlot {
+    RenderContext context;
+    Scene scene;
+    Map *map;                   // the slot's own copy of the scene's map, so the game can change it mid-frame
+    unsigned long mapSerial;
+    unsigned long mapRevision;
+    LightSet *lights;           // the slot's own copy of the scene's moving lights
+    FrameState state;
+    double submitTime;
+    double renderStartTime;
+    double renderEndTime;
+} FrameSlot;
+
+struct FramePipeline {
+    FrameSlot slots[MAX_PIPELINE_DEPTH];
+    int depth;
+    FrameStats *stats;
+    int nextSubmit;
+    int nextRender;
+    int nextPresent;
+    int inFlight;
+    bool threaded;
+    bool shuttingDown;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t frameQueued;
+    pthread_cond_t frameReady;
+};
+
+static void *renderThreadMain(void *argument);
+static void renderSlot(FrameSlot *slot);
+static void syncSlotMap(FrameSlot *slot, const Map *map);
+static void syncSlotLights(FrameSlot *slot, const LightSet *lights);
+
+FramePipeline *framePipelineCreate(int depth, int width, int height, FrameStats *stats) {
+    if (depth < 1 || depth > MAX_PIPELINE_DEPTH) {
+        return NULL;
+    }
+    FramePipeline *pipeline = (FramePipeline*) calloc(1, sizeof(FramePipeline));
+    if (pipeline == NULL) {
+        return NULL;
+    }
+    pipeline->depth = depth;
+    pipeline->stats = stats;
+    for (int i = 0; i < depth; i++) {
+        if (!renderContextInit(&pipeline->slots[i].context, width, height)) {
+            framePipelineDestroy(pipeline);
+            return NULL;
+        }
+        // slots render in turn, so an interleaved frame rebuilds from the slot submitted before it,
+        // which is either presenting, only read, or waiting for the next submit
+        if (depth > 1) {
+            pipeline->slots[i].context.frameBefore = &pipeline->slots[(i + depth - 1) % depth].context;
+        }
+    }
+
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->frameQueued, NULL);
+    pthread_cond_init(&pipeline->frameReady, NULL);
+    // with a single buffer there is nothing to overlap, so frames render on the caller
+    if (depth > 1) {
+        pipeline->threaded = pthread_create(&pipeline->thread, NULL, renderThreadMain, pipeline) == 0;
+    }
+    return pipeline;
+}
+
+void framePipelineDestroy(FramePipeline *pipeline) {
+    if (pipeline == NULL) {
+        return;
+    }
+    if (pipeline->threaded) {
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->shuttingDown = true;
+        pthread_cond_signal(&pipeline->frameQueued);
+        pthread_mutex_unlock(&pipeline->lock);
+        pthread_join(pipeline->thread, NULL);
+    }
+    pthread_cond_destroy(&pipeline->frameReady);
+    pthread_cond_destroy(&pipeline->frameQueued);
+    pthread_mutex_destroy(&pipeline->lock);
+    for (int i = 0; i < pipeline->depth; i++) {
+        renderContextDestroy(&pipeline->slots[i].context);
+        mapDestroy(pipeline->slots[i].map);
+        lightSetDestroy(pipeline->slots[i].lights);
+    }
+    free(pipeline);
+}
+
+void framePipelineSubmit(FramePipeline *pipeline, const Player *camera, const Scene *scene) {
+    FrameSlot *slot = &pipeline->slots[pipeline->nextSubmit];
+    slot->context.camera = *camera;
+    slot->scene = *scene;
+    syncSlotMap(slot, scene->map);
+    syncSlotLights(slot, scene->lights);
+    slot->submitTime = statsNow();
+    pipeline->nextSubmit = (pipeline->nextSubmit + 1) % pipeline->depth;
+
+    if (!pipeline->threaded) {
+        renderSlot(slot);
+        slot->state = FRAME_READY;
+        pipeline->inFlight++;
+        return;
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    slot->state = FRAME_QUEUED;
+    pipeline->inFlight++;
+    pthread_cond_signal(&pipeline->frameQueued);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+RenderContext *framePipelineAcquire(FramePipeline *pipeline) {
+    // keep depth - 1 frames rendering behind the one being presented
+    if (pipeline->inFlight < (pipeline->threaded ? pipeline->depth : 1)) {
+        return NULL;
+    }
+    FrameSlot *slot = &pipeline->slots[pipeline->nextPresent];
+
+    double waitStart = statsNow();
+    pthread_mutex_lock(&pipeline->lock);
+    while (slot->state != FRAME_READY) {
+        pthread_cond_wait(&pipeline->frameReady, &pipeline->lock);
+    }
+    slot->state = FRAME_PRESENTING;
+    pipeline->inFlight--;
+    pthread_mutex_unlock(&pipeline->lock);
+    statsRecord(pipeline->stats, STAT_PRESENT_WAIT, statsNow() - waitStart);
+
+    pipeline->nextPresent = (pipeline->nextPresent + 1) % pipeline->depth;
+    return &slot->context;
+}
+
+void framePipelineRelease(FramePipeline *pipeline, RenderContext *frame) {
+    FrameSlot *slot = (FrameSlot*) frame;
+    statsRecord(pipeline->stats, STAT_RENDER, slot->renderEndTime - slot->renderStartTime);
+    statsRecord(pipeline->stats, STAT_LATENCY, statsNow() - slot->submitTime);
+
+    pthread_mutex_lock(&pipeline->lock);
+    slot->state = FRAME_FREE;
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// PRIVATE
+
+static void *renderThreadMain(void *argument) {
+    FramePipeline *pipeline = (FramePipeline*) argument;
+
+    pthread_mutex_lock(&pipeline->lock);
+    for (;;) {
+        FrameSlot *slot = &pipeline->slots[pipeline->nextRender];
+        while (slot->state != FRAME_QUEUED && !pipeline->shuttingDown) {
+            pthread_cond_wait(&pipeline->frameQueued, &pipeline->lock);
+        }
+        if (pipeline->shuttingDown) {
+            break;
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+
+        renderSlot(slot);
+
+        pthread_mutex_lock(&pipeline->lock);
+        slot->state = FRAME_READY;
+        pipeline->nextRender = (pipeline->nextRender + 1) % pipeline->depth;
+        pthread_cond_signal(&pipeline->frameReady);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// the slot is not rendering, so its copy can be brought up to date with just the cells that
+// changed since it was last submitted; only a different map or a lost journal costs a full copy
+static void syncSlotMap(FrameSlot *slot, const Map *map) {
+    if (slot->map == NULL || slot->mapSerial != map->serial || !mapUpdateCopy(slot->map, map, slot->mapRevision)) {
+        mapDestroy(slot->map);
+        slot->map = mapCopy(map);
+        slot->mapSerial = map->serial;
+    }
+    slot->mapRevision = mapRevision(map);
+    // without memory for a copy the frame reads the map itself, which is only safe while nothing changes it
+    if (slot->map != NULL) {
+        slot->scene.map = slot->map;
+    }
+}
+
+// lights are few and their polygons small, so they are copied whole every frame
+static void syncSlotLights(FrameSlot *slot, const LightSet *lights) {
+    if (lights == NULL) {
+        return;
+    }
+    if (slot->lights == NULL) {
+        slot->lights = lightSetCreate();
+    }
+    // unlike the map, the lights are moved every frame, so a frame that cannot copy them goes without
+    slot->scene.lights = slot->lights != NULL && lightSetCopy(slot->lights, lights) ? slot->lights : NULL;
+}
+
+static void renderSlot(FrameSlot *slot) {
+    slot->renderStartTime = statsNow();
+    renderView(&slot->context, &slot->scene);
+    slot->renderEndTime = statsNow();
+}
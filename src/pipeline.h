@@ -0,0 +1,32 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "player.h"
+#include "render.h"
+#include "stats.h"
+
+#define MAX_PIPELINE_DEPTH 3
+
+// renders frames on a worker thread while the caller presents earlier ones.
+// depth 1 renders synchronously, depth 2 overlaps rendering frame N + 1 with
+// presenting frame N, depth 3 allows one more frame in flight at the cost of
+// one more frame of latency.
+typedef struct FramePipeline FramePipeline;
+
+FramePipeline *framePipelineCreate(int depth, int width, int height, FrameStats *stats);
+void framePipelineDestroy(FramePipeline *pipeline);
+
+// queues a frame for the given camera; never blocks since at most depth - 1
+// frames are in flight between an acquire and the next submit. the scene, its
+// map and its lights are copied, so they may change right after the submit; map
+// copies are kept up to date from the map's journal. the textures and lightmap
+// must stay alive until the frame is released. interleaved frames rebuild from the
+// frame submitted before them, whichever slot rendered it.
+void framePipelineSubmit(FramePipeline *pipeline, const Player *camera, const Scene *scene);
+
+// returns the oldest submitted frame once it finished rendering, or NULL while
+// the pipeline is still filling up; must be released before the next submit
+RenderContext *framePipelineAcquire(FramePipeline *pipeline);
+void framePipelineRelease(FramePipeline *pipeline, RenderContext *frame);
+
+#endif
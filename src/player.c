@@ -1,34 +1,36 @@
 #include "player.h"
+#include "collision.h"
 #include "constants.h"
 #include "map.h"
 
-void movePlayer(Player *player, float deltaTime) {
+void movePlayer(const Map *map, Player *player, float deltaTime) {
     player->rotationAngle += player->turnDirection * player->turnSpeed * deltaTime;
     float moveStep = player->walkDirection * player->walkSpeed * deltaTime;
 
-    float newPlayerX = player->x + cos(player->rotationAngle) * moveStep;
-    float newPlayerY = player->y + sin(player->rotationAngle) * moveStep;
+    float newPlayerX = player->x;
+    float newPlayerY = player->y;
+    collisionMoveCircle(map, &newPlayerX, &newPlayerY, PLAYER_RADIUS,
+        cos(player->rotationAngle) * moveStep, sin(player->rotationAngle) * moveStep);
 
-    if (!mapHasWallAt(newPlayerX, newPlayerY)) {
-        player->x = newPlayerX;
-        player->y = newPlayerY;
+    // a step into a portal lands as far past its target, facing the way the portal turns
+    float turn = 0;
+    int portalCell = mapPortalAt(map, newPlayerX, newPlayerY);
+    int normalX = (int)floor(newPlayerX / TILE_SIZE) - (int)floor(player->x / TILE_SIZE);
+    int normalY = (int)floor(newPlayerY / TILE_SIZE) - (int)floor(player->y / TILE_SIZE);
+    if (portalCell >= 0 && (normalX != 0 || normalY != 0)) {
+        // slipping in past a corner has no face to come out of, and portals do not chain
+        if (normalX * normalX + normalY * normalY != 1) {
+            return;
+        }
+        turn = mapCrossPortal(map, portalCell, &newPlayerX, &newPlayerY, &normalX, &normalY);
+        if (mapPortalAt(map, newPlayerX, newPlayerY) >= 0 || mapHasWallAt(map, newPlayerX, newPlayerY)) {
+            return;
+        }
+        // the walls around the exit need not line up with the ones around the entrance
+        collisionMoveCircle(map, &newPlayerX, &newPlayerY, PLAYER_RADIUS, 0, 0);
     }
-}
 
-void renderPlayer(SDL_Renderer *renderer, Player *player) {
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    SDL_Rect playerRect = {
-        player->x * MINIMAP_SCALE_FACTOR,
-        player->y * MINIMAP_SCALE_FACTOR,
-        player->width * MINIMAP_SCALE_FACTOR,
-        player->height * MINIMAP_SCALE_FACTOR
-    };
-    SDL_RenderFillRect(renderer, &playerRect);
-    SDL_RenderDrawLine(
-        renderer,
-        MINIMAP_SCALE_FACTOR * player->x,
-        MINIMAP_SCALE_FACTOR * player->y,
-        MINIMAP_SCALE_FACTOR * player->x + cos(player->rotationAngle) * 40,
-        MINIMAP_SCALE_FACTOR * player->y + sin(player->rotationAngle) * 40
-    );
-}
\ No newline at end of file
+    player->x = newPlayerX;
+    player->y = newPlayerY;
+    player->rotationAngle += turn;
+}
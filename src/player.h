@@ -1,8 +1,6 @@
 #ifndef _PLAYER_H_
 #define _PLAYER_H_
 
-#include <SDL2/SDL.h>
-
 typedef struct Player {
     float x;
     float y;
@@ -15,7 +13,8 @@ typedef struct Player {
     float turnSpeed;
 } Player;
 
-void movePlayer(Player *player, float deltaTime);
-void renderPlayer(SDL_Renderer *renderer, Player *player);
+struct Map;
+
+void movePlayer(const struct Map *map, Player *player, float deltaTime);
 
 #endif
@@ -0,0 +1,155 @@
+#include "pngwrite.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// deflate's stored blocks hold at most this many bytes each
+#define STORED_BLOCK_SIZE 65535
+// bytes of adler-32 that can be summed before its second sum could overflow 32 bits
+#define ADLER_RUN 5552
+
+typedef struct PngWriter {
+    FILE *file;
+    uint32_t crcTable[256];
+    uint32_t crc;           // of the chunk being written
+    uint32_t adlerA;        // of the image data, as zlib wants it
+    uint32_t adlerB;
+    uint32_t blockLeft;     // bytes left in the current stored block
+    uint32_t dataLeft;      // image data bytes left to write
+    bool failed;
+} PngWriter;
+
+static void beginChunk(PngWriter *writer, const char *type, uint32_t length);
+static void endChunk(PngWriter *writer);
+static void writeImageData(PngWriter *writer, const unsigned char *bytes, uint32_t count);
+static void writeBytes(PngWriter *writer, const unsigned char *bytes, uint32_t count);
+static void putUint32(unsigned char *bytes, uint32_t value);
+
+bool pngWrite(const char *path, const uint32_t *pixels, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    // every row starts with its filter type, always none
+    uint32_t rowSize = 1 + 3 * (uint32_t)width;
+    uint32_t dataSize = rowSize * (uint32_t)height;
+    uint32_t numBlocks = (dataSize + STORED_BLOCK_SIZE - 1) / STORED_BLOCK_SIZE;
+    unsigned char *row = (unsigned char*) malloc(rowSize);
+    FILE *file = row != NULL ? fopen(path, "wb") : NULL;
+    if (file == NULL) {
+        free(row);
+        return false;
+    }
+
+    PngWriter writer = { file };
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        writer.crcTable[i] = crc;
+    }
+    writer.adlerA = 1;
+    writer.dataLeft = dataSize;
+
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    writeBytes(&writer, signature, 8);
+    // 8 bits per channel, RGB, default compression, filtering and no interlacing
+    unsigned char header[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0 };
+    putUint32(&header[0], (uint32_t)width);
+    putUint32(&header[4], (uint32_t)height);
+    beginChunk(&writer, "IHDR", 13);
+    writeBytes(&writer, header, 13);
+    endChunk(&writer);
+
+    // a zlib stream of stored blocks: its header, 5 bytes ahead of every block and the checksum
+    beginChunk(&writer, "IDAT", 2 + dataSize + 5 * numBlocks + 4);
+    static const unsigned char zlibHeader[2] = { 0x78, 0x01 };
+    writeBytes(&writer, zlibHeader, 2);
+    for (int y = 0; y < height; y++) {
+        const uint32_t *pixel = &pixels[(size_t)y * width];
+        row[0] = 0;
+        for (int x = 0; x < width; x++) {
+            row[1 + 3 * x] = pixel[x] & 0xFF;
+            row[2 + 3 * x] = (pixel[x] >> 8) & 0xFF;
+            row[3 + 3 * x] = (pixel[x] >> 16) & 0xFF;
+        }
+        writeImageData(&writer, row, rowSize);
+    }
+    unsigned char adler[4];
+    putUint32(adler, (writer.adlerB << 16) | writer.adlerA);
+    writeBytes(&writer, adler, 4);
+    endChunk(&writer);
+
+    beginChunk(&writer, "IEND", 0);
+    endChunk(&writer);
+
+    free(row);
+    bool written = !writer.failed;
+    return fclose(file) == 0 && written;
+}
+
+// PRIVATE
+
+static void beginChunk(PngWriter *writer, const char *type, uint32_t length) {
+    unsigned char bytes[4];
+    putUint32(bytes, length);
+    writeBytes(writer, bytes, 4);
+    // the checksum covers the type and the data
+    writer->crc = 0xFFFFFFFFu;
+    writeBytes(writer, (const unsigned char*) type, 4);
+}
+
+static void endChunk(PngWriter *writer) {
+    unsigned char bytes[4];
+    putUint32(bytes, writer->crc ^ 0xFFFFFFFFu);
+    writeBytes(writer, bytes, 4);
+}
+
+// splits the image data into stored blocks and keeps its adler-32
+static void writeImageData(PngWriter *writer, const unsigned char *bytes, uint32_t count) {
+    while (count > 0) {
+        if (writer->blockLeft == 0) {
+            uint32_t size = writer->dataLeft < STORED_BLOCK_SIZE ? writer->dataLeft : STORED_BLOCK_SIZE;
+            unsigned char blockHeader[5] = {
+                size == writer->dataLeft ? 1 : 0,
+                size & 0xFF, (size >> 8) & 0xFF, ~size & 0xFF, (~size >> 8) & 0xFF
+            };
+            writeBytes(writer, blockHeader, 5);
+            writer->blockLeft = size;
+        }
+        uint32_t piece = count < writer->blockLeft ? count : writer->blockLeft;
+        writeBytes(writer, bytes, piece);
+        for (uint32_t start = 0; start < piece; start += ADLER_RUN) {
+            uint32_t end = piece - start < ADLER_RUN ? piece : start + ADLER_RUN;
+            for (uint32_t i = start; i < end; i++) {
+                writer->adlerA += bytes[i];
+                writer->adlerB += writer->adlerA;
+            }
+            writer->adlerA %= 65521;
+            writer->adlerB %= 65521;
+        }
+        writer->blockLeft -= piece;
+        writer->dataLeft -= piece;
+        bytes += piece;
+        count -= piece;
+    }
+}
+
+// writes bytes and adds them to the chunk's checksum
+static void writeBytes(PngWriter *writer, const unsigned char *bytes, uint32_t count) {
+    uint32_t crc = writer->crc;
+    for (uint32_t i = 0; i < count; i++) {
+        crc = writer->crcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    writer->crc = crc;
+    if (!writer->failed && fwrite(bytes, 1, count, writer->file) != count) {
+        writer->failed = true;
+    }
+}
+
+// big endian, as png wants every number
+static void putUint32(unsigned char *bytes, uint32_t value) {
+    bytes[0] = (value >> 24) & 0xFF;
+    bytes[1] = (value >> 16) & 0xFF;
+    bytes[2] = (value >> 8) & 0xFF;
+    bytes[3] = value & 0xFF;
+}
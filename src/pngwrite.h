@@ -0,0 +1,12 @@
+#ifndef _PNGWRITE_H_
+#define _PNGWRITE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// writes pixels in color buffer layout (red in the low byte) as an 8-bit RGB png, dropping alpha.
+// the image data is stored without compression: writing costs little more than the file's size
+// in checksums, so a capture thread keeps up with the frame rate, at some 3 bytes per pixel.
+bool pngWrite(const char *path, const uint32_t *pixels, int width, int height);
+
+#endif
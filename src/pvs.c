@@ -0,0 +1,588 @@
+#include "pvs.h"
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bounding box width of a cell that sees everything
+#define SEES_EVERYTHING -1
+
+// what a cell does to sight
+#define CELL_OPEN 0
+#define CELL_OPAQUE 1
+#define CELL_PORTAL 2   // blocks the straight line, but shows whatever lies beyond its target
+
+typedef struct PvsCell {
+    size_t offset;      // of the first byte of the cell's bitset
+    int minCol;         // of the bounding box of what the cell sees
+    int minRow;
+    int numCols;        // 0 when the cell sees nothing, SEES_EVERYTHING when it sees a portal
+    int numRows;
+} PvsCell;
+
+struct Pvs {
+    unsigned long serial;       // of the map the set was built for
+    unsigned long revision;     // of that map, the set was last checked against
+    int numRows;
+    int numCols;
+    bool stale;                 // a wall the set relies on is gone
+    unsigned char *kinds;       // of every cell when the set was built
+    PvsCell *cells;
+    unsigned char *bits;        // the bitsets of all cells, row by row
+    size_t numBytes;
+};
+
+// the sets of one row of cells, built by one task and gathered once all are done
+typedef struct RowSets {
+    unsigned char *bits;
+    size_t numBytes;
+    size_t capacity;
+    bool failed;
+} RowSets;
+
+typedef struct PvsBuild {
+    Pvs *pvs;
+    RowSets *rows;
+} PvsBuild;
+
+typedef struct Sighting {
+    int col;
+    int row;
+} Sighting;
+
+// cells seen from one cell, in any order and possibly repeated
+typedef struct Sightings {
+    Sighting *cells;
+    int count;
+    int capacity;
+    bool failed;
+    bool seesPortal;
+} Sightings;
+
+// a line through two corners of cells, in a quadrant's coordinates: the traced cell spans 0 to 1
+// on both axes and the quadrant's cells lie towards positive x and y
+typedef struct SightLine {
+    int startX;
+    int startY;
+    int endX;
+    int endY;
+} SightLine;
+
+// a corner a view's line was bent around, and the one it was bent around before, -1 for none
+typedef struct Bump {
+    int x;
+    int y;
+    int parent;
+} Bump;
+
+// the sight lines between a shallow and a steep line, each of which runs from a point of the
+// traced cell past the corners of the walls bounding the view on that side
+typedef struct View {
+    SightLine shallow;
+    SightLine steep;
+    int shallowBump;
+    int steepBump;
+} View;
+
+// a quarter of what a cell sees, traced from the whole of it: the views still open, from the
+// shallowest to the steepest, and the corners their lines were bent around. kept across cells.
+typedef struct Quadrant {
+    const Pvs *pvs;
+    Sightings *sightings;
+    int col;            // of the traced cell
+    int row;
+    int stepX;          // the quadrant's direction on the map, +1 or -1
+    int stepY;
+    View *views;
+    int numViews;
+    int viewCapacity;
+    Bump *bumps;
+    int numBumps;
+    int bumpCapacity;
+} Quadrant;
+
+typedef struct PvsUpdate {
+    Pvs *pvs;
+    const Scene *scene;
+} PvsUpdate;
+
+static unsigned char cellKind(const Scene *scene, int cell);
+static void buildRowTask(void *data, int row);
+static void traceCell(Quadrant *quadrant, int col, int row);
+static void traceQuadrant(Quadrant *quadrant, int stepX, int stepY);
+static int visitCell(Quadrant *quadrant, int x, int y, int viewIndex);
+static bool splitView(Quadrant *quadrant, int viewIndex);
+static int addBump(Quadrant *quadrant, int x, int y, int parent);
+static void addShallowBump(Quadrant *quadrant, int viewIndex, int x, int y);
+static void addSteepBump(Quadrant *quadrant, int viewIndex, int x, int y);
+static bool checkView(Quadrant *quadrant, int viewIndex);
+static void removeView(Quadrant *quadrant, int viewIndex);
+static int lineSide(const SightLine *line, int x, int y);
+static void addSighting(Sightings *sightings, int col, int row);
+static bool storeSet(RowSets *rowSets, PvsCell *pvsCell, const Sightings *sightings);
+static bool cellSees(const Pvs *pvs, const PvsCell *from, int col, int row);
+static int cellIndexAt(const Pvs *pvs, float x, float y);
+static void checkChange(void *user, int col, int row);
+
+Pvs *pvsBuild(Scheduler *scheduler, const Scene *scene) {
+    const Map *map = scene->map;
+    int numCells = map->numRows * map->numCols;
+    Pvs *pvs = (Pvs*) calloc(1, sizeof(Pvs));
+    RowSets *rows = (RowSets*) calloc((size_t)map->numRows, sizeof(RowSets));
+    if (pvs == NULL || rows == NULL) {
+        free(pvs);
+        free(rows);
+        return NULL;
+    }
+    pvs->serial = map->serial;
+    pvs->revision = mapRevision(map);
+    pvs->numRows = map->numRows;
+    pvs->numCols = map->numCols;
+    pvs->kinds = (unsigned char*) malloc((size_t)numCells);
+    pvs->cells = (PvsCell*) calloc((size_t)numCells, sizeof(PvsCell));
+    if (pvs->kinds == NULL || pvs->cells == NULL) {
+        pvsDestroy(pvs);
+        free(rows);
+        return NULL;
+    }
+    for (int cell = 0; cell < numCells; cell++) {
+        pvs->kinds[cell] = cellKind(scene, cell);
+    }
+
+    PvsBuild build = { pvs, rows };
+    if (scheduler == NULL) {
+        for (int row = 0; row < map->numRows; row++) {
+            buildRowTask(&build, row);
+        }
+    } else {
+        schedulerParallelFor(scheduler, map->numRows, buildRowTask, &build);
+    }
+
+    // gathers the rows' sets into one block, moving every cell's offset along
+    bool failed = false;
+    size_t numBytes = 0;
+    for (int row = 0; row < map->numRows; row++) {
+        failed = failed || rows[row].failed;
+        numBytes += rows[row].numBytes;
+    }
+    pvs->bits = failed ? NULL : (unsigned char*) malloc(numBytes > 0 ? numBytes : 1);
+    if (pvs->bits != NULL) {
+        size_t start = 0;
+        for (int row = 0; row < map->numRows; row++) {
+            if (rows[row].numBytes > 0) {
+                memcpy(pvs->bits + start, rows[row].bits, rows[row].numBytes);
+            }
+            for (int col = 0; col < map->numCols; col++) {
+                pvs->cells[(row * map->numCols) + col].offset += start;
+            }
+            start += rows[row].numBytes;
+        }
+        pvs->numBytes = numBytes;
+    }
+    for (int row = 0; row < map->numRows; row++) {
+        free(rows[row].bits);
+    }
+    free(rows);
+    if (pvs->bits == NULL) {
+        pvsDestroy(pvs);
+        return NULL;
+    }
+    return pvs;
+}
+
+void pvsDestroy(Pvs *pvs) {
+    if (pvs == NULL) {
+        return;
+    }
+    free(pvs->kinds);
+    free(pvs->cells);
+    free(pvs->bits);
+    free(pvs);
+}
+
+size_t pvsMemoryUsage(const Pvs *pvs) {
+    size_t numCells = (size_t)pvs->numRows * pvs->numCols;
+    return sizeof(Pvs) + numCells * (sizeof(PvsCell) + 1) + pvs->numBytes;
+}
+
+bool pvsUpdate(Pvs *pvs, const Scene *scene) {
+    const Map *map = scene->map;
+    if (pvs->serial != map->serial || pvs->numRows != map->numRows || pvs->numCols != map->numCols) {
+        pvs->stale = true;
+        return false;
+    }
+    PvsUpdate update = { pvs, scene };
+    if (!pvs->stale && !mapForEachChange(map, pvs->revision, checkChange, &update)) {
+        // the journal lost track, so every cell is compared instead
+        for (int row = 0; row < map->numRows && !pvs->stale; row++) {
+            for (int col = 0; col < map->numCols; col++) {
+                checkChange(&update, col, row);
+            }
+        }
+    }
+    pvs->revision = mapRevision(map);
+    return !pvs->stale;
+}
+
+bool pvsCanSee(const Pvs *pvs, float fromX, float fromY, float toX, float toY) {
+    int from = cellIndexAt(pvs, fromX, fromY);
+    if (pvs->stale || from < 0) {
+        return true;
+    }
+    int to = cellIndexAt(pvs, toX, toY);
+    return to >= 0 && cellSees(pvs, &pvs->cells[from], to % pvs->numCols, to / pvs->numCols);
+}
+
+int pvsCullBodies(const Pvs *pvs, float x, float y, const Body *bodies, int numBodies, int *visible) {
+    int from = cellIndexAt(pvs, x, y);
+    int numVisible = 0;
+    for (int i = 0; i < numBodies; i++) {
+        const Body *body = &bodies[i];
+        bool seen = pvs->stale || from < 0;
+        // every cell the body's bounding square overlaps, clipped to the grid
+        int firstCol = (int)floorf((body->x - body->radius) / TILE_SIZE);
+        int lastCol = (int)floorf((body->x + body->radius) / TILE_SIZE);
+        int firstRow = (int)floorf((body->y - body->radius) / TILE_SIZE);
+        int lastRow = (int)floorf((body->y + body->radius) / TILE_SIZE);
+        firstCol = firstCol < 0 ? 0 : firstCol;
+        firstRow = firstRow < 0 ? 0 : firstRow;
+        lastCol = lastCol >= pvs->numCols ? pvs->numCols - 1 : lastCol;
+        lastRow = lastRow >= pvs->numRows ? pvs->numRows - 1 : lastRow;
+        for (int row = firstRow; row <= lastRow && !seen; row++) {
+            for (int col = firstCol; col <= lastCol && !seen; col++) {
+                seen = cellSees(pvs, &pvs->cells[from], col, row);
+            }
+        }
+        if (seen) {
+            visible[numVisible++] = i;
+        }
+    }
+    return numVisible;
+}
+
+// PRIVATE
+
+static unsigned char cellKind(const Scene *scene, int cell) {
+    const Map *map = scene->map;
+    int content = map->cells[cell];
+    if (map->portals[cell].target >= 0 && scene->maxPortalHops > 0) {
+        return CELL_PORTAL;
+    }
+    if (content == 0 || map->doors[cell].orientation != DOOR_NONE || map->heights[cell] < 1) {
+        return CELL_OPEN;
+    }
+    // the texture the renderer picks for the wall
+    if (scene->numWallTextures == 0) {
+        return CELL_OPAQUE;
+    }
+    int textureIndex = content > 0 ? (content - 1) % scene->numWallTextures : 0;
+    return scene->wallTextures[textureIndex].translucent ? CELL_OPEN : CELL_OPAQUE;
+}
+
+// builds the sets of one row of cells into that row's own block
+static void buildRowTask(void *data, int row) {
+    PvsBuild *build = (PvsBuild*) data;
+    Pvs *pvs = build->pvs;
+    RowSets *rowSets = &build->rows[row];
+    Sightings sightings = { 0 };
+    Quadrant quadrant = { pvs, &sightings };
+    for (int col = 0; col < pvs->numCols && !rowSets->failed; col++) {
+        int cell = (row * pvs->numCols) + col;
+        PvsCell *pvsCell = &pvs->cells[cell];
+        // nothing stands inside walls, and whatever enters a portal comes out elsewhere
+        if (pvs->kinds[cell] != CELL_OPEN) {
+            pvsCell->numCols = pvs->kinds[cell] == CELL_PORTAL ? SEES_EVERYTHING : 0;
+            continue;
+        }
+        traceCell(&quadrant, col, row);
+        if (sightings.failed) {
+            rowSets->failed = true;
+        } else if (sightings.seesPortal) {
+            pvsCell->numCols = SEES_EVERYTHING;
+        } else if (!storeSet(rowSets, pvsCell, &sightings)) {
+            rowSets->failed = true;
+        }
+    }
+    free(sightings.cells);
+    free(quadrant.views);
+    free(quadrant.bumps);
+}
+
+// everything seen from anywhere inside the cell, in all four directions; quadrants share the
+// lines of cells straight out from it
+static void traceCell(Quadrant *quadrant, int col, int row) {
+    Sightings *sightings = quadrant->sightings;
+    sightings->count = 0;
+    sightings->seesPortal = false;
+    addSighting(sightings, col, row);
+    quadrant->col = col;
+    quadrant->row = row;
+    for (int q = 0; q < 4 && !sightings->seesPortal && !sightings->failed; q++) {
+        traceQuadrant(quadrant, q % 2 == 0 ? 1 : -1, q < 2 ? 1 : -1);
+    }
+}
+
+// precise permissive field of view: a cell is seen when some straight line joins a point of the
+// traced cell to a point of it without passing through the inside of a wall. cells are visited
+// by their distance in steps, nearest first, each diagonal from shallow to steep, and every wall
+// met bends the lines of the view it lies in around its corners, or splits that view in two.
+static void traceQuadrant(Quadrant *quadrant, int stepX, int stepY) {
+    const Pvs *pvs = quadrant->pvs;
+    int extentX = stepX > 0 ? pvs->numCols - 1 - quadrant->col : quadrant->col;
+    int extentY = stepY > 0 ? pvs->numRows - 1 - quadrant->row : quadrant->row;
+    // the lines only have to reach past the farthest cell
+    int reach = extentX + extentY + 1;
+    quadrant->stepX = stepX;
+    quadrant->stepY = stepY;
+    quadrant->numViews = 0;
+    quadrant->numBumps = 0;
+    if (!splitView(quadrant, 0)) {
+        return;
+    }
+    View whole = { { 0, 1, reach, 0 }, { 1, 0, 0, reach }, -1, -1 };
+    quadrant->views[0] = whole;
+
+    for (int distance = 1; distance <= extentX + extentY && quadrant->numViews > 0; distance++) {
+        int firstY = distance > extentX ? distance - extentX : 0;
+        int lastY = distance < extentY ? distance : extentY;
+        int viewIndex = 0;
+        for (int y = firstY; y <= lastY && viewIndex < quadrant->numViews; y++) {
+            viewIndex = visitCell(quadrant, distance - y, y, viewIndex);
+            if (quadrant->sightings->failed) {
+                return;
+            }
+        }
+    }
+}
+
+// sights the cell if it lies in a view, and lets a wall there narrow that view. returns the view
+// the next cell along the diagonal starts looking from.
+static int visitCell(Quadrant *quadrant, int x, int y, int viewIndex) {
+    // the corners that reach furthest towards the shallow and the steep side
+    int topLeftX = x;
+    int topLeftY = y + 1;
+    int bottomRightX = x + 1;
+    int bottomRightY = y;
+    while (viewIndex < quadrant->numViews && lineSide(&quadrant->views[viewIndex].steep, bottomRightX, bottomRightY) >= 0) {
+        viewIndex++;
+    }
+    if (viewIndex == quadrant->numViews || lineSide(&quadrant->views[viewIndex].shallow, topLeftX, topLeftY) <= 0) {
+        return viewIndex;
+    }
+
+    const Pvs *pvs = quadrant->pvs;
+    int col = quadrant->col + (x * quadrant->stepX);
+    int row = quadrant->row + (y * quadrant->stepY);
+    addSighting(quadrant->sightings, col, row);
+    unsigned char kind = pvs->kinds[(row * pvs->numCols) + col];
+    if (kind == CELL_OPEN) {
+        return viewIndex;
+    }
+    quadrant->sightings->seesPortal = quadrant->sightings->seesPortal || kind == CELL_PORTAL;
+
+    const View *view = &quadrant->views[viewIndex];
+    bool blocksShallow = lineSide(&view->shallow, bottomRightX, bottomRightY) < 0;
+    bool blocksSteep = lineSide(&view->steep, topLeftX, topLeftY) > 0;
+    if (blocksShallow && blocksSteep) {
+        removeView(quadrant, viewIndex);
+    } else if (blocksShallow) {
+        addShallowBump(quadrant, viewIndex, topLeftX, topLeftY);
+        checkView(quadrant, viewIndex);
+    } else if (blocksSteep) {
+        addSteepBump(quadrant, viewIndex, bottomRightX, bottomRightY);
+        checkView(quadrant, viewIndex);
+    } else if (splitView(quadrant, viewIndex)) {
+        // the wall lies inside the view: the copy passes below it, the original above
+        int steeperIndex = viewIndex + 1;
+        addSteepBump(quadrant, viewIndex, bottomRightX, bottomRightY);
+        if (!checkView(quadrant, viewIndex)) {
+            steeperIndex--;
+        }
+        addShallowBump(quadrant, steeperIndex, topLeftX, topLeftY);
+        checkView(quadrant, steeperIndex);
+        viewIndex = steeperIndex;
+    }
+    return viewIndex;
+}
+
+// inserts a copy of the view before it, or makes room for the first view when there is none
+static bool splitView(Quadrant *quadrant, int viewIndex) {
+    if (quadrant->numViews == quadrant->viewCapacity) {
+        int capacity = quadrant->viewCapacity > 0 ? 2 * quadrant->viewCapacity : 64;
+        View *views = (View*) realloc(quadrant->views, sizeof(View) * (size_t)capacity);
+        if (views == NULL) {
+            quadrant->sightings->failed = true;
+            return false;
+        }
+        quadrant->views = views;
+        quadrant->viewCapacity = capacity;
+    }
+    if (quadrant->numViews > 0) {
+        memmove(&quadrant->views[viewIndex + 1], &quadrant->views[viewIndex], sizeof(View) * (size_t)(quadrant->numViews - viewIndex));
+    }
+    quadrant->numViews++;
+    return true;
+}
+
+static int addBump(Quadrant *quadrant, int x, int y, int parent) {
+    if (quadrant->numBumps == quadrant->bumpCapacity) {
+        int capacity = quadrant->bumpCapacity > 0 ? 2 * quadrant->bumpCapacity : 256;
+        Bump *bumps = (Bump*) realloc(quadrant->bumps, sizeof(Bump) * (size_t)capacity);
+        if (bumps == NULL) {
+            quadrant->sightings->failed = true;
+            return parent;
+        }
+        quadrant->bumps = bumps;
+        quadrant->bumpCapacity = capacity;
+    }
+    Bump bump = { x, y, parent };
+    quadrant->bumps[quadrant->numBumps] = bump;
+    return quadrant->numBumps++;
+}
+
+// bends the shallow line up through the corner, pivoting it on whichever corner of the steep
+// side it would now cut through
+static void addShallowBump(Quadrant *quadrant, int viewIndex, int x, int y) {
+    int bump = addBump(quadrant, x, y, quadrant->views[viewIndex].shallowBump);
+    View *view = &quadrant->views[viewIndex];
+    view->shallow.endX = x;
+    view->shallow.endY = y;
+    view->shallowBump = bump;
+    for (int steep = view->steepBump; steep >= 0; steep = quadrant->bumps[steep].parent) {
+        if (lineSide(&view->shallow, quadrant->bumps[steep].x, quadrant->bumps[steep].y) < 0) {
+            view->shallow.startX = quadrant->bumps[steep].x;
+            view->shallow.startY = quadrant->bumps[steep].y;
+        }
+    }
+}
+
+static void addSteepBump(Quadrant *quadrant, int viewIndex, int x, int y) {
+    int bump = addBump(quadrant, x, y, quadrant->views[viewIndex].steepBump);
+    View *view = &quadrant->views[viewIndex];
+    view->steep.endX = x;
+    view->steep.endY = y;
+    view->steepBump = bump;
+    for (int shallow = view->shallowBump; shallow >= 0; shallow = quadrant->bumps[shallow].parent) {
+        if (lineSide(&view->steep, quadrant->bumps[shallow].x, quadrant->bumps[shallow].y) > 0) {
+            view->steep.startX = quadrant->bumps[shallow].x;
+            view->steep.startY = quadrant->bumps[shallow].y;
+        }
+    }
+}
+
+// a view narrowed down to one line through a corner of the traced cell shows nothing more
+static bool checkView(Quadrant *quadrant, int viewIndex) {
+    const View *view = &quadrant->views[viewIndex];
+    const SightLine *shallow = &view->shallow;
+    bool sameLine = lineSide(shallow, view->steep.startX, view->steep.startY) == 0
+        && lineSide(shallow, view->steep.endX, view->steep.endY) == 0;
+    if (sameLine && (lineSide(shallow, 0, 1) == 0 || lineSide(shallow, 1, 0) == 0)) {
+        removeView(quadrant, viewIndex);
+        return false;
+    }
+    return true;
+}
+
+static void removeView(Quadrant *quadrant, int viewIndex) {
+    quadrant->numViews--;
+    memmove(&quadrant->views[viewIndex], &quadrant->views[viewIndex + 1], sizeof(View) * (size_t)(quadrant->numViews - viewIndex));
+}
+
+// positive when the point lies above the line, towards the steep side, 0 when it lies on it
+static int lineSide(const SightLine *line, int x, int y) {
+    long side = ((long)(line->endY - line->startY) * (line->endX - x)) - ((long)(line->endX - line->startX) * (line->endY - y));
+    return side > 0 ? 1 : side < 0 ? -1 : 0;
+}
+
+static void addSighting(Sightings *sightings, int col, int row) {
+    if (sightings->count == sightings->capacity) {
+        int capacity = sightings->capacity > 0 ? 2 * sightings->capacity : 256;
+        Sighting *cells = (Sighting*) realloc(sightings->cells, sizeof(Sighting) * (size_t)capacity);
+        if (cells == NULL) {
+            sightings->failed = true;
+            return;
+        }
+        sightings->cells = cells;
+        sightings->capacity = capacity;
+    }
+    Sighting sighting = { col, row };
+    sightings->cells[sightings->count++] = sighting;
+}
+
+// clips the sightings to their bounding box and appends them to the row's block as one bitset
+static bool storeSet(RowSets *rowSets, PvsCell *pvsCell, const Sightings *sightings) {
+    int minCol = INT_MAX;
+    int minRow = INT_MAX;
+    int maxCol = INT_MIN;
+    int maxRow = INT_MIN;
+    for (int i = 0; i < sightings->count; i++) {
+        int col = sightings->cells[i].col;
+        int row = sightings->cells[i].row;
+        minCol = col < minCol ? col : minCol;
+        minRow = row < minRow ? row : minRow;
+        maxCol = col > maxCol ? col : maxCol;
+        maxRow = row > maxRow ? row : maxRow;
+    }
+    int width = maxCol - minCol + 1;
+    int height = maxRow - minRow + 1;
+    size_t numBytes = (((size_t)width * height) + 7) / 8;
+    if (rowSets->numBytes + numBytes > rowSets->capacity) {
+        size_t capacity = rowSets->capacity > 0 ? rowSets->capacity : 4096;
+        while (capacity < rowSets->numBytes + numBytes) {
+            capacity *= 2;
+        }
+        unsigned char *bits = (unsigned char*) realloc(rowSets->bits, capacity);
+        if (bits == NULL) {
+            return false;
+        }
+        rowSets->bits = bits;
+        rowSets->capacity = capacity;
+    }
+    unsigned char *set = rowSets->bits + rowSets->numBytes;
+    memset(set, 0, numBytes);
+    for (int i = 0; i < sightings->count; i++) {
+        size_t bit = ((size_t)(sightings->cells[i].row - minRow) * width) + (sightings->cells[i].col - minCol);
+        set[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+    pvsCell->offset = rowSets->numBytes;
+    pvsCell->minCol = minCol;
+    pvsCell->minRow = minRow;
+    pvsCell->numCols = width;
+    pvsCell->numRows = height;
+    rowSets->numBytes += numBytes;
+    return true;
+}
+
+static bool cellSees(const Pvs *pvs, const PvsCell *from, int col, int row) {
+    if (from->numCols == SEES_EVERYTHING) {
+        return true;
+    }
+    int x = col - from->minCol;
+    int y = row - from->minRow;
+    if (x < 0 || x >= from->numCols || y < 0 || y >= from->numRows) {
+        return false;
+    }
+    size_t bit = ((size_t)y * from->numCols) + x;
+    return (pvs->bits[from->offset + bit / 8] >> (bit % 8)) & 1;
+}
+
+static int cellIndexAt(const Pvs *pvs, float x, float y) {
+    int col = (int)floorf(x / TILE_SIZE);
+    int row = (int)floorf(y / TILE_SIZE);
+    if (col < 0 || col >= pvs->numCols || row < 0 || row >= pvs->numRows) {
+        return -1;
+    }
+    return (row * pvs->numCols) + col;
+}
+
+// walls that appear only hide more; anything else that changes what a cell does to sight makes
+// the set miss what can be seen now
+static void checkChange(void *user, int col, int row) {
+    PvsUpdate *update = (PvsUpdate*) user;
+    Pvs *pvs = update->pvs;
+    int cell = (row * pvs->numCols) + col;
+    unsigned char kind = cellKind(update->scene, cell);
+    if (kind != pvs->kinds[cell] && kind != CELL_OPAQUE) {
+        pvs->stale = true;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _PVS_H_
+#define _PVS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "collision.h"
+#include "render.h"
+#include "scheduler.h"
+
+// a potentially visible set: for every cell of a map, the cells that can be seen from somewhere
+// inside it, so things standing in any other cell can be skipped before they are projected.
+// each cell's set is a bitset clipped to the bounding box of what it sees.
+//
+// sets are made for things no taller than a tile, so only walls at least a tile tall hide what
+// lies behind them. see-through walls hide nothing, and neither do doors, as they may open at any
+// time. a cell that sees a portal the scene renders through sees everything.
+typedef struct Pvs Pvs;
+
+// traces what every cell sees from anywhere inside it, on the scheduler's workers or the calling
+// thread when scheduler is NULL. the sets are conservative: a cell is in another's set whenever a
+// straight line joins some point of one to some point of the other without passing through the
+// inside of a wall, lines grazing a wall's corner or edge included, so no camera in the cell can
+// see into a cell left out. returns NULL only when out of memory.
+Pvs *pvsBuild(Scheduler *scheduler, const Scene *scene);
+void pvsDestroy(Pvs *pvs);
+// bytes taken by the sets and the bookkeeping around them
+size_t pvsMemoryUsage(const Pvs *pvs);
+
+// catches up with the changes made to the map since the set was built. walls that appear only
+// hide more, but once a wall the set relies on is gone, or the map is a different one, the set
+// reports everything as visible and this returns false until it is built again. the journal does
+// not cover textures, so the set has to be built again after wall textures were swapped.
+bool pvsUpdate(Pvs *pvs, const Scene *scene);
+
+// whether anything at (toX, toY) may be seen by a camera at (fromX, fromY)
+bool pvsCanSee(const Pvs *pvs, float fromX, float fromY, float toX, float toY);
+// collects the indices of the bodies that may be seen from (x, y), any part of them, and returns
+// how many there are. visible needs room for numBodies indices.
+int pvsCullBodies(const Pvs *pvs, float x, float y, const Body *bodies, int numBodies, int *visible);
+
+#endif
@@ -0,0 +1,126 @@
+#include "query.h"
+#include <math.h>
+#include <stdlib.h>
+#include "utils.h"
+
+// queries per scheduler task, enough to amortize handing out the task
+#define QUERY_CHUNK_SIZE 256
+// eyes and guns are as high as the camera, in tiles
+#define EYE_HEIGHT 0.5f
+
+typedef struct QueryBatch {
+    const Map *map;
+    const void *queries;
+    void *results;
+    int count;
+} QueryBatch;
+
+static void runBatch(Scheduler *scheduler, QueryBatch *batch, TaskFunction task);
+static void sightTask(void *data, int chunk);
+static void hitscanTask(void *data, int chunk);
+static bool lineOfSight(const Map *map, const SightQuery *query);
+static bool blocksSight(const Map *map, int col, int row);
+static void hitscan(const Map *map, const HitscanQuery *query, Ray *hit);
+
+void queryLineOfSight(Scheduler *scheduler, const Map *map, const SightQuery *queries, bool *visible, int count) {
+    QueryBatch batch = { map, queries, visible, count };
+    runBatch(scheduler, &batch, sightTask);
+}
+
+void queryHitscan(Scheduler *scheduler, const Map *map, const HitscanQuery *queries, Ray *hits, int count) {
+    QueryBatch batch = { map, queries, hits, count };
+    runBatch(scheduler, &batch, hitscanTask);
+}
+
+// PRIVATE
+
+static void runBatch(Scheduler *scheduler, QueryBatch *batch, TaskFunction task) {
+    int numChunks = (batch->count + QUERY_CHUNK_SIZE - 1) / QUERY_CHUNK_SIZE;
+    if (scheduler == NULL) {
+        for (int chunk = 0; chunk < numChunks; chunk++) {
+            task(batch, chunk);
+        }
+        return;
+    }
+    schedulerParallelFor(scheduler, numChunks, task, batch);
+}
+
+static void sightTask(void *data, int chunk) {
+    QueryBatch *batch = (QueryBatch*) data;
+    const SightQuery *queries = (const SightQuery*) batch->queries;
+    bool *visible = (bool*) batch->results;
+    int end = (chunk + 1) * QUERY_CHUNK_SIZE < batch->count ? (chunk + 1) * QUERY_CHUNK_SIZE : batch->count;
+    for (int i = chunk * QUERY_CHUNK_SIZE; i < end; i++) {
+        visible[i] = lineOfSight(batch->map, &queries[i]);
+    }
+}
+
+static void hitscanTask(void *data, int chunk) {
+    QueryBatch *batch = (QueryBatch*) data;
+    const HitscanQuery *queries = (const HitscanQuery*) batch->queries;
+    Ray *hits = (Ray*) batch->results;
+    int end = (chunk + 1) * QUERY_CHUNK_SIZE < batch->count ? (chunk + 1) * QUERY_CHUNK_SIZE : batch->count;
+    for (int i = chunk * QUERY_CHUNK_SIZE; i < end; i++) {
+        hitscan(batch->map, &queries[i], &hits[i]);
+    }
+}
+
+// visits exactly the cells the segment passes through, in order, stepping to whichever grid line
+// comes first along it, and stops at the target's cell instead of running on to the next wall
+static bool lineOfSight(const Map *map, const SightQuery *query) {
+    float dx = query->toX - query->fromX;
+    float dy = query->toY - query->fromY;
+    int col = (int)floorf(query->fromX / TILE_SIZE);
+    int row = (int)floorf(query->fromY / TILE_SIZE);
+    int numSteps = abs((int)floorf(query->toX / TILE_SIZE) - col) + abs((int)floorf(query->toY / TILE_SIZE) - row);
+    int colStep = dx > 0 ? 1 : -1;
+    int rowStep = dy > 0 ? 1 : -1;
+
+    // fractions of the segment to the next vertical and horizontal grid line, and between two of them
+    float nextX = dx > 0 ? ((col + 1) * TILE_SIZE - query->fromX) / dx : dx < 0 ? (col * TILE_SIZE - query->fromX) / dx : INFINITY;
+    float nextY = dy > 0 ? ((row + 1) * TILE_SIZE - query->fromY) / dy : dy < 0 ? (row * TILE_SIZE - query->fromY) / dy : INFINITY;
+    float stepX = dx != 0 ? fabsf(TILE_SIZE / dx) : INFINITY;
+    float stepY = dy != 0 ? fabsf(TILE_SIZE / dy) : INFINITY;
+
+    for (int step = 0; step < numSteps; step++) {
+        if (nextX < nextY) {
+            col += colStep;
+            nextX += stepX;
+        } else {
+            row += rowStep;
+            nextY += stepY;
+        }
+        if (blocksSight(map, col, row)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool blocksSight(const Map *map, int col, int row) {
+    float x = (col + 0.5f) * TILE_SIZE;
+    float y = (row + 0.5f) * TILE_SIZE;
+    return (mapHasWallAt(map, x, y) && mapWallHeightAt(map, x, y) > EYE_HEIGHT) || mapPortalAt(map, x, y) >= 0;
+}
+
+// walks the ray past faces too low to stop anything, up to the first one beyond maxDistance
+static void hitscan(const Map *map, const HitscanQuery *query, Ray *hit) {
+    Player origin = { 0 };
+    origin.x = query->x;
+    origin.y = query->y;
+    RayWalk walk;
+    rayWalkBegin(&walk, normalizeAngle(query->angle), &origin, MAX_PORTAL_HOPS);
+    while (rayWalkNext(&walk, map, hit) && hit->distance <= query->maxDistance) {
+        if (hit->wallHitHeight > EYE_HEIGHT) {
+            return;
+        }
+    }
+    float angle = normalizeAngle(query->angle);
+    hit->angle = angle;
+    hit->wallHitX = query->x + cos(angle) * query->maxDistance;
+    hit->wallHitY = query->y + sin(angle) * query->maxDistance;
+    hit->distance = query->maxDistance;
+    hit->wallHitOffset = 0;
+    hit->wallHitHeight = 0;
+    hit->wallHitContent = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef _QUERY_H_
+#define _QUERY_H_
+
+#include <stdbool.h>
+#include "map.h"
+#include "ray.h"
+#include "scheduler.h"
+
+// visibility and hit tests for gameplay code, independent of any camera or render context. a
+// batch is split into chunks that run on the scheduler's workers, or on the calling thread when
+// scheduler is NULL; the map must not change until the call returns.
+//
+// both kinds of query look from half a tile above the floor like the camera, so walls lower than
+// that neither block sight nor stop shots. sight counts a door as closed until it is fully open,
+// shots hit the door's slab wherever it still is.
+
+typedef struct SightQuery {
+    float fromX;
+    float fromY;
+    float toX;
+    float toY;
+} SightQuery;
+
+typedef struct HitscanQuery {
+    float x;
+    float y;
+    float angle;
+    float maxDistance;
+} HitscanQuery;
+
+// visible[i] tells whether the segment of queries[i] crosses no blocking cell. portals block
+// sight, since the two ends of a segment through one are not where they seem.
+void queryLineOfSight(Scheduler *scheduler, const Map *map, const SightQuery *queries, bool *visible, int count);
+
+// hits[i] is the first wall face along queries[i] within maxDistance, passing through up to
+// MAX_PORTAL_HOPS portals. a miss has wallHitContent 0, distance maxDistance and ends maxDistance
+// along the query's angle, ignoring any portals on the way.
+void queryHitscan(Scheduler *scheduler, const Map *map, const HitscanQuery *queries, Ray *hits, int count);
+
+#endif
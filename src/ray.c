@@ -1,135 +1,220 @@
 #include "ray.h"
+#include <limits.h>
+#include <stddef.h>
 #include "map.h"
 #include "utils.h"
 #include "constants.h"
 
-void castRay(Ray *ray, Player *player);
-GridIntersection horizontalGridIntersection(Ray *ray, Player *player);
-GridIntersection verticalGridIntersection(Ray *ray, Player *player);
+// how far inside a portal's target a leg starts, so it never begins on the grid line it leaves through
+#define PORTAL_EXIT_NUDGE (TILE_SIZE / 1024.0f)
+
+void castRay(const Map *map, Ray *ray, Player *player);
+void beginLeg(RayWalk *walk, float originX, float originY, float angle);
+void passPortal(RayWalk *walk, const Map *map, const GridWalk *grid);
+void scanGridWalk(GridWalk *grid, const Map *map, const RayWalk *walk);
+bool doorIntersection(const MapDoor *door, const RayWalk *walk, float xToCheck, float yToCheck, GridIntersection *intersection);
 bool isRayFacingDown(float angle);
 bool isRayFacingUp(float angle);
 bool isRayFacingRight(float angle);
 bool isRayFacingLeft(float angle);
 
-void renderRays(SDL_Renderer *renderer, Ray *rays, Player *player) {
-    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-    for (int i = 0; i < NUM_RAYS; i++) {
-        SDL_RenderDrawLine(
-            renderer,
-            MINIMAP_SCALE_FACTOR * player->x,
-            MINIMAP_SCALE_FACTOR * player->y,
-            MINIMAP_SCALE_FACTOR * (rays + i)->wallHitX,
-            MINIMAP_SCALE_FACTOR * (rays + i)->wallHitY
-        );
-    }
-}
-
-void castAllRays(Ray *rays, Player *player) {
+void castAllRays(const Map *map, Ray *rays, int numRays, Player *player) {
     float rayAngle = player->rotationAngle - (FOV_ANGLE / 2);
-    for (int i = 0; i < NUM_RAYS; i++) {
+    for (int i = 0; i < numRays; i++) {
         Ray *ray = (rays + i);;
         ray->angle = normalizeAngle(rayAngle);
-        castRay(ray, player);
-        rayAngle += FOV_ANGLE / NUM_RAYS;
+        castRay(map, ray, player);
+        rayAngle += FOV_ANGLE / numRays;
     }
 }
 
-// PRIVATE
-
-void castRay(Ray *ray, Player *player) {
-    GridIntersection horizontalIntersection = horizontalGridIntersection(ray, player);
-    GridIntersection verticalIntersection = verticalGridIntersection(ray, player);
+void rayWalkBegin(RayWalk *walk, float angle, Player *player, int maxPortalHops) {
+    walk->rayAngle = angle;
+    walk->originDistance = 0;
+    walk->portalHopsLeft = maxPortalHops;
+    beginLeg(walk, player->x, player->y, angle);
+}
 
-    float horizontalHitDistance = calculateHitDistance(player, &horizontalIntersection);
-    float verticalHitDistance = calculateHitDistance(player, &verticalIntersection);
+bool rayWalkNext(RayWalk *walk, const Map *map, Ray *hit) {
+    GridWalk *nearest;
+    for (;;) {
+        if (!walk->horizontal.scanned) {
+            scanGridWalk(&walk->horizontal, map, walk);
+        }
+        if (!walk->vertical.scanned) {
+            scanGridWalk(&walk->vertical, map, walk);
+        }
+        nearest = walk->vertical.hitDistance < walk->horizontal.hitDistance ? &walk->vertical : &walk->horizontal;
+        if (!nearest->hit.foundWallHit || nearest->portalCell < 0 || walk->portalHopsLeft <= 0) {
+            break;
+        }
+        passPortal(walk, map, nearest);
+    }
 
-    if (verticalHitDistance < horizontalHitDistance) {
-        ray->distance = verticalHitDistance;
-        ray->wallHitX = verticalIntersection.wallHitX;
-        ray->wallHitY = verticalIntersection.wallHitY;
-        ray->wallHitContent = verticalIntersection.content;
-        ray->wasHitVertical = true;
-    } else {
-        ray->distance = horizontalHitDistance;
-        ray->wallHitX = horizontalIntersection.wallHitX;
-        ray->wallHitY = horizontalIntersection.wallHitY;
-        ray->wallHitContent = horizontalIntersection.content;
-        ray->wasHitVertical = false;
+    hit->angle = walk->rayAngle;
+    hit->distance = nearest->hitDistance;
+    hit->wallHitX = nearest->hit.wallHitX;
+    hit->wallHitY = nearest->hit.wallHitY;
+    hit->wallHitOffset = nearest->hit.wallHitOffset;
+    hit->wallHitHeight = nearest->hit.wallHeight;
+    hit->wallHitContent = nearest->hit.content;
+    hit->wasHitVertical = nearest->hit.wasHitVertical;
+    if (!nearest->hit.foundWallHit) {
+        return false;
     }
+    nearest->scanned = false;
+    return true;
 }
 
-GridIntersection horizontalGridIntersection(Ray *ray, Player *player) {
-    GridIntersection intersection = { 0 , 0 };
-
-    float yIntercept = floor(player->y / TILE_SIZE) * TILE_SIZE;
-    yIntercept += isRayFacingDown(ray->angle) ? TILE_SIZE : 0;
-
-    float xIntercept = player->x + (yIntercept - player->y) / tan(ray->angle);
-
-    float yStep = TILE_SIZE;
-    yStep *= isRayFacingUp(ray->angle) ? -1 : 1;
+// PRIVATE
 
-    float xStep = TILE_SIZE / tan(ray->angle);
-    xStep *= (isRayFacingLeft(ray->angle) && xStep > 0) ? -1 : 1;
-    xStep *= (isRayFacingRight(ray->angle) && xStep < 0) ? -1 : 1;
+void castRay(const Map *map, Ray *ray, Player *player) {
+    RayWalk walk;
+    rayWalkBegin(&walk, ray->angle, player, MAX_PORTAL_HOPS);
+    rayWalkNext(&walk, map, ray);
+}
 
-    float nextTouchX = xIntercept;
-    float nextTouchY = yIntercept;
+// sets up both sets of grid lines for a straight leg from (originX, originY)
+void beginLeg(RayWalk *walk, float originX, float originY, float angle) {
+    walk->angle = angle;
+    walk->originX = originX;
+    walk->originY = originY;
+
+    // crossings of the horizontal grid lines
+    GridWalk *horizontal = &walk->horizontal;
+    float yIntercept = floor(originY / TILE_SIZE) * TILE_SIZE;
+    yIntercept += isRayFacingDown(angle) ? TILE_SIZE : 0;
+
+    float xIntercept = originX + (yIntercept - originY) / tan(angle);
+
+    horizontal->yStep = TILE_SIZE;
+    horizontal->yStep *= isRayFacingUp(angle) ? -1 : 1;
+
+    horizontal->xStep = TILE_SIZE / tan(angle);
+    horizontal->xStep *= (isRayFacingLeft(angle) && horizontal->xStep > 0) ? -1 : 1;
+    horizontal->xStep *= (isRayFacingRight(angle) && horizontal->xStep < 0) ? -1 : 1;
+
+    horizontal->nextTouchX = xIntercept;
+    horizontal->nextTouchY = yIntercept;
+    horizontal->checkOffsetX = 0;
+    horizontal->checkOffsetY = isRayFacingUp(angle) ? -1 : 0;
+    horizontal->vertical = false;
+    horizontal->scanned = false;
+
+    // crossings of the vertical grid lines
+    GridWalk *vertical = &walk->vertical;
+    xIntercept = floor(originX / TILE_SIZE) * TILE_SIZE;
+    xIntercept += isRayFacingRight(angle) ? TILE_SIZE : 0;
+
+    yIntercept = originY + (xIntercept - originX) * tan(angle);
+
+    vertical->xStep = TILE_SIZE;
+    vertical->xStep *= isRayFacingLeft(angle) ? -1 : 1;
+
+    vertical->yStep = TILE_SIZE * tan(angle);
+    vertical->yStep *= (isRayFacingUp(angle) && vertical->yStep > 0) ? -1 : 1;
+    vertical->yStep *= (isRayFacingDown(angle) && vertical->yStep < 0) ? -1 : 1;
+
+    vertical->nextTouchX = xIntercept;
+    vertical->nextTouchY = yIntercept;
+    vertical->checkOffsetX = isRayFacingLeft(angle) ? -1 : 0;
+    vertical->checkOffsetY = 0;
+    vertical->vertical = true;
+    vertical->scanned = false;
+}
 
-    // Increment xStep and yStep until we find a wall
-    while (inScreenBounds(nextTouchX, nextTouchY)) {
-        float xToCheck = nextTouchX;
-        float yToCheck = nextTouchY + (isRayFacingUp(ray->angle) ? -1 : 0);
+// the grid's next face belongs to a portal: the path goes on beyond the portal's target, where
+// whatever the other set of lines had found so far no longer matters
+void passPortal(RayWalk *walk, const Map *map, const GridWalk *grid) {
+    float exitX = grid->hit.wallHitX;
+    float exitY = grid->hit.wallHitY;
+    int normalX = grid->vertical ? (grid->xStep > 0 ? 1 : -1) : 0;
+    int normalY = grid->vertical ? 0 : (grid->yStep > 0 ? 1 : -1);
+    float turn = mapCrossPortal(map, grid->portalCell, &exitX, &exitY, &normalX, &normalY);
+
+    walk->originDistance = grid->hitDistance;
+    walk->portalHopsLeft--;
+    beginLeg(walk, exitX - normalX * PORTAL_EXIT_NUDGE, exitY - normalY * PORTAL_EXIT_NUDGE, normalizeAngle(walk->angle + turn));
+}
 
-        if (mapHasWallAt(xToCheck, yToCheck)) {
-            // found a wall hit
-            intersection.wallHitX = nextTouchX;
-            intersection.wallHitY = nextTouchY;
-            intersection.content = mapContentAt(xToCheck, yToCheck);
+// steps along one set of grid lines until the ray enters a wall, and leaves the grid past that face
+void scanGridWalk(GridWalk *grid, const Map *map, const RayWalk *walk) {
+    GridIntersection intersection = { 0 , 0 };
+    int portalCell = -1;
+
+    while (inMapBounds(map, grid->nextTouchX, grid->nextTouchY)) {
+        float touchX = grid->nextTouchX;
+        float touchY = grid->nextTouchY;
+        float xToCheck = touchX + grid->checkOffsetX;
+        float yToCheck = touchY + grid->checkOffsetY;
+        grid->nextTouchX += grid->xStep;
+        grid->nextTouchY += grid->yStep;
+
+        int content = mapContentAt(map, xToCheck, yToCheck);
+        if (content == 0) {
+            continue;
+        }
+        // found a wall hit, unless it is a door the ray passes through
+        const MapDoor *door = mapDoorAt(map, xToCheck, yToCheck);
+        if (door == NULL) {
+            float touchAlongWall = grid->vertical ? touchY : touchX;
+            intersection.wallHitX = touchX;
+            intersection.wallHitY = touchY;
+            intersection.wallHitOffset = touchAlongWall - floor(touchAlongWall / TILE_SIZE) * TILE_SIZE;
+            intersection.wasHitVertical = grid->vertical;
             intersection.foundWallHit = true;
+        }
+        if (door == NULL || doorIntersection(door, walk, xToCheck, yToCheck, &intersection)) {
+            intersection.content = content;
+            intersection.wallHeight = mapWallHeightAt(map, xToCheck, yToCheck);
+            portalCell = mapPortalAt(map, xToCheck, yToCheck);
             break;
-        } else {
-            nextTouchX += xStep;
-            nextTouchY += yStep;
         }
     }
-    return intersection;
+    grid->hit = intersection;
+    grid->hitDistance = intersection.foundWallHit
+        ? walk->originDistance + distanceBetweenPoints(walk->originX, walk->originY, intersection.wallHitX, intersection.wallHitY)
+        : INT_MAX;
+    grid->portalCell = portalCell;
+    grid->scanned = true;
 }
 
-GridIntersection verticalGridIntersection(Ray *ray, Player *player) {
-    GridIntersection intersection = { 0 , 0 };
-
-    float xIntercept = floor(player->x / TILE_SIZE) * TILE_SIZE;
-    xIntercept += isRayFacingRight(ray->angle) ? TILE_SIZE : 0;
-
-    float yIntercept = player->y + (xIntercept - player->x) * tan(ray->angle);
-
-    float xStep = TILE_SIZE;
-    xStep *= isRayFacingLeft(ray->angle) ? -1 : 1;
-
-    float yStep = TILE_SIZE * tan(ray->angle);
-    yStep *= (isRayFacingUp(ray->angle) && yStep > 0) ? -1 : 1;
-    yStep *= (isRayFacingDown(ray->angle) && yStep < 0) ? -1 : 1;
-
-    float nextTouchX = xIntercept;
-    float nextTouchY = yIntercept;
-
-    while (inScreenBounds(nextTouchX, nextTouchY)) {
-        float xToCheck = nextTouchX + (isRayFacingLeft(ray->angle) ? -1 : 0);
-        float yToCheck = nextTouchY;
-
-        if (mapHasWallAt(xToCheck, yToCheck)) {
-            intersection.wallHitX = nextTouchX;
-            intersection.wallHitY = nextTouchY;
-            intersection.content = mapContentAt(xToCheck, yToCheck);
-            intersection.foundWallHit = true;
-            break;
-        } else {
-            nextTouchX += xStep;
-            nextTouchY += yStep;
+// the ray entered a door cell at (xToCheck, yToCheck). it hits the door where it crosses the slab
+// through the middle of the cell, unless that point lies in the part the door has slid away from.
+bool doorIntersection(const MapDoor *door, const RayWalk *walk, float xToCheck, float yToCheck, GridIntersection *intersection) {
+    float cellX = floor(xToCheck / TILE_SIZE) * TILE_SIZE;
+    float cellY = floor(yToCheck / TILE_SIZE) * TILE_SIZE;
+    float rayCos = cos(walk->angle);
+    float raySin = sin(walk->angle);
+
+    float hitX, hitY, distanceAlongDoor;
+    if (door->orientation == DOOR_ALONG_Y) {
+        hitX = cellX + TILE_SIZE / 2;
+        if (fabs(rayCos) < 1e-6 || (hitX - walk->originX) / rayCos < 0) {
+            return false;
         }
+        hitY = walk->originY + (hitX - walk->originX) / rayCos * raySin;
+        distanceAlongDoor = hitY - cellY;
+    } else {
+        hitY = cellY + TILE_SIZE / 2;
+        if (fabs(raySin) < 1e-6 || (hitY - walk->originY) / raySin < 0) {
+            return false;
+        }
+        hitX = walk->originX + (hitY - walk->originY) / raySin * rayCos;
+        distanceAlongDoor = hitX - cellX;
     }
-    return intersection;
+    float doorEdge = door->openAmount * TILE_SIZE;
+    if (distanceAlongDoor < doorEdge || distanceAlongDoor >= TILE_SIZE) {
+        return false;
+    }
+
+    // the texture slides along with the door
+    intersection->wallHitX = hitX;
+    intersection->wallHitY = hitY;
+    intersection->wallHitOffset = distanceAlongDoor - doorEdge;
+    intersection->wasHitVertical = door->orientation == DOOR_ALONG_Y;
+    intersection->foundWallHit = true;
+    return true;
 }
 
 bool isRayFacingDown(float angle) {
@@ -3,17 +3,58 @@
 
 #include <stdbool.h>
 #include "player.h"
+#include "map.h"
 
 typedef struct Ray {
     float angle;
     float wallHitX;
     float wallHitY;
     float distance;
+    float wallHitOffset; // position along the wall face, 0 to TILE_SIZE, where its texture is sampled
+    float wallHitHeight; // height of the wall that was hit, in tiles
     bool wasHitVertical;
     int wallHitContent;
 } Ray;
 
-void renderRays(SDL_Renderer *renderer, Ray *rays, Player *player);
-void castAllRays(Ray *rays, Player *player);
+// the crossings of a ray with either the horizontal or the vertical grid lines
+typedef struct GridWalk {
+    float nextTouchX;
+    float nextTouchY;
+    float xStep;
+    float yStep;
+    float checkOffsetX;     // nudges a crossing into the cell beyond the line
+    float checkOffsetY;
+    bool vertical;
+    bool scanned;           // hit is the next face on these lines and has not been reported yet
+    GridIntersection hit;
+    float hitDistance;
+    int portalCell;         // the hit is a face of this portal cell, -1 for anything else
+} GridWalk;
+
+// walks a ray through the grid and reports the wall faces it enters, nearest first, so a
+// renderer can look past walls lower than the ones behind them. each set of grid lines is
+// only scanned ahead when its next face is asked for, so stopping after the first face costs
+// the same as casting a single hit.
+//
+// a ray entering a portal goes on from its target as a new leg of the walk, until it has passed
+// through maxPortalHops portals; the next portal it enters is reported as a wall. distances are
+// measured along the whole path and hits keep the angle the walk started with, so they project
+// the same as walls seen directly.
+typedef struct RayWalk {
+    float rayAngle;
+    float angle;            // direction of the current leg
+    float originX;          // start of the current leg, the camera or a portal exit
+    float originY;
+    float originDistance;   // length of the path before the current leg
+    int portalHopsLeft;
+    GridWalk horizontal;
+    GridWalk vertical;
+} RayWalk;
+
+// rays cast on their own pass through at most MAX_PORTAL_HOPS portals
+void castAllRays(const Map *map, Ray *rays, int numRays, Player *player);
+void rayWalkBegin(RayWalk *walk, float angle, Player *player, int maxPortalHops);
+// fills in the next face; returns false, with hit describing a miss, once the ray leaves the map
+bool rayWalkNext(RayWalk *walk, const Map *map, Ray *hit);
 
 #endif
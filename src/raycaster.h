@@ -0,0 +1,45 @@
+#ifndef _RAYCASTER_H_
+#define _RAYCASTER_H_
+
+// public interface of libraycaster: map loading, ray casting and rendering into
+// caller-owned 32-bit color buffers, without any windowing or SDL dependency.
+// the major version changes whenever a declaration below changes incompatibly.
+#define RAYCASTER_VERSION_MAJOR 11
+#define RAYCASTER_VERSION_MINOR 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arena.h"
+#include "capture.h"
+#include "collision.h"
+#include "constants.h"
+#include "delta.h"
+#include "flowfield.h"
+#include "lightbaker.h"
+#include "lightmap.h"
+#include "lights.h"
+#include "loader.h"
+#include "map.h"
+#include "pipeline.h"
+#include "player.h"
+#include "pngwrite.h"
+#include "pvs.h"
+#include "query.h"
+#include "ray.h"
+#include "reload.h"
+#include "render.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "stream.h"
+#include "texture.h"
+#include "upng.h"
+#include "watcher.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "reload.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "watcher.h"
+
+#define MAX_CHANGES_PER_POLL 64
+
+// a map replaced by a reload, kept alive until no frame uses it
+typedef struct RetiredMap {
+    Map *map;
+    unsigned long lastUsingFrame;
+    struct RetiredMap *next;
+} RetiredMap;
+
+struct AssetReloader {
+    FileWatcher *watcher;
+    TextureLoader *textures;
+    int *textureIds;    // watcher id of every texture path
+    int numTextures;
+    int mapId;
+    const char *mapPath;
+    FrameStats *stats;
+    RetiredMap *retired;
+
+    // map parsing on the background thread, guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t requestsChanged;
+    bool mapRequested;
+    double mapRequestTime;
+    Map *loadedMap;
+    bool shuttingDown;
+    pthread_t thread;
+    bool threadStarted;
+};
+
+static void *mapThreadMain(void *argument);
+static void freeRetiredMaps(AssetReloader *reloader, unsigned long framesPresented);
+
+AssetReloader *assetReloaderCreate(TextureLoader *textures, const char *const *texturePaths, int numTextures,
+    const char *mapPath, FrameStats *stats) {
+    FileWatcher *watcher = fileWatcherCreate();
+    if (watcher == NULL) {
+        return NULL;
+    }
+    AssetReloader *reloader = (AssetReloader*) calloc(1, sizeof(AssetReloader));
+    int *textureIds = (int*) malloc(sizeof(int) * (numTextures > 0 ? numTextures : 1));
+    if (reloader == NULL || textureIds == NULL) {
+        free(reloader);
+        free(textureIds);
+        fileWatcherDestroy(watcher);
+        return NULL;
+    }
+    pthread_mutex_init(&reloader->lock, NULL);
+    pthread_cond_init(&reloader->requestsChanged, NULL);
+    reloader->watcher = watcher;
+    reloader->textures = textures;
+    reloader->textureIds = textureIds;
+    reloader->numTextures = numTextures;
+    reloader->mapPath = mapPath;
+    reloader->stats = stats;
+
+    for (int i = 0; i < numTextures; i++) {
+        textureIds[i] = fileWatcherAdd(watcher, texturePaths[i]);
+    }
+    reloader->mapId = -1;
+    if (mapPath != NULL) {
+        reloader->mapId = fileWatcherAdd(watcher, mapPath);
+        reloader->threadStarted = pthread_create(&reloader->thread, NULL, mapThreadMain, reloader) == 0;
+    }
+    return reloader;
+}
+
+void assetReloaderDestroy(AssetReloader *reloader) {
+    if (reloader == NULL) {
+        return;
+    }
+    if (reloader->threadStarted) {
+        pthread_mutex_lock(&reloader->lock);
+        reloader->shuttingDown = true;
+        pthread_cond_signal(&reloader->requestsChanged);
+        pthread_mutex_unlock(&reloader->lock);
+        pthread_join(reloader->thread, NULL);
+    }
+    mapDestroy(reloader->loadedMap);
+    freeRetiredMaps(reloader, (unsigned long)-1);
+    fileWatcherDestroy(reloader->watcher);
+    free(reloader->textureIds);
+    pthread_cond_destroy(&reloader->requestsChanged);
+    pthread_mutex_destroy(&reloader->lock);
+    free(reloader);
+}
+
+Map *assetReloaderPoll(AssetReloader *reloader, Map *currentMap,
+    unsigned long framesSubmitted, unsigned long framesPresented) {
+    freeRetiredMaps(reloader, framesPresented);
+
+    int changed[MAX_CHANGES_PER_POLL];
+    int numChanged = fileWatcherPoll(reloader->watcher, changed, MAX_CHANGES_PER_POLL);
+    for (int i = 0; i < numChanged; i++) {
+        if (changed[i] == reloader->mapId && reloader->threadStarted) {
+            pthread_mutex_lock(&reloader->lock);
+            reloader->mapRequested = true;
+            reloader->mapRequestTime = statsNow();
+            pthread_cond_signal(&reloader->requestsChanged);
+            pthread_mutex_unlock(&reloader->lock);
+        }
+        for (int j = 0; j < reloader->numTextures; j++) {
+            if (changed[i] == reloader->textureIds[j]) {
+                textureLoaderReload(reloader->textures, j);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&reloader->lock);
+    Map *loadedMap = reloader->loadedMap;
+    double requestTime = reloader->mapRequestTime;
+    reloader->loadedMap = NULL;
+    pthread_mutex_unlock(&reloader->lock);
+    if (loadedMap == NULL) {
+        return NULL;
+    }
+
+    RetiredMap *retired = (RetiredMap*) malloc(sizeof(RetiredMap));
+    if (retired == NULL) {
+        // nowhere to park the old map, so keep using it rather than free one in use
+        mapDestroy(loadedMap);
+        return NULL;
+    }
+    retired->map = currentMap;
+    retired->lastUsingFrame = framesSubmitted;
+    retired->next = reloader->retired;
+    reloader->retired = retired;
+    statsRecord(reloader->stats, STAT_RELOAD, statsNow() - requestTime);
+    return loadedMap;
+}
+
+// PRIVATE
+
+static void *mapThreadMain(void *argument) {
+    AssetReloader *reloader = (AssetReloader*) argument;
+    pthread_mutex_lock(&reloader->lock);
+    while (!reloader->shuttingDown) {
+        if (!reloader->mapRequested) {
+            pthread_cond_wait(&reloader->requestsChanged, &reloader->lock);
+            continue;
+        }
+        reloader->mapRequested = false;
+        pthread_mutex_unlock(&reloader->lock);
+
+        // a file caught halfway through being written fails to parse; the next write reloads it again
+        Map *map = mapLoadFromFile(reloader->mapPath);
+        if (map == NULL) {
+            fprintf(stderr, "Error reloading the map %s.\n", reloader->mapPath);
+        }
+
+        pthread_mutex_lock(&reloader->lock);
+        if (map != NULL) {
+            mapDestroy(reloader->loadedMap);
+            reloader->loadedMap = map;
+        }
+    }
+    pthread_mutex_unlock(&reloader->lock);
+    return NULL;
+}
+
+// frees the maps whose last user, the frame submitted right before the swap, has been presented
+static void freeRetiredMaps(AssetReloader *reloader, unsigned long framesPresented) {
+    RetiredMap **link = &reloader->retired;
+    while (*link != NULL) {
+        RetiredMap *retired = *link;
+        if (framesPresented >= retired->lastUsingFrame) {
+            *link = retired->next;
+            mapDestroy(retired->map);
+            free(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef _RELOAD_H_
+#define _RELOAD_H_
+
+#include "loader.h"
+#include "map.h"
+#include "stats.h"
+
+// hot reload of the wall textures and the map file while the game runs.
+// changed files are noticed through a FileWatcher; textures are decoded again
+// by the TextureLoader and maps are parsed on a background thread of their
+// own, so the render loop only ever swaps finished assets in between frames.
+typedef struct AssetReloader AssetReloader;
+
+// mapPath may be NULL when the map is built in. returns NULL when file change
+// notifications are not available, in which case there is nothing to poll
+AssetReloader *assetReloaderCreate(TextureLoader *textures, const char *const *texturePaths, int numTextures,
+    const char *mapPath, FrameStats *stats);
+void assetReloaderDestroy(AssetReloader *reloader);
+
+// call once per frame. queues reloads of changed files and returns a freshly
+// loaded map to use from now on, or NULL if the map did not change. the map
+// it replaces is taken over and freed once every frame submitted before the
+// swap has been presented.
+Map *assetReloaderPoll(AssetReloader *reloader, Map *currentMap,
+    unsigned long framesSubmitted, unsigned long framesPresented);
+
+#endif
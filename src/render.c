@@ -0,0 +1,657 @@
+#include "render.h"
+#include <math.h>
+#include <stdlib.h>
+#include "constants.h"
+#include "utils.h"
+
+// lit floors look their light up every this many rows and blend it in between
+#define FLOOR_LIGHT_SPAN 16
+// unlit walls fill runs of a texel once it covers this many pixels; below that a divide per
+// texel costs more than it saves
+#define WALL_RUN_PIXELS 8
+// a column is reprojected from the frame before only where that frame saw the same face at
+// this share of the distance, plus a unit; anything else was hidden then, or is gone now
+#define REPROJECT_TOLERANCE 0.03f
+
+typedef struct ViewportBatch {
+    RenderContext *contexts;
+    const Scene *scene;
+} ViewportBatch;
+
+// a see-through wall found while filling a column, blended in once everything behind it is drawn
+typedef struct ColumnHit {
+    Ray hit;
+    int visibleTop;
+    int visibleBottom;
+    int wallTop;
+    int wallHeight;
+} ColumnHit;
+
+// what an interleaved frame rebuilds its other columns from
+typedef struct FrameBefore {
+    const uint32_t *colorBuffer;
+    const Ray *rays;
+    Player camera;
+    int parity;     // of the columns it cast
+} FrameBefore;
+
+// where a column that was not cast this frame takes its pixels from
+typedef struct ColumnSource {
+    int column;     // of the frame before, -1 to blend the neighbouring columns instead
+    int row;        // the frame before's row for row 0, in 1/65536ths
+    int rowStep;    // per row down, in 1/65536ths; a whole row unless the camera came nearer or went away
+} ColumnSource;
+
+// walks a wall column's texture down the screen in 1/65536ths of a texel. power-of-two heights
+// wrap by masking the texel row; other heights keep the position inside one repeat of the texture.
+typedef struct WallTexels {
+    const uint32_t *column;
+    uint32_t position;
+    uint32_t step;      // per pixel; below one texel while the wall is magnified
+    uint32_t mask;      // height - 1 for power-of-two heights, otherwise 0
+    uint32_t wrap;      // height in 1/65536ths, for the other heights
+} WallTexels;
+
+// a column's ray as far as finding the floor it shows goes
+typedef struct FloorRay {
+    float reach;        // the floor on row y lies reach / (y - horizon) along the ray
+    int horizon;
+    float cameraX;
+    float cameraY;
+    float rayCos;
+    float raySin;
+    float legX;         // start of the walk's current leg
+    float legY;
+    float legDistance;  // along the ray, where the leg starts
+    float legCos;
+    float legSin;
+} FloorRay;
+
+void generate3DProjection(RenderContext *context, const Scene *scene);
+bool beginInterleavedFrame(RenderContext *context, FrameBefore *before);
+void reconstructColumns(RenderContext *context, const FrameBefore *before, int parity, ColumnSource *sources);
+void findColumnSource(RenderContext *context, const FrameBefore *before, int column, ColumnSource *source);
+bool reprojectFace(RenderContext *context, const FrameBefore *before, int column, const Ray *face, ColumnSource *source);
+bool isStraight(const Ray *ray, const Player *camera);
+uint32_t averageColor(uint32_t a, uint32_t b);
+void renderColumn(RenderContext *context, const Scene *scene, int rayIndex, float projectionPlaneDistance, ColumnHit *seeThrough, int maxSeeThrough);
+void renderCeiling(RenderContext *context, int wallTop, int rayIndex);
+const Texture *wallTextureOf(const Scene *scene, const Ray *hit);
+void renderWall(RenderContext *context, const Scene *scene, const Ray *hit, int wallTop, int wallBottom, int textureTop, int wallHeight, int rayIndex);
+void blendWall(RenderContext *context, const Scene *scene, const Ray *hit, int wallTop, int wallBottom, int textureTop, int wallHeight, int rayIndex);
+void beginWallTexels(WallTexels *texels, const Texture *wallTexture, const Ray *hit, int wallTop, int textureTop, int wallHeight);
+uint32_t nextWallTexel(WallTexels *texels);
+void copyWallMasked(WallTexels *texels, uint32_t *pixel, int stride, int count);
+void copyWallWrapped(WallTexels *texels, uint32_t *pixel, int stride, int count);
+void fillWallRuns(WallTexels *texels, uint32_t *pixel, int stride, int count);
+bool isLit(const Scene *scene);
+int beginWallLight(const Scene *scene, const Ray *hit, int wallTop, int textureTop, int wallHeight, int *scales);
+int wallLightAt(const int *scales, int position);
+uint32_t blendTexel(uint32_t texel, uint32_t background);
+uint32_t shadeTexel(uint32_t texel, int scale);
+void renderFloor(RenderContext *context, const Scene *scene, const RayWalk *walk, float projectionPlaneDistance, int floorTop, int floorBottom, int rayIndex);
+int floorLightAt(const Scene *scene, const FloorRay *floorRay, int y);
+int floorLightOf(const Scene *scene, float x, float y);
+void renderViewportTask(void *data, int index);
+
+bool renderContextInit(RenderContext *context, int width, int height) {
+    context->width = width;
+    context->height = height;
+    // one ray per screen column
+    context->rays = (Ray*) malloc(sizeof(Ray) * (uint32_t)width);
+    context->colorBuffer = (uint32_t*) malloc(sizeof(uint32_t) * (uint32_t)width * (uint32_t)height);
+    // room for a full list of see-through hits in every column, and where interleaved columns come from
+    context->frameArena = arenaCreate((sizeof(ColumnHit) * MAX_COLUMN_HITS + sizeof(ColumnSource)) * (uint32_t)width);
+    context->frameBefore = NULL;
+    context->spareColorBuffer = NULL;
+    context->spareRays = NULL;
+    context->castParity = -1;
+    if (context->rays == NULL || context->colorBuffer == NULL || context->frameArena == NULL) {
+        renderContextDestroy(context);
+        return false;
+    }
+    return true;
+}
+
+void renderContextDestroy(RenderContext *context) {
+    free(context->rays);
+    free(context->colorBuffer);
+    free(context->spareRays);
+    free(context->spareColorBuffer);
+    arenaDestroy(context->frameArena);
+    context->rays = NULL;
+    context->colorBuffer = NULL;
+    context->spareRays = NULL;
+    context->spareColorBuffer = NULL;
+    context->castParity = -1;
+    context->frameArena = NULL;
+}
+
+void clearColorBuffer(RenderContext *context, uint32_t color) {
+    for (int x = 0; x < context->width; x++) {
+        for (int y = 0; y < context->height; y++) {
+            context->colorBuffer[(context->width * y) + x] = color;
+        }
+    }
+}
+
+void renderView(RenderContext *context, const Scene *scene) {
+    arenaReset(context->frameArena);
+    generate3DProjection(context, scene);
+}
+
+void renderViewports(Scheduler *scheduler, RenderContext *contexts, int numContexts, const Scene *scene) {
+    ViewportBatch batch = { contexts, scene };
+    schedulerParallelFor(scheduler, numContexts, renderViewportTask, &batch);
+}
+
+// PRIVATE
+
+void renderViewportTask(void *data, int index) {
+    ViewportBatch *batch = (ViewportBatch*) data;
+    renderView(&batch->contexts[index], batch->scene);
+}
+
+// casts one ray per column while drawing it, since walls lower than the camera let the ray go on.
+// interleaved frames cast only the columns of one parity, and rebuild the others afterwards.
+void generate3DProjection(RenderContext *context, const Scene *scene) {
+    float projectionPlaneDistance = (context->width / 2) / tan(FOV_ANGLE / 2);
+    float rayAngle = context->camera.rotationAngle - (FOV_ANGLE / 2);
+    // without the hit lists every wall is drawn opaque
+    ColumnHit *hitLists = (ColumnHit*) arenaAlloc(context->frameArena, sizeof(ColumnHit) * MAX_COLUMN_HITS * (uint32_t)context->width);
+    int maxSeeThrough = hitLists != NULL ? MAX_COLUMN_HITS : 0;
+
+    // every column is cast while there is no frame before to rebuild from
+    int parity = -1;
+    ColumnSource *sources = NULL;
+    FrameBefore before;
+    if (scene->interleaved && beginInterleavedFrame(context, &before)) {
+        sources = (ColumnSource*) arenaAlloc(context->frameArena, sizeof(ColumnSource) * (uint32_t)context->width);
+        parity = sources != NULL ? 1 - before.parity : -1;
+    }
+
+    for (int i = 0; i < context->width; i++) {
+        context->rays[i].angle = normalizeAngle(rayAngle);
+        if (parity < 0 || i % 2 == parity) {
+            ColumnHit *seeThrough = hitLists != NULL ? &hitLists[i * MAX_COLUMN_HITS] : NULL;
+            renderColumn(context, scene, i, projectionPlaneDistance, seeThrough, maxSeeThrough);
+        }
+        rayAngle += FOV_ANGLE / context->width;
+    }
+    if (parity >= 0) {
+        reconstructColumns(context, &before, parity, sources);
+    }
+    // a frame with every column cast serves the next as well as either parity would
+    context->castCamera = context->camera;
+    context->castParity = !scene->interleaved ? -1 : parity >= 0 ? parity : 0;
+}
+
+// finds the frame before: the latest frame of frameBefore, or else the context's own finished
+// frame, whose buffers are swapped for the spare ones to draw into. returns whether there is an
+// interleaved frame before to rebuild from; without memory for one every column is cast, as it
+// is when the frame is too narrow for a column to have a neighbour to be rebuilt from.
+bool beginInterleavedFrame(RenderContext *context, FrameBefore *before) {
+    if (context->width < 2) {
+        return false;
+    }
+    const RenderContext *source = context->frameBefore;
+    if (source == NULL) {
+        if (context->spareColorBuffer == NULL) {
+            context->spareColorBuffer = (uint32_t*) malloc(sizeof(uint32_t) * (uint32_t)context->width * (uint32_t)context->height);
+            context->spareRays = (Ray*) malloc(sizeof(Ray) * (uint32_t)context->width);
+            if (context->spareColorBuffer == NULL || context->spareRays == NULL) {
+                free(context->spareColorBuffer);
+                free(context->spareRays);
+                context->spareColorBuffer = NULL;
+                context->spareRays = NULL;
+            }
+        }
+        if (context->spareColorBuffer == NULL) {
+            return false;
+        }
+        uint32_t *colorBuffer = context->spareColorBuffer;
+        context->spareColorBuffer = context->colorBuffer;
+        context->colorBuffer = colorBuffer;
+        Ray *rays = context->spareRays;
+        context->spareRays = context->rays;
+        context->rays = rays;
+        before->colorBuffer = context->spareColorBuffer;
+        before->rays = context->spareRays;
+        source = context;
+    } else {
+        before->colorBuffer = source->colorBuffer;
+        before->rays = source->rays;
+    }
+    before->camera = source->castCamera;
+    before->parity = source->castParity;
+    return before->parity >= 0;
+}
+
+// fills the columns that were not cast from the frame before, or from their neighbours where it
+// did not see them. row by row, as the columns of one row share cache lines, where going column
+// by column would cost as much as casting them.
+void reconstructColumns(RenderContext *context, const FrameBefore *before, int parity, ColumnSource *sources) {
+    int width = context->width;
+    for (int x = 1 - parity; x < width; x += 2) {
+        findColumnSource(context, before, x, &sources[x]);
+    }
+    for (int y = 0; y < context->height; y++) {
+        uint32_t *row = &context->colorBuffer[width * y];
+        for (int x = 1 - parity; x < width; x += 2) {
+            const ColumnSource *source = &sources[x];
+            if (source->column < 0) {
+                row[x] = averageColor(row[x > 0 ? x - 1 : x + 1], row[x + 1 < width ? x + 1 : x - 1]);
+                continue;
+            }
+            int position = source->row + source->rowStep * y;
+            int sourceRow = position < 0 ? 0 : position >> 16;
+            sourceRow = sourceRow < context->height ? sourceRow : context->height - 1;
+            row[x] = before->colorBuffer[(width * sourceRow) + source->column];
+        }
+    }
+}
+
+// the column shows the face of one of its neighbours, unless it is the edge of something new;
+// the nearer neighbour is tried first, as its face would hide the other's
+void findColumnSource(RenderContext *context, const FrameBefore *before, int column, ColumnSource *source) {
+    const Ray *left = column > 0 ? &context->rays[column - 1] : NULL;
+    const Ray *right = column + 1 < context->width ? &context->rays[column + 1] : NULL;
+    const Ray *nearer = left == NULL || (right != NULL && right->distance < left->distance) ? right : left;
+    const Ray *farther = nearer == left ? right : left;
+    source->column = -1;
+    if (nearer == NULL) {
+        return;
+    }
+    if (reprojectFace(context, before, column, nearer, source) || (farther != NULL && reprojectFace(context, before, column, farther, source))) {
+        return;
+    }
+    float angle = context->rays[column].angle;
+    context->rays[column] = *nearer;
+    context->rays[column].angle = angle;
+}
+
+// follows the column's ray onto the plane of a neighbour's face and looks for that point in the
+// frame before. on success the column's ray becomes its hit on the face, the rest of it copied
+// from the neighbour.
+bool reprojectFace(RenderContext *context, const FrameBefore *before, int column, const Ray *face, ColumnSource *source) {
+    const Player *camera = &context->camera;
+    const Player *previous = &before->camera;
+    Ray *ray = &context->rays[column];
+    if (!isStraight(face, camera)) {
+        return false;
+    }
+    float rayCos = cos(ray->angle);
+    float raySin = sin(ray->angle);
+    // vertical faces lie on a line of constant x, horizontal ones on one of constant y
+    float along = face->wasHitVertical ? (face->wallHitX - camera->x) / rayCos : (face->wallHitY - camera->y) / raySin;
+    if (!(along > 0 && along < face->distance * 2)) {
+        return false;
+    }
+    float hitX = camera->x + rayCos * along;
+    float hitY = camera->y + raySin * along;
+
+    // the frame before's column whose ray came nearest that point, among the columns it cast
+    float dx = hitX - previous->x;
+    float dy = hitY - previous->y;
+    float previousDistance = sqrtf(dx * dx + dy * dy);
+    float previousAngle = atan2f(dy, dx);
+    float offset = remainderf(previousAngle - (previous->rotationAngle - (FOV_ANGLE / 2)), 2 * M_PI);
+    float exact = offset * context->width / FOV_ANGLE;
+    int previousColumn = (int)floorf(exact + 0.5f);
+    if ((previousColumn & 1) != before->parity) {
+        previousColumn += exact > previousColumn ? 1 : -1;
+    }
+    if (previousColumn < 0 || previousColumn >= context->width) {
+        return false;
+    }
+    const Ray *seen = &before->rays[previousColumn];
+    if (!isStraight(seen, previous) || seen->wasHitVertical != face->wasHitVertical || seen->wallHitContent != face->wallHitContent
+        || fabsf(seen->distance - previousDistance) > previousDistance * REPROJECT_TOLERANCE + 1) {
+        return false;
+    }
+
+    // rows stretch about the horizon by how much nearer the point came
+    float perpendicular = along * cos(ray->angle - camera->rotationAngle);
+    float previousPerpendicular = previousDistance * cos(previousAngle - previous->rotationAngle);
+    float rowStep = perpendicular / previousPerpendicular;
+    if (!(rowStep > 0.5f && rowStep < 2)) {
+        return false;
+    }
+    int horizon = context->height / 2;
+    source->column = previousColumn;
+    source->row = (int)((horizon + (0.5f - horizon) * rowStep) * 65536);
+    source->rowStep = (int)(rowStep * 65536);
+
+    float angle = ray->angle;
+    *ray = *face;
+    ray->angle = angle;
+    ray->wallHitX = hitX;
+    ray->wallHitY = hitY;
+    ray->distance = along;
+    return true;
+}
+
+// whether a ray reached its hit without passing through a portal, so the hit lies along its angle
+bool isStraight(const Ray *ray, const Player *camera) {
+    return fabsf(distanceBetweenPoints(camera->x, camera->y, ray->wallHitX, ray->wallHitY) - ray->distance) < 1;
+}
+
+// per channel, rounding down; the low bits are dropped first so no channel carries into the next
+uint32_t averageColor(uint32_t a, uint32_t b) {
+    return (a & b) + (((a ^ b) & 0xFEFEFEFE) >> 1);
+}
+
+// fills the column front to back. clipTop is the highest pixel drawn so far: everything from
+// there down is final, so a wall farther away only draws what shows above the walls before it.
+// see-through walls leave clipTop alone and are listed instead, then blended back to front once
+// everything behind them is drawn. the column's ray keeps the nearest hit.
+void renderColumn(RenderContext *context, const Scene *scene, int rayIndex, float projectionPlaneDistance, ColumnHit *seeThrough, int maxSeeThrough) {
+    Ray *ray = &context->rays[rayIndex];
+    float maxWallHeight = scene->map->maxWallHeight;
+    int horizon = context->height / 2;
+    int clipTop = context->height;
+
+    RayWalk walk;
+    rayWalkBegin(&walk, ray->angle, &context->camera, scene->maxPortalHops);
+    Ray hit;
+    bool nearest = true;
+    int numSeeThrough = 0;
+    while (rayWalkNext(&walk, scene->map, nearest ? ray : &hit)) {
+        const Ray *wall = nearest ? ray : &hit;
+        nearest = false;
+
+        float perpendicularDistance = wall->distance * cos(wall->angle - context->camera.rotationAngle);
+        // a camera standing exactly on a wall boundary would otherwise project an infinitely tall wall
+        perpendicularDistance = perpendicularDistance < 1 ? 1 : perpendicularDistance;
+        float projectedWallHeight = (TILE_SIZE / perpendicularDistance) * projectionPlaneDistance;
+
+        // the camera is half a tile above the floor, so taller walls only grow upwards
+        int tileStripHeight = (int)projectedWallHeight;
+        int wallBottom = horizon + (tileStripHeight / 2);
+        int wallTop = horizon - (tileStripHeight / 2) - (int)((wall->wallHitHeight - 1) * tileStripHeight);
+
+        int visibleBottom = wallBottom < clipTop ? wallBottom : clipTop;
+        int visibleTop = wallTop < 0 ? 0 : wallTop;
+        if (numSeeThrough < maxSeeThrough && wallTextureOf(scene, wall)->translucent) {
+            if (visibleTop < visibleBottom) {
+                ColumnHit columnHit = { *wall, visibleTop, visibleBottom, wallTop, tileStripHeight };
+                seeThrough[numSeeThrough++] = columnHit;
+            }
+            continue;
+        }
+        renderFloor(context, scene, &walk, projectionPlaneDistance, visibleBottom, clipTop, rayIndex);
+        clipTop = visibleBottom;
+        if (visibleTop < visibleBottom) {
+            renderWall(context, scene, wall, visibleTop, visibleBottom, wallTop, tileStripHeight, rayIndex);
+            clipTop = visibleTop;
+        }
+
+        // done once the column is full, or once not even the tallest wall in the map could rise
+        // above what is drawn; walls farther away project lower than one at this distance
+        int tallestTop = horizon - (tileStripHeight / 2) - (int)((maxWallHeight - 1) * tileStripHeight);
+        if (clipTop <= 0 || (maxWallHeight >= 1 && clipTop <= tallestTop)) {
+            break;
+        }
+    }
+
+    // whatever is left above the walls is ceiling above the horizon and floor below it
+    renderCeiling(context, clipTop < horizon ? clipTop : horizon, rayIndex);
+    renderFloor(context, scene, &walk, projectionPlaneDistance, horizon, clipTop, rayIndex);
+
+    for (int i = numSeeThrough - 1; i >= 0; i--) {
+        const ColumnHit *columnHit = &seeThrough[i];
+        blendWall(context, scene, &columnHit->hit, columnHit->visibleTop, columnHit->visibleBottom, columnHit->wallTop, columnHit->wallHeight, rayIndex);
+    }
+}
+
+void renderCeiling(RenderContext *context, int wallTop, int rayIndex) {
+    for (int y = 0; y < wallTop; y++) {
+        context->colorBuffer[(context->width * y) + rayIndex] = 0xFF444444;
+    }
+}
+
+const Texture *wallTextureOf(const Scene *scene, const Ray *hit) {
+    int textureIndex = hit->wallHitContent > 0 ? (hit->wallHitContent - 1) % scene->numWallTextures : 0;
+    return &scene->wallTextures[textureIndex];
+}
+
+// draws wallTop to wallBottom of a wall whose texture starts at textureTop and repeats every wallHeight pixels
+void renderWall(RenderContext *context, const Scene *scene, const Ray *hit, int wallTop, int wallBottom, int textureTop, int wallHeight, int rayIndex) {
+    WallTexels texels;
+    beginWallTexels(&texels, wallTextureOf(scene, hit), hit, wallTop, textureTop, wallHeight);
+    uint32_t *pixel = &context->colorBuffer[(context->width * wallTop) + rayIndex];
+
+    // unlit walls copy texels straight down the column, a run at a time where one texel spans many pixels
+    if (!isLit(scene)) {
+        if (texels.step <= (1 << 16) / WALL_RUN_PIXELS) {
+            fillWallRuns(&texels, pixel, context->width, wallBottom - wallTop);
+        } else if (texels.mask != 0) {
+            copyWallMasked(&texels, pixel, context->width, wallBottom - wallTop);
+        } else {
+            copyWallWrapped(&texels, pixel, context->width, wallBottom - wallTop);
+        }
+        return;
+    }
+
+    int scales[LIGHTMAP_LUMELS + 1];
+    int lightPosition = beginWallLight(scene, hit, wallTop, textureTop, wallHeight, scales);
+    int lightStep = (LIGHTMAP_LUMELS << 16) / wallHeight;
+    for (int y = wallTop; y < wallBottom; y++) {
+        *pixel = shadeTexel(nextWallTexel(&texels), wallLightAt(scales, lightPosition));
+        lightPosition -= lightStep;
+        pixel += context->width;
+    }
+}
+
+// like renderWall, but mixes each texel into what is already drawn by its alpha
+void blendWall(RenderContext *context, const Scene *scene, const Ray *hit, int wallTop, int wallBottom, int textureTop, int wallHeight, int rayIndex) {
+    WallTexels texels;
+    beginWallTexels(&texels, wallTextureOf(scene, hit), hit, wallTop, textureTop, wallHeight);
+    uint32_t *pixel = &context->colorBuffer[(context->width * wallTop) + rayIndex];
+    int scales[LIGHTMAP_LUMELS + 1];
+    int lightPosition = beginWallLight(scene, hit, wallTop, textureTop, wallHeight, scales);
+    int lightStep = (LIGHTMAP_LUMELS << 16) / wallHeight;
+    bool lit = isLit(scene);
+
+    for (int y = wallTop; y < wallBottom; y++) {
+        uint32_t texelColor = nextWallTexel(&texels);
+        if (lit) {
+            texelColor = shadeTexel(texelColor, wallLightAt(scales, lightPosition));
+            lightPosition -= lightStep;
+        }
+        *pixel = blendTexel(texelColor, *pixel);
+        pixel += context->width;
+    }
+}
+
+// finds the texture column the ray hit, which is contiguous in memory, and where in it row wallTop starts
+void beginWallTexels(WallTexels *texels, const Texture *wallTexture, const Ray *hit, int wallTop, int textureTop, int wallHeight) {
+    // textures wider than a tile need the offset's fraction too
+    int textureOffsetX = (int)(hit->wallHitOffset * wallTexture->width / TILE_SIZE);
+    textureOffsetX = textureOffsetX < wallTexture->width ? textureOffsetX : wallTexture->width - 1;
+    texels->column = &wallTexture->texels[textureOffsetX * wallTexture->height];
+    texels->step = ((uint32_t)wallTexture->height << 16) / (uint32_t)wallHeight;
+    // a texture a pixel or two high on a wall filling the screen would otherwise never step
+    texels->step = texels->step > 0 ? texels->step : 1;
+    texels->mask = wallTexture->heightShift > 0 ? (uint32_t)wallTexture->height - 1 : 0;
+    texels->wrap = (uint32_t)wallTexture->height << 16;
+    // exact for the first row, however far above the screen the wall's top lies; stepping only adds
+    // its rounding for the rows on screen. only walls taller than a tile wrap around
+    uint64_t position = ((uint64_t)(wallTop - textureTop) * texels->wrap) / (uint32_t)wallHeight;
+    texels->position = (uint32_t)(position % texels->wrap);
+}
+
+uint32_t nextWallTexel(WallTexels *texels) {
+    uint32_t texel;
+    if (texels->mask != 0) {
+        texel = texels->column[(texels->position >> 16) & texels->mask];
+        texels->position += texels->step;
+    } else {
+        texel = texels->column[texels->position >> 16];
+        texels->position += texels->step;
+        if (texels->position >= texels->wrap) {
+            texels->position -= texels->wrap;
+        }
+    }
+    return texel;
+}
+
+// power-of-two heights: the position may run past the texture, the mask wraps it for free
+void copyWallMasked(WallTexels *texels, uint32_t *pixel, int stride, int count) {
+    const uint32_t *column = texels->column;
+    uint32_t position = texels->position;
+    uint32_t step = texels->step;
+    uint32_t mask = texels->mask;
+    for (int i = 0; i < count; i++) {
+        *pixel = column[(position >> 16) & mask];
+        position += step;
+        pixel += stride;
+    }
+    texels->position = position;
+}
+
+void copyWallWrapped(WallTexels *texels, uint32_t *pixel, int stride, int count) {
+    for (int i = 0; i < count; i++) {
+        *pixel = nextWallTexel(texels);
+        pixel += stride;
+    }
+}
+
+// a magnified wall repeats each texel over several pixels; works out how many once per texel
+// and fills them, rather than stepping and indexing the texture for every pixel
+void fillWallRuns(WallTexels *texels, uint32_t *pixel, int stride, int count) {
+    uint32_t *end = pixel + (size_t)count * stride;
+    while (pixel < end) {
+        uint32_t row = texels->position >> 16;
+        uint32_t texel = texels->column[texels->mask != 0 ? row & texels->mask : row];
+        uint32_t toNextTexel = ((row + 1) << 16) - texels->position;
+        uint32_t run = (toNextTexel + texels->step - 1) / texels->step;
+        for (uint32_t i = 0; i < run && pixel < end; i++) {
+            *pixel = texel;
+            pixel += stride;
+        }
+        texels->position += run * texels->step;
+        if (texels->mask == 0 && texels->position >= texels->wrap) {
+            texels->position -= texels->wrap;
+        }
+    }
+}
+
+// whether walls and floors are shaded at all
+bool isLit(const Scene *scene) {
+    return scene->lightmap != NULL || scene->lights != NULL;
+}
+
+// looks up the light of the wall column a ray hit. returns where the top pixel's center lies,
+// in 1/65536ths of a lumel up from the floor; each pixel further down is 1 / wallHeight of a tile lower.
+int beginWallLight(const Scene *scene, const Ray *hit, int wallTop, int textureTop, int wallHeight, int *scales) {
+    if (!isLit(scene)) {
+        return 0;
+    }
+    if (scene->lightmap != NULL) {
+        lightmapWallScales(scene->lightmap, hit, scales);
+    } else {
+        for (int i = 0; i <= LIGHTMAP_LUMELS; i++) {
+            scales[i] = LIGHTS_AMBIENT_SCALE;
+        }
+    }
+    // moving lights are taken at one height, so they brighten the whole column alike
+    int added = scene->lights != NULL ? lightSetWallScale(scene->lights, hit) : 0;
+    if (added > 0) {
+        for (int i = 0; i <= LIGHTMAP_LUMELS; i++) {
+            scales[i] = scales[i] + added < LIGHTMAP_FULL_SCALE ? scales[i] + added : LIGHTMAP_FULL_SCALE;
+        }
+    }
+    float wallBottom = textureTop + hit->wallHitHeight * wallHeight;
+    float position = (wallBottom - wallTop - 0.5f) * LIGHTMAP_LUMELS / wallHeight;
+    // far above anything the light could reach, and still short of overflowing
+    return (int)((position < 16384 ? position : 16384) * 65536);
+}
+
+// the light scale at a position up the wall, blended between the lumels around it
+int wallLightAt(const int *scales, int position) {
+    if (position <= 0) {
+        return scales[0];
+    }
+    if (position >= LIGHTMAP_LUMELS << 16) {
+        return scales[LIGHTMAP_LUMELS];
+    }
+    int lumel = position >> 16;
+    int fraction = (position >> 8) & 0xFF;
+    return scales[lumel] + (((scales[lumel + 1] - scales[lumel]) * fraction) >> 8);
+}
+
+// alpha is the top byte; red and blue are blended together in one multiply, as neither can carry into the other
+uint32_t blendTexel(uint32_t texel, uint32_t background) {
+    uint32_t alpha = texel >> 24;
+    if (alpha == 255) {
+        return texel;
+    }
+    if (alpha == 0) {
+        return background;
+    }
+    uint32_t redBlue = ((texel & 0x00FF00FF) * alpha + (background & 0x00FF00FF) * (255 - alpha)) >> 8;
+    uint32_t green = ((texel & 0x0000FF00) * alpha + (background & 0x0000FF00) * (255 - alpha)) >> 8;
+    return 0xFF000000 | (redBlue & 0x00FF00FF) | (green & 0x0000FF00);
+}
+
+// scales a color by a light scale out of LIGHTMAP_FULL_SCALE, keeping its alpha
+uint32_t shadeTexel(uint32_t texel, int scale) {
+    uint32_t redBlue = ((texel & 0x00FF00FF) * (uint32_t)scale) >> 8;
+    uint32_t green = ((texel & 0x0000FF00) * (uint32_t)scale) >> 8;
+    return (texel & 0xFF000000) | (redBlue & 0x00FF00FF) | (green & 0x0000FF00);
+}
+
+// a lit floor is cast every few pixels and its light blended in between: row y shows the floor
+// where a wall with its bottom on that row would stand. the floor beyond a portal is found along
+// the walk's current leg, the floor in front of it along the ray as if the portal were not there.
+void renderFloor(RenderContext *context, const Scene *scene, const RayWalk *walk, float projectionPlaneDistance, int floorTop, int floorBottom, int rayIndex) {
+    if (!isLit(scene)) {
+        for (int y = floorTop; y < floorBottom; y++) {
+            context->colorBuffer[(context->width * y) + rayIndex] = 0xFF888888;
+        }
+        return;
+    }
+    float rayAngle = context->rays[rayIndex].angle;
+    FloorRay floorRay = {
+        (TILE_SIZE / 2) * projectionPlaneDistance / cos(rayAngle - context->camera.rotationAngle),
+        context->height / 2,
+        context->camera.x, context->camera.y, cos(rayAngle), sin(rayAngle),
+        walk->originX, walk->originY, walk->originDistance, cos(walk->angle), sin(walk->angle)
+    };
+    // the floor is gray, so one channel of it is blended and copied into the others
+    int y = floorTop;
+    int gray = shadeTexel(0xFF888888, floorLightAt(scene, &floorRay, y)) & 0xFF;
+    while (y < floorBottom) {
+        int spanEnd = y + FLOOR_LIGHT_SPAN < floorBottom ? y + FLOOR_LIGHT_SPAN : floorBottom;
+        int endGray = shadeTexel(0xFF888888, floorLightAt(scene, &floorRay, spanEnd)) & 0xFF;
+        // in 1/256ths, stepping towards the span's end
+        int blended = gray * 256;
+        int step = (endGray - gray) * 256 / (spanEnd - y);
+        for (; y < spanEnd; y++) {
+            context->colorBuffer[(context->width * y) + rayIndex] = 0xFF000000 | (uint32_t)(blended >> 8) * 0x010101;
+            blended += step;
+        }
+        gray = endGray;
+    }
+}
+
+// light scale of the floor shown on row y of a column, taken at the row's near edge: the wall
+// standing on the floor's first row may end a pixel short of its center, leaving that behind the wall
+int floorLightAt(const Scene *scene, const FloorRay *floorRay, int y) {
+    float distance = floorRay->reach / (y + 1 - floorRay->horizon);
+    if (distance >= floorRay->legDistance) {
+        float legDistance = distance - floorRay->legDistance;
+        return floorLightOf(scene, floorRay->legX + floorRay->legCos * legDistance, floorRay->legY + floorRay->legSin * legDistance);
+    }
+    return floorLightOf(scene, floorRay->cameraX + floorRay->rayCos * distance, floorRay->cameraY + floorRay->raySin * distance);
+}
+
+// light scale of the floor at (x, y), the lightmap's or the dark of an unlit scene, plus the moving lights
+int floorLightOf(const Scene *scene, float x, float y) {
+    int scale = scene->lightmap != NULL ? lightmapFloorScale(scene->lightmap, x, y) : LIGHTS_AMBIENT_SCALE;
+    if (scene->lights != NULL) {
+        scale += lightSetFloorScale(scene->lights, x, y);
+    }
+    return scale < LIGHTMAP_FULL_SCALE ? scale : LIGHTMAP_FULL_SCALE;
+}
@@ -0,0 +1,55 @@
+#ifndef _RENDER_H_
+#define _RENDER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
+#include "lightmap.h"
+#include "lights.h"
+#include "player.h"
+#include "map.h"
+#include "ray.h"
+#include "scheduler.h"
+#include "texture.h"
+
+// everything needed to render one camera; contexts share nothing mutable,
+// so any number of them can be rendered concurrently against the same map and textures
+typedef struct RenderContext {
+    Player camera;
+    Ray *rays;
+    uint32_t *colorBuffer;
+    int width;
+    int height;
+    Arena *frameArena;  // scratch for one frame, reset whenever a frame starts
+    // interleaved frames rebuild half their columns from the frame before. by default that is the
+    // context's own, kept in spare buffers allocated with its first interleaved frame; contexts
+    // that take turns rendering one sequence of frames, such as a pipeline's, set frameBefore to
+    // the context of the same size rendered just before them instead
+    const struct RenderContext *frameBefore;
+    uint32_t *spareColorBuffer;
+    Ray *spareRays;
+    Player castCamera;  // the camera the frame in colorBuffer was rendered for
+    int castParity;     // columns of this parity were cast in it, -1 unless it was interleaved
+} RenderContext;
+
+// read-only data shared by every context; a wall with map content n uses wall texture n - 1.
+// walls with translucent textures are blended over whatever lies behind them.
+typedef struct Scene {
+    const Map *map;
+    const Texture *wallTextures;
+    int numWallTextures;
+    int maxPortalHops;      // per ray, 0 shows every portal as a wall
+    const Lightmap *lightmap;   // lights walls and floors, NULL draws them at full brightness
+    const LightSet *lights;     // moving lights added on top; alone, they light a dark scene
+    // casts every other column, alternating between frames, and rebuilds the rest from the
+    // frame before, reprojected to the new camera
+    bool interleaved;
+} Scene;
+
+bool renderContextInit(RenderContext *context, int width, int height);
+void renderContextDestroy(RenderContext *context);
+void clearColorBuffer(RenderContext *context, uint32_t color);
+void renderView(RenderContext *context, const Scene *scene);
+void renderViewports(Scheduler *scheduler, RenderContext *contexts, int numContexts, const Scene *scene);
+
+#endif
@@ -0,0 +1,178 @@
+#include "replay.h"
+#include <stdlib.h>
+#include <string.h>
+#include "constants.h"
+
+#define REPLAY_MAGIC "RCRP"
+#define REPLAY_VERSION 1
+
+static bool writeUint32(FILE *file, uint32_t value);
+static bool readUint32(FILE *file, uint32_t *value);
+static bool writeFloat(FILE *file, float value);
+static bool readFloat(FILE *file, float *value);
+static bool writeRun(FILE *file, const ReplayRun *run);
+
+bool replayRecorderOpen(ReplayRecorder *recorder, const char *path, const Player *start) {
+    recorder->run.numTicks = 0;
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        return false;
+    }
+    bool written = fwrite(REPLAY_MAGIC, 1, 4, recorder->file) == 4
+        && fputc(REPLAY_VERSION, recorder->file) != EOF
+        && writeUint32(recorder->file, TICK_RATE)
+        && writeFloat(recorder->file, start->x)
+        && writeFloat(recorder->file, start->y)
+        && writeFloat(recorder->file, start->rotationAngle)
+        && writeFloat(recorder->file, start->walkSpeed)
+        && writeFloat(recorder->file, start->turnSpeed);
+    if (!written) {
+        fclose(recorder->file);
+        recorder->file = NULL;
+    }
+    return written;
+}
+
+// call once per simulation tick, before the tick moves the player
+bool replayRecordTick(ReplayRecorder *recorder, const Player *player) {
+    ReplayRun *run = &recorder->run;
+    if (run->numTicks > 0 && run->walkDirection == player->walkDirection && run->turnDirection == player->turnDirection) {
+        run->numTicks++;
+        return true;
+    }
+    if (run->numTicks > 0 && !writeRun(recorder->file, run)) {
+        return false;
+    }
+    run->numTicks = 1;
+    run->walkDirection = (int8_t)player->walkDirection;
+    run->turnDirection = (int8_t)player->turnDirection;
+    return true;
+}
+
+void replayRecorderClose(ReplayRecorder *recorder) {
+    if (recorder->file == NULL) {
+        return;
+    }
+    if (recorder->run.numTicks > 0) {
+        writeRun(recorder->file, &recorder->run);
+    }
+    fclose(recorder->file);
+    recorder->file = NULL;
+}
+
+bool replayLoad(Replay *replay, const char *path) {
+    memset(replay, 0, sizeof(Replay));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t tickRate;
+    bool valid = fread(magic, 1, 4, file) == 4
+        && memcmp(magic, REPLAY_MAGIC, 4) == 0
+        && fgetc(file) == REPLAY_VERSION
+        && readUint32(file, &tickRate)
+        && tickRate == TICK_RATE
+        && readFloat(file, &replay->start.x)
+        && readFloat(file, &replay->start.y)
+        && readFloat(file, &replay->start.rotationAngle)
+        && readFloat(file, &replay->start.walkSpeed)
+        && readFloat(file, &replay->start.turnSpeed);
+    replay->start.width = 1;
+    replay->start.height = 1;
+
+    int capacity = 0;
+    while (valid) {
+        ReplayRun run;
+        if (!readUint32(file, &run.numTicks)) {
+            break;
+        }
+        int walkDirection = fgetc(file);
+        int turnDirection = fgetc(file);
+        if (turnDirection == EOF) {
+            valid = false;
+            break;
+        }
+        run.walkDirection = (int8_t)walkDirection;
+        run.turnDirection = (int8_t)turnDirection;
+
+        if (replay->numRuns == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            ReplayRun *runs = (ReplayRun*) realloc(replay->runs, sizeof(ReplayRun) * capacity);
+            if (runs == NULL) {
+                valid = false;
+                break;
+            }
+            replay->runs = runs;
+        }
+        replay->runs[replay->numRuns++] = run;
+    }
+    fclose(file);
+
+    if (!valid) {
+        replayDestroy(replay);
+    }
+    return valid;
+}
+
+// sets the player input for the next simulation tick, false once the log is exhausted
+bool replayNextTick(Replay *replay, Player *player) {
+    while (replay->currentRun < replay->numRuns && replay->currentTick >= replay->runs[replay->currentRun].numTicks) {
+        replay->currentRun++;
+        replay->currentTick = 0;
+    }
+    if (replay->currentRun >= replay->numRuns) {
+        player->walkDirection = 0;
+        player->turnDirection = 0;
+        return false;
+    }
+    player->walkDirection = replay->runs[replay->currentRun].walkDirection;
+    player->turnDirection = replay->runs[replay->currentRun].turnDirection;
+    replay->currentTick++;
+    return true;
+}
+
+void replayDestroy(Replay *replay) {
+    free(replay->runs);
+    replay->runs = NULL;
+    replay->numRuns = 0;
+}
+
+// PRIVATE
+
+// the log is little-endian regardless of the host
+static bool writeUint32(FILE *file, uint32_t value) {
+    unsigned char bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF };
+    return fwrite(bytes, 1, 4, file) == 4;
+}
+
+static bool readUint32(FILE *file, uint32_t *value) {
+    unsigned char bytes[4];
+    if (fread(bytes, 1, 4, file) != 4) {
+        return false;
+    }
+    *value = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    return true;
+}
+
+static bool writeFloat(FILE *file, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return writeUint32(file, bits);
+}
+
+static bool readFloat(FILE *file, float *value) {
+    uint32_t bits;
+    if (!readUint32(file, &bits)) {
+        return false;
+    }
+    memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+static bool writeRun(FILE *file, const ReplayRun *run) {
+    return writeUint32(file, run->numTicks)
+        && fputc((unsigned char)run->walkDirection, file) != EOF
+        && fputc((unsigned char)run->turnDirection, file) != EOF;
+}
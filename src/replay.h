@@ -0,0 +1,40 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "player.h"
+
+// a replay log stores the starting camera followed by runs of simulation ticks
+// that share the same walk and turn input. driving movePlayer with TICK_LENGTH
+// steps from the same map, moving its doors before every step the way the game
+// does, reproduces the recorded camera path exactly.
+typedef struct ReplayRun {
+    uint32_t numTicks;
+    int8_t walkDirection;
+    int8_t turnDirection;
+} ReplayRun;
+
+typedef struct ReplayRecorder {
+    FILE *file;
+    ReplayRun run;
+} ReplayRecorder;
+
+typedef struct Replay {
+    Player start;
+    ReplayRun *runs;
+    int numRuns;
+    int currentRun;
+    uint32_t currentTick;
+} Replay;
+
+bool replayRecorderOpen(ReplayRecorder *recorder, const char *path, const Player *start);
+bool replayRecordTick(ReplayRecorder *recorder, const Player *player);
+void replayRecorderClose(ReplayRecorder *recorder);
+
+bool replayLoad(Replay *replay, const char *path);
+bool replayNextTick(Replay *replay, Player *player);
+void replayDestroy(Replay *replay);
+
+#endif
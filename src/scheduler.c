@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scheduler.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// range of task indices still owned by a worker: the owner pops from the end,
+// thieves take the front half
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    int begin;
+    int end;
+} WorkQueue;
+
+// the schedulers whose tasks a thread is running, innermost first, kept on the thread's stack
+typedef struct RunningTasks {
+    Scheduler *scheduler;
+    struct RunningTasks *outer;
+} RunningTasks;
+
+typedef struct Worker {
+    Scheduler *scheduler;
+    pthread_t thread;
+    int index;
+} Worker;
+
+struct Scheduler {
+    int numWorkers;
+    Worker *workers;
+    WorkQueue *queues;
+    pthread_mutex_t callLock;   // held by the thread whose parallel-for is running
+    pthread_mutex_t lock;
+    pthread_cond_t jobReady;
+    pthread_cond_t jobDone;
+    unsigned generation;
+    int busyWorkers;
+    bool shuttingDown;
+    TaskFunction task;
+    void *taskData;
+};
+
+static pthread_key_t runningTasksKey;
+static pthread_once_t runningTasksOnce = PTHREAD_ONCE_INIT;
+
+static void createRunningTasksKey(void);
+static bool isRunningTasksOf(Scheduler *scheduler);
+static void *workerMain(void *argument);
+static void runTasks(Scheduler *scheduler, int self);
+static bool popTask(WorkQueue *queue, int *index);
+static bool stealTasks(Scheduler *scheduler, int self, int *index);
+
+Scheduler *schedulerCreate(int numWorkers) {
+    if (numWorkers <= 0) {
+        long onlineCores = sysconf(_SC_NPROCESSORS_ONLN);
+        numWorkers = onlineCores > 0 ? (int)onlineCores : 1;
+    }
+
+    Scheduler *scheduler = (Scheduler*) calloc(1, sizeof(Scheduler));
+    if (scheduler == NULL) {
+        return NULL;
+    }
+    scheduler->workers = (Worker*) calloc(numWorkers, sizeof(Worker));
+    scheduler->queues = (WorkQueue*) calloc(numWorkers, sizeof(WorkQueue));
+    if (scheduler->workers == NULL || scheduler->queues == NULL) {
+        free(scheduler->workers);
+        free(scheduler->queues);
+        free(scheduler);
+        return NULL;
+    }
+
+    pthread_once(&runningTasksOnce, createRunningTasksKey);
+    pthread_mutex_init(&scheduler->callLock, NULL);
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->jobReady, NULL);
+    pthread_cond_init(&scheduler->jobDone, NULL);
+    for (int i = 0; i < numWorkers; i++) {
+        pthread_mutex_init(&scheduler->queues[i].lock, NULL);
+        scheduler->workers[i].scheduler = scheduler;
+        scheduler->workers[i].index = i;
+    }
+
+    // worker 0 is whichever thread calls schedulerParallelFor
+    scheduler->numWorkers = 1;
+    for (int i = 1; i < numWorkers; i++) {
+        if (pthread_create(&scheduler->workers[i].thread, NULL, workerMain, &scheduler->workers[i]) != 0) {
+            break;
+        }
+        scheduler->numWorkers++;
+    }
+    return scheduler;
+}
+
+void schedulerDestroy(Scheduler *scheduler) {
+    if (scheduler == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->shuttingDown = true;
+    pthread_cond_broadcast(&scheduler->jobReady);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for (int i = 1; i < scheduler->numWorkers; i++) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < scheduler->numWorkers; i++) {
+        pthread_mutex_destroy(&scheduler->queues[i].lock);
+    }
+    pthread_cond_destroy(&scheduler->jobDone);
+    pthread_cond_destroy(&scheduler->jobReady);
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_mutex_destroy(&scheduler->callLock);
+    free(scheduler->queues);
+    free(scheduler->workers);
+    free(scheduler);
+}
+
+int schedulerWorkerCount(Scheduler *scheduler) {
+    return scheduler->numWorkers;
+}
+
+void schedulerParallelFor(Scheduler *scheduler, int count, TaskFunction task, void *data) {
+    if (count <= 0) {
+        return;
+    }
+    // the workers are busy with the job this call is part of, and would never get to a new one
+    if (isRunningTasksOf(scheduler)) {
+        for (int i = 0; i < count; i++) {
+            task(data, i);
+        }
+        return;
+    }
+    pthread_mutex_lock(&scheduler->callLock);
+    int numWorkers = scheduler->numWorkers;
+    for (int i = 0; i < numWorkers; i++) {
+        WorkQueue *queue = &scheduler->queues[i];
+        pthread_mutex_lock(&queue->lock);
+        queue->begin = (int)((long)count * i / numWorkers);
+        queue->end = (int)((long)count * (i + 1) / numWorkers);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->task = task;
+    scheduler->taskData = data;
+    scheduler->busyWorkers = numWorkers - 1;
+    scheduler->generation++;
+    pthread_cond_broadcast(&scheduler->jobReady);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    runTasks(scheduler, 0);
+
+    pthread_mutex_lock(&scheduler->lock);
+    while (scheduler->busyWorkers > 0) {
+        pthread_cond_wait(&scheduler->jobDone, &scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    pthread_mutex_unlock(&scheduler->callLock);
+}
+
+// PRIVATE
+
+static void createRunningTasksKey(void) {
+    pthread_key_create(&runningTasksKey, NULL);
+}
+
+static bool isRunningTasksOf(Scheduler *scheduler) {
+    for (RunningTasks *running = (RunningTasks*) pthread_getspecific(runningTasksKey); running != NULL; running = running->outer) {
+        if (running->scheduler == scheduler) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *workerMain(void *argument) {
+    Worker *worker = (Worker*) argument;
+    Scheduler *scheduler = worker->scheduler;
+    unsigned seenGeneration = 0;
+
+    pthread_mutex_lock(&scheduler->lock);
+    for (;;) {
+        while (scheduler->generation == seenGeneration && !scheduler->shuttingDown) {
+            pthread_cond_wait(&scheduler->jobReady, &scheduler->lock);
+        }
+        if (scheduler->shuttingDown) {
+            break;
+        }
+        seenGeneration = scheduler->generation;
+        pthread_mutex_unlock(&scheduler->lock);
+
+        runTasks(scheduler, worker->index);
+
+        pthread_mutex_lock(&scheduler->lock);
+        if (--scheduler->busyWorkers == 0) {
+            pthread_cond_signal(&scheduler->jobDone);
+        }
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return NULL;
+}
+
+static void runTasks(Scheduler *scheduler, int self) {
+    RunningTasks running = { scheduler, (RunningTasks*) pthread_getspecific(runningTasksKey) };
+    pthread_setspecific(runningTasksKey, &running);
+    int index;
+    while (popTask(&scheduler->queues[self], &index) || stealTasks(scheduler, self, &index)) {
+        scheduler->task(scheduler->taskData, index);
+    }
+    pthread_setspecific(runningTasksKey, running.outer);
+}
+
+static bool popTask(WorkQueue *queue, int *index) {
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->begin < queue->end) {
+        *index = --queue->end;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool stealTasks(Scheduler *scheduler, int self, int *index) {
+    int numWorkers = scheduler->numWorkers;
+    for (int offset = 1; offset < numWorkers; offset++) {
+        WorkQueue *victim = &scheduler->queues[(self + offset) % numWorkers];
+        int stolenBegin = 0;
+        int stolenCount = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->begin;
+        if (remaining > 0) {
+            stolenCount = (remaining + 1) / 2;
+            stolenBegin = victim->begin;
+            victim->begin += stolenCount;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (stolenCount > 0) {
+            // run the first stolen index now and keep the rest where others can steal it back
+            WorkQueue *own = &scheduler->queues[self];
+            pthread_mutex_lock(&own->lock);
+            own->begin = stolenBegin + 1;
+            own->end = stolenBegin + stolenCount;
+            pthread_mutex_unlock(&own->lock);
+            *index = stolenBegin;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,19 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+typedef struct Scheduler Scheduler;
+
+typedef void (*TaskFunction)(void *data, int index);
+
+// numWorkers counts the calling thread; zero or less uses one worker per online core
+Scheduler *schedulerCreate(int numWorkers);
+void schedulerDestroy(Scheduler *scheduler);
+int schedulerWorkerCount(Scheduler *scheduler);
+
+// runs task(data, i) for every i in [0, count) and returns once all of them finished.
+// indices are split evenly between the workers and idle workers steal from busy ones.
+// calls from several threads take turns. a call from inside one of the scheduler's own tasks
+// runs its tasks one after another on the calling thread, as the workers are all taken.
+void schedulerParallelFor(Scheduler *scheduler, int count, TaskFunction task, void *data);
+
+#endif
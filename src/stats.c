@@ -0,0 +1,51 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+#include <string.h>
+#include <time.h>
+
+static const char *statNames[NUM_STATS] = {
+    "frame",
+    "render",
+    "present wait",
+    "present",
+    "latency",
+    "reload",
+    "asset swap",
+    "collision",
+    "light bake",
+    "light shadow",
+    "capture",
+    "stream",
+};
+
+// monotonic time in milliseconds
+double statsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+void statsRecord(FrameStats *stats, StatId id, double milliseconds) {
+    if (stats == NULL) {
+        return;
+    }
+    StatCounter *counter = &stats->counters[id];
+    counter->total += milliseconds;
+    counter->max = milliseconds > counter->max ? milliseconds : counter->max;
+    counter->count++;
+}
+
+// prints the average and worst value of every stat measured since the last report, then resets them
+void statsReport(FrameStats *stats, FILE *file) {
+    for (int i = 0; i < NUM_STATS; i++) {
+        StatCounter *counter = &stats->counters[i];
+        if (counter->count == 0) {
+            continue;
+        }
+        fprintf(file, "%-14s avg %8.3f ms  max %8.3f ms  (%d)\n",
+            statNames[i], counter->total / counter->count, counter->max, counter->count);
+    }
+    fprintf(file, "\n");
+    memset(stats->counters, 0, sizeof(stats->counters));
+}
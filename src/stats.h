@@ -0,0 +1,38 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+
+typedef enum StatId {
+    STAT_FRAME,         // one iteration of the game loop
+    STAT_RENDER,        // casting and rasterizing one frame
+    STAT_PRESENT_WAIT,  // main thread blocked until the next frame finished rendering
+    STAT_PRESENT,       // upload, overlays and present
+    STAT_LATENCY,       // camera submitted to frame presented
+    STAT_RELOAD,        // changed asset detected to new version swapped in
+    STAT_ASSET_SWAP,    // main thread time spent swapping reloaded assets in
+    STAT_COLLISION,     // moving everything through the map in one simulation tick
+    STAT_LIGHT_BAKE,    // map change to lighting rebaked for it swapped in
+    STAT_LIGHT_SHADOW,  // finding what one moving light reaches
+    STAT_CAPTURE,       // copying a frame into the capture ring, waiting for a free buffer included
+    STAT_STREAM,        // encoding a frame for a remote viewer and handing it to the socket
+    NUM_STATS
+} StatId;
+
+typedef struct StatCounter {
+    double total;
+    double max;
+    int count;
+} StatCounter;
+
+// millisecond timings accumulated between two reports; not thread safe,
+// every thread that measures something hands the timings to one owner
+typedef struct FrameStats {
+    StatCounter counters[NUM_STATS];
+} FrameStats;
+
+double statsNow(void);
+void statsRecord(FrameStats *stats, StatId id, double milliseconds);
+void statsReport(FrameStats *stats, FILE *file);
+
+#endif
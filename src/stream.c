@@ -0,0 +1,361 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "delta.h"
+
+#define STREAM_MAGIC "RCST"
+#define STREAM_VERSION 1
+#define HELLO_SIZE 5
+// payload size, width, height, flags and 3 bytes of padding, little endian
+#define FRAME_HEADER_SIZE 12
+#define FRAME_KEY 1     // encoded against nothing, the viewer needs no earlier frame
+
+// a viewer that stops reading would otherwise kill the game with SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct FrameStreamServer {
+    int listenSocket;
+    int viewerSocket;       // -1 while no viewer is connected
+    char *unixPath;         // removed again on destroy
+    int width;
+    int height;
+    uint32_t *reference;    // what the viewer will hold once it decoded everything sent
+    bool viewerHasFrame;
+    unsigned char *output;  // hello or header and frame, waiting to be sent
+    size_t outputSize;
+    size_t outputSent;
+    StreamCounts counts;
+    FrameStats *stats;
+};
+
+struct FrameStreamViewer {
+    int socket;
+    uint32_t *frame;
+    int width;
+    int height;
+    unsigned char *data;
+    size_t dataCapacity;
+};
+
+static int openSocket(const char *address, bool listening);
+static void acceptViewer(FrameStreamServer *server);
+static void closeViewer(FrameStreamServer *server);
+static bool flushOutput(FrameStreamServer *server);
+static bool receiveAll(int socket, unsigned char *bytes, size_t size);
+static void putUint32(unsigned char *bytes, uint32_t value);
+static uint32_t getUint32(const unsigned char *bytes);
+
+FrameStreamServer *streamServerCreate(const char *address, int width, int height, FrameStats *stats) {
+    FrameStreamServer *server = (FrameStreamServer*) calloc(1, sizeof(FrameStreamServer));
+    if (server == NULL) {
+        return NULL;
+    }
+    server->viewerSocket = -1;
+    server->width = width;
+    server->height = height;
+    server->stats = stats;
+    server->reference = (uint32_t*) malloc(sizeof(uint32_t) * (size_t)width * height);
+    server->output = (unsigned char*) malloc(FRAME_HEADER_SIZE + deltaEncodeBound(width, height));
+    server->listenSocket = openSocket(address, true);
+    if (strchr(address, '/') != NULL && server->listenSocket >= 0) {
+        server->unixPath = (char*) malloc(strlen(address) + 1);
+        if (server->unixPath != NULL) {
+            strcpy(server->unixPath, address);
+        }
+    }
+    if (server->reference == NULL || server->output == NULL || server->listenSocket < 0
+        || fcntl(server->listenSocket, F_SETFL, O_NONBLOCK) != 0) {
+        streamServerDestroy(server);
+        return NULL;
+    }
+    return server;
+}
+
+void streamServerDestroy(FrameStreamServer *server) {
+    if (server == NULL) {
+        return;
+    }
+    closeViewer(server);
+    if (server->listenSocket >= 0) {
+        close(server->listenSocket);
+    }
+    if (server->unixPath != NULL) {
+        unlink(server->unixPath);
+    }
+    free(server->unixPath);
+    free(server->output);
+    free(server->reference);
+    free(server);
+}
+
+bool streamServerSend(FrameStreamServer *server, const uint32_t *pixels) {
+    double start = statsNow();
+    if (server->viewerSocket < 0) {
+        acceptViewer(server);
+        if (server->viewerSocket < 0) {
+            return false;
+        }
+    }
+    if (!flushOutput(server)) {
+        closeViewer(server);
+        return false;
+    }
+    if (server->outputSent < server->outputSize) {
+        server->counts.framesSkipped++;
+        statsRecord(server->stats, STAT_STREAM, statsNow() - start);
+        return false;
+    }
+
+    double encodeStart = statsNow();
+    const uint32_t *reference = server->viewerHasFrame ? server->reference : NULL;
+    size_t size = deltaEncode(pixels, reference, server->width, server->height, &server->output[FRAME_HEADER_SIZE]);
+    server->counts.encodeMilliseconds += statsNow() - encodeStart;
+    memset(server->output, 0, FRAME_HEADER_SIZE);
+    putUint32(&server->output[0], (uint32_t)size);
+    putUint32(&server->output[4], (uint32_t)server->width | ((uint32_t)server->height << 16));
+    server->output[8] = reference == NULL ? FRAME_KEY : 0;
+    server->outputSize = FRAME_HEADER_SIZE + size;
+    server->outputSent = 0;
+    memcpy(server->reference, pixels, sizeof(uint32_t) * (size_t)server->width * server->height);
+    server->viewerHasFrame = true;
+    server->counts.framesSent++;
+    server->counts.bytesSent += server->outputSize;
+
+    if (!flushOutput(server)) {
+        closeViewer(server);
+    }
+    statsRecord(server->stats, STAT_STREAM, statsNow() - start);
+    return true;
+}
+
+StreamCounts streamServerCounts(const FrameStreamServer *server) {
+    return server->counts;
+}
+
+FrameStreamViewer *streamViewerConnect(const char *address) {
+    FrameStreamViewer *viewer = (FrameStreamViewer*) calloc(1, sizeof(FrameStreamViewer));
+    if (viewer == NULL) {
+        return NULL;
+    }
+    viewer->socket = openSocket(address, false);
+    unsigned char hello[HELLO_SIZE];
+    if (viewer->socket < 0 || !receiveAll(viewer->socket, hello, HELLO_SIZE)
+        || memcmp(hello, STREAM_MAGIC, 4) != 0 || hello[4] != STREAM_VERSION) {
+        streamViewerDestroy(viewer);
+        return NULL;
+    }
+    return viewer;
+}
+
+void streamViewerDestroy(FrameStreamViewer *viewer) {
+    if (viewer == NULL) {
+        return;
+    }
+    if (viewer->socket >= 0) {
+        close(viewer->socket);
+    }
+    free(viewer->data);
+    free(viewer->frame);
+    free(viewer);
+}
+
+const uint32_t *streamViewerReceive(FrameStreamViewer *viewer, int *width, int *height) {
+    unsigned char header[FRAME_HEADER_SIZE];
+    if (!receiveAll(viewer->socket, header, FRAME_HEADER_SIZE)) {
+        return NULL;
+    }
+    uint32_t size = getUint32(&header[0]);
+    int frameWidth = (int)(getUint32(&header[4]) & 0xFFFF);
+    int frameHeight = (int)(getUint32(&header[4]) >> 16);
+    bool key = (header[8] & FRAME_KEY) != 0;
+    if (frameWidth == 0 || frameHeight == 0 || size > deltaEncodeBound(frameWidth, frameHeight)) {
+        return NULL;
+    }
+    // a delta only applies to a frame of its own size
+    if (frameWidth != viewer->width || frameHeight != viewer->height) {
+        if (!key) {
+            return NULL;
+        }
+        uint32_t *frame = (uint32_t*) realloc(viewer->frame, sizeof(uint32_t) * (size_t)frameWidth * frameHeight);
+        if (frame == NULL) {
+            return NULL;
+        }
+        viewer->frame = frame;
+        viewer->width = frameWidth;
+        viewer->height = frameHeight;
+    }
+    if (viewer->dataCapacity < size) {
+        unsigned char *data = (unsigned char*) realloc(viewer->data, size);
+        if (data == NULL) {
+            return NULL;
+        }
+        viewer->data = data;
+        viewer->dataCapacity = size;
+    }
+    if (!receiveAll(viewer->socket, viewer->data, size)
+        || !deltaDecode(viewer->data, size, viewer->frame, frameWidth, frameHeight)) {
+        return NULL;
+    }
+    *width = frameWidth;
+    *height = frameHeight;
+    return viewer->frame;
+}
+
+// PRIVATE
+
+// listens on or connects to an address, see stream.h
+static int openSocket(const char *address, bool listening) {
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(local.sun_path)) {
+            return -1;
+        }
+        strcpy(local.sun_path, address);
+        // a socket file left behind by an earlier run would make bind fail, so it is removed; anything
+        // else at the path is a mistyped address and is left alone
+        struct stat existing;
+        if (listening && lstat(address, &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode) || unlink(address) != 0) {
+                return -1;
+            }
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        bool opened = listening
+            ? bind(fd, (struct sockaddr*) &local, sizeof(local)) == 0 && listen(fd, 1) == 0
+            : connect(fd, (struct sockaddr*) &local, sizeof(local)) == 0;
+        if (!opened) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    char host[256] = "127.0.0.1";
+    const char *port = address;
+    const char *colon = strrchr(address, ':');
+    if (colon != NULL) {
+        size_t hostLength = (size_t)(colon - address);
+        if (hostLength >= sizeof(host)) {
+            return -1;
+        }
+        if (hostLength > 0) {
+            memcpy(host, address, hostLength);
+            host[hostLength] = '\0';
+        }
+        port = colon + 1;
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *results;
+    if (getaddrinfo(host, port, &hints, &results) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *result = results; result != NULL && fd < 0; result = result->ai_next) {
+        fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int enabled = 1;
+        bool opened = listening
+            ? setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled)) == 0
+                && bind(fd, result->ai_addr, result->ai_addrlen) == 0 && listen(fd, 1) == 0
+            : connect(fd, result->ai_addr, result->ai_addrlen) == 0;
+        if (!opened) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    return fd;
+}
+
+static void acceptViewer(FrameStreamServer *server) {
+    int fd = accept(server->listenSocket, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+        close(fd);
+        return;
+    }
+    // frames go out whole, so their last segment should not wait for an acknowledgement; fails harmlessly on unix sockets
+    int enabled = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    server->viewerSocket = fd;
+    server->viewerHasFrame = false;
+    memcpy(server->output, STREAM_MAGIC, 4);
+    server->output[4] = STREAM_VERSION;
+    server->outputSize = HELLO_SIZE;
+    server->outputSent = 0;
+    server->counts.viewers++;
+}
+
+static void closeViewer(FrameStreamServer *server) {
+    if (server->viewerSocket >= 0) {
+        close(server->viewerSocket);
+    }
+    server->viewerSocket = -1;
+    server->outputSize = 0;
+    server->outputSent = 0;
+}
+
+// sends as much of the output as the socket takes right now; false once the viewer is gone
+static bool flushOutput(FrameStreamServer *server) {
+    while (server->outputSent < server->outputSize) {
+        ssize_t sent = send(server->viewerSocket, &server->output[server->outputSent],
+            server->outputSize - server->outputSent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            server->outputSent += (size_t)sent;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else if (sent < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool receiveAll(int socket, unsigned char *bytes, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t count = recv(socket, &bytes[received], size - received, 0);
+        if (count > 0) {
+            received += (size_t)count;
+        } else if (count == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void putUint32(unsigned char *bytes, uint32_t value) {
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t getUint32(const unsigned char *bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
@@ -0,0 +1,45 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stats.h"
+
+// serves rendered frames to one remote viewer at a time over a socket. an address with a '/'
+// in it is a unix socket path, anything else is host:port, or a port alone on localhost.
+//
+// each frame is sent as a delta against the last frame the viewer got (see delta.h), so a still
+// camera costs next to nothing and a moving one mostly the walls that changed. sending never
+// blocks the caller: while the socket is still busy with one frame, the frames after it are
+// skipped, and the next one sent covers everything that changed since. a new viewer starts off
+// with the whole frame.
+typedef struct FrameStreamServer FrameStreamServer;
+typedef struct FrameStreamViewer FrameStreamViewer;
+
+typedef struct StreamCounts {
+    unsigned long viewers;          // connections accepted
+    unsigned long framesSent;
+    unsigned long framesSkipped;    // while the viewer was still receiving an earlier frame
+    unsigned long long bytesSent;   // of the frames sent, headers included
+    double encodeMilliseconds;
+} StreamCounts;
+
+// returns NULL when out of memory or the address cannot be listened on, which includes a path
+// naming anything but a socket: only a socket left behind by an earlier server is replaced
+FrameStreamServer *streamServerCreate(const char *address, int width, int height, FrameStats *stats);
+void streamServerDestroy(FrameStreamServer *server);
+
+// call once per presented frame. accepts a waiting viewer, sends the frame to the viewer unless it
+// is still busy, and records the time taken as STAT_STREAM. returns true when the frame was sent.
+bool streamServerSend(FrameStreamServer *server, const uint32_t *pixels);
+StreamCounts streamServerCounts(const FrameStreamServer *server);
+
+// returns NULL when the server cannot be reached or does not speak the protocol
+FrameStreamViewer *streamViewerConnect(const char *address);
+void streamViewerDestroy(FrameStreamViewer *viewer);
+
+// waits for the next frame and returns it as a color buffer of width x height pixels, valid until
+// the next call; NULL once the server went away or sent something that is not a frame
+const uint32_t *streamViewerReceive(FrameStreamViewer *viewer, int *width, int *height);
+
+#endif
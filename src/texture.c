@@ -0,0 +1,104 @@
+#include "texture.h"
+#include <stdlib.h>
+#include "arena.h"
+#include "upng.h"
+
+static bool textureDecode(Texture *texture, upng_t *png, Arena *scratch);
+static bool textureAllocate(Texture *texture, int width, int height);
+static void findTranslucency(Texture *texture);
+static void *arenaAllocHook(void *user, unsigned long size);
+
+bool textureLoad(Texture *texture, const char *path, Arena *scratch) {
+    return textureDecode(texture, upng_new_from_file(path), scratch);
+}
+
+bool textureLoadMapped(Texture *texture, const char *path, Arena *scratch) {
+    return textureDecode(texture, upng_new_from_file_mapped(path), scratch);
+}
+
+// transposes row-major pixels into the column-major texel layout
+bool textureFromPixels(Texture *texture, const uint32_t *pixels, int width, int height) {
+    if (!textureAllocate(texture, width, height)) {
+        return false;
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            texture->texels[(x * height) + y] = pixels[(width * y) + x];
+        }
+    }
+    findTranslucency(texture);
+    return true;
+}
+
+bool textureCreateSolid(Texture *texture, int width, int height, uint32_t color) {
+    if (!textureAllocate(texture, width, height)) {
+        return false;
+    }
+    for (int i = 0; i < width * height; i++) {
+        texture->texels[i] = color;
+    }
+    texture->translucent = (color >> 24) < 255;
+    return true;
+}
+
+void textureDestroy(Texture *texture) {
+    free(texture->texels);
+    texture->texels = NULL;
+    texture->width = 0;
+    texture->height = 0;
+    texture->heightShift = -1;
+    texture->translucent = false;
+}
+
+// PRIVATE
+
+// pixels are converted to RGBA and written straight into the column-major
+// texels as each scanline is decoded, whatever the file's own format
+static bool textureDecode(Texture *texture, upng_t *png, Arena *scratch) {
+    if (png == NULL) {
+        return false;
+    }
+    if (scratch != NULL) {
+        upng_set_allocator(png, arenaAllocHook, NULL, scratch);
+    }
+    if (upng_header(png) != UPNG_EOK
+        || !textureAllocate(texture, (int)upng_get_width(png), (int)upng_get_height(png))) {
+        upng_free(png);
+        return false;
+    }
+    unsigned long columnStride = sizeof(uint32_t) * (unsigned long)texture->height;
+    if (upng_decode_rgba8(png, (unsigned char*) texture->texels, columnStride, sizeof(uint32_t)) != UPNG_EOK) {
+        textureDestroy(texture);
+        upng_free(png);
+        return false;
+    }
+    upng_free(png);
+    findTranslucency(texture);
+    return true;
+}
+
+static bool textureAllocate(Texture *texture, int width, int height) {
+    texture->width = width;
+    texture->height = height;
+    texture->texels = (uint32_t*) malloc(sizeof(uint32_t) * (uint32_t)width * (uint32_t)height);
+    texture->heightShift = -1;
+    for (int shift = 0; shift < 16 && height > 0; shift++) {
+        if (height == 1 << shift) {
+            texture->heightShift = shift;
+        }
+    }
+    texture->translucent = false;
+    return texture->texels != NULL;
+}
+
+// texels are RGBA in memory, so alpha is the top byte
+static void findTranslucency(Texture *texture) {
+    texture->translucent = false;
+    for (int i = 0; i < texture->width * texture->height && !texture->translucent; i++) {
+        texture->translucent = (texture->texels[i] >> 24) < 255;
+    }
+}
+
+static void *arenaAllocHook(void *user, unsigned long size) {
+    return arenaAlloc((Arena*) user, size);
+}
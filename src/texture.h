@@ -0,0 +1,27 @@
+#ifndef _TEXTURE_H_
+#define _TEXTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
+
+// walls are always sampled one vertical column at a time, so texels are stored
+// column-major: texel (x, y) lives at texels[(x * height) + y] and a whole
+// wall column is one contiguous run of memory
+typedef struct Texture {
+    int width;
+    int height;
+    uint32_t *texels;
+    int heightShift;    // log2 of height when it is a power of two, so walls index with a mask; otherwise -1
+    bool translucent;   // some texel has alpha below 255, so walls using it show what lies behind them
+} Texture;
+
+// decoder scratch comes from the arena when one is given, otherwise from the heap
+bool textureLoad(Texture *texture, const char *path, Arena *scratch);
+// decodes straight from a mapping of the file, for files nothing rewrites meanwhile
+bool textureLoadMapped(Texture *texture, const char *path, Arena *scratch);
+bool textureFromPixels(Texture *texture, const uint32_t *pixels, int width, int height);
+bool textureCreateSolid(Texture *texture, int width, int height, uint32_t color);
+void textureDestroy(Texture *texture);
+
+#endif
@@ -24,11 +24,32 @@ freely, subject to the following restrictions:
 		distribution.
 */
 
+#if !defined(_POSIX_C_SOURCE) && (defined(__unix__) || defined(__APPLE__))
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UPNG_USE_MMAP
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UPNG_USE_SSE2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UPNG_USE_AVX2	/* compiled with a target attribute, used if the CPU has it */
+#endif
+#endif
+
 #include "upng.h"
 
 #define MAKE_BYTE(b) ((b) & 0xFF)
@@ -76,12 +97,49 @@ typedef enum upng_color {
 	UPNG_RGBA		= 6
 } upng_color;
 
+typedef enum upng_source_owner {
+	UPNG_SOURCE_BORROWED	= 0, /* caller keeps the buffer alive */
+	UPNG_SOURCE_HEAP		= 1, /* malloc'd by upng */
+	UPNG_SOURCE_MAPPED		= 2  /* file mapped into memory by upng */
+} upng_source_owner;
+
 typedef struct upng_source {
 	const unsigned char*	buffer;
 	unsigned long			size;
 	char					owning;
 } upng_source;
 
+/* the concatenated payload of all IDAT chunks, read in place from the source.
+ * reads only move forward in practice, so the current chunk is cached and the
+ * next one found by walking the chunk list. */
+typedef struct upng_stream {
+	const unsigned char*	first;		/* first IDAT chunk */
+	const unsigned char*	end;		/* end of the source buffer */
+	const unsigned char*	chunk;		/* IDAT chunk holding the current segment */
+	const unsigned char*	data;		/* payload of that chunk */
+	unsigned long			start;		/* offset of data[0], relative to the skipped bytes */
+	unsigned long			length;		/* payload length of the current chunk */
+	unsigned long			skipped;	/* bytes consumed by stream_skip, e.g. the zlib header */
+} upng_stream;
+
+/* destination of the inflater. only the 32k deflate window and two scanlines
+ * are kept in memory: a scanline is unfiltered as soon as its last byte has
+ * been inflated and is then handed to the row callback. */
+typedef struct upng_rows {
+	upng_t*					upng;
+	unsigned char*			window;		/* ring of the most recently inflated bytes */
+	unsigned long			mask;		/* window size - 1, the size is a power of two */
+	unsigned long			pos;		/* total number of bytes inflated so far */
+	unsigned long			row_end;	/* value of pos at which the pending scanline is complete */
+	unsigned long			stride;		/* filter type byte plus scanline bytes */
+	unsigned long			bytewidth;	/* bytes per pixel for filtering, at least 1 */
+	unsigned				y;			/* scanlines delivered so far */
+	unsigned				height;
+	unsigned char*			lines[2];	/* current and previous unfiltered scanline */
+	upng_row_callback		callback;
+	void*					user;
+} upng_rows;
+
 struct upng_t {
 	unsigned		width;
 	unsigned		height;
@@ -98,8 +156,23 @@ struct upng_t {
 
 	upng_state		state;
 	upng_source		source;
+
+	upng_alloc_func	alloc;		/* NULL: malloc/free */
+	upng_free_func	release;
+	void*			alloc_user;
 };
 
+/* decoded rows converted to 8-bit RGBA and scattered into a caller buffer */
+typedef struct upng_target {
+	unsigned char*	pixels;
+	unsigned long	pixel_stride;
+	unsigned long	row_stride;
+	unsigned		width;
+	upng_format		format;
+	unsigned		depth;
+	unsigned		components;
+} upng_target;
+
 typedef struct huffman_tree {
 	unsigned* tree2d;
 	unsigned maxbitlen;	/*maximum number of bits a single code can get */
@@ -176,14 +249,92 @@ static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
 	29, 30, 31, 0, 0
 };
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+static void* upng_alloc(upng_t* upng, unsigned long size)
+{
+	return upng->alloc != NULL ? upng->alloc(upng->alloc_user, size) : malloc(size);
+}
+
+static void upng_release(upng_t* upng, void* ptr)
+{
+	if (upng->alloc != NULL) {
+		if (upng->release != NULL) {
+			upng->release(upng->alloc_user, ptr);
+		}
+	} else {
+		free(ptr);
+	}
+}
+
+static void stream_init(upng_stream *stream, const unsigned char *first, const unsigned char *end)
+{
+	stream->first = first;
+	stream->end = end;
+	stream->chunk = first;
+	stream->data = first + 8;
+	stream->start = 0;
+	stream->length = upng_chunk_length(first);
+	stream->skipped = 0;
+}
+
+/* make offset count bytes the new offset 0 */
+static void stream_skip(upng_stream *stream, unsigned long count)
+{
+	stream->skipped += count;
+	stream->start -= count;
+}
+
+/* moves to the next IDAT chunk; chunk bounds were validated before the stream was created */
+static int stream_next_chunk(upng_stream *stream)
+{
+	const unsigned char *chunk = stream->chunk + stream->length + 12;
+	while (chunk + 12 <= stream->end) {
+		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
+			stream->chunk = chunk;
+			stream->data = chunk + 8;
+			stream->start += stream->length;
+			stream->length = upng_chunk_length(chunk);
+			return 1;
+		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
+			break;
+		}
+		chunk += upng_chunk_length(chunk) + 12;
+	}
+	return 0;
+}
+
+/* index is past the current chunk: find the chunk holding it */
+static unsigned char stream_seek(upng_stream *stream, unsigned long index)
+{
+	if (index + stream->skipped < stream->start + stream->skipped) {
+		unsigned long skipped = stream->skipped;
+		stream_init(stream, stream->first, stream->end);
+		stream_skip(stream, skipped);
+	}
+	while (index - stream->start >= stream->length) {
+		if (!stream_next_chunk(stream)) {
+			return 0;	/* past the last IDAT; callers bounds-check against the total size */
+		}
+	}
+	return stream->data[index - stream->start];
+}
+
+/* kept small so it inlines into the bit readers; chunk changes take the out of line path */
+static unsigned char stream_byte(upng_stream *stream, unsigned long index)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
+	if (index - stream->start < stream->length) {
+		return stream->data[index - stream->start];
+	}
+	return stream_seek(stream, index);
+}
+
+static unsigned char read_bit(unsigned long *bitpointer, upng_stream *bitstream)
+{
+	unsigned char result = (unsigned char)((stream_byte(bitstream, (*bitpointer) >> 3) >> ((*bitpointer) & 0x7)) & 1);
 	(*bitpointer)++;
 	return result;
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+static unsigned read_bits(unsigned long *bitpointer, upng_stream *bitstream, unsigned long nbits)
 {
 	unsigned result = 0, i;
 	for (i = 0; i < nbits; i++)
@@ -268,7 +419,7 @@ static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+static unsigned huffman_decode_symbol(upng_t *upng, upng_stream *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
 {
 	unsigned treepos = 0, ct;
 	unsigned char bit;
@@ -295,7 +446,7 @@ static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, uns
 }
 
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, upng_stream *in, unsigned long *bp, unsigned long inlength)
 {
 	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
 	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
@@ -449,8 +600,73 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	}
 }
 
+static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length);
+
+/* called when pos reaches row_end: unfilter the scanline that just completed and deliver it */
+static void rows_flush(upng_rows *rows)
+{
+	unsigned long length = rows->stride - 1;
+	unsigned long first = (rows->pos - length) & rows->mask;
+	unsigned long head = rows->mask + 1 - first;
+	unsigned char filter_type = rows->window[(rows->pos - rows->stride) & rows->mask];
+	unsigned char *recon = rows->lines[rows->y & 1];
+	unsigned char *precon = rows->y > 0 ? rows->lines[(rows->y - 1) & 1] : NULL;
+
+	if (rows->y == rows->height) {
+		/* more data than the image has scanlines */
+		SET_ERROR(rows->upng, UPNG_EMALFORMED);
+		rows->row_end = ULONG_MAX;
+		return;
+	}
+
+	/* the scanline may wrap around the end of the window */
+	if (head >= length) {
+		memcpy(recon, rows->window + first, length);
+	} else {
+		memcpy(recon, rows->window + first, head);
+		memcpy(recon + head, rows->window, length - head);
+	}
+
+	unfilter_scanline(rows->upng, recon, recon, precon, rows->bytewidth, filter_type, length);
+	if (rows->upng->error != UPNG_EOK) {
+		rows->row_end = ULONG_MAX;
+		return;
+	}
+
+	rows->callback(rows->user, rows->y, recon, length);
+	rows->y++;
+	rows->row_end += rows->stride;
+}
+
+static void rows_put(upng_rows *rows, unsigned char byte)
+{
+	rows->window[rows->pos & rows->mask] = byte;
+	if (++rows->pos == rows->row_end) {
+		rows_flush(rows);
+	}
+}
+
+/* copy length bytes from distance back in the window. the source may overlap
+ * the bytes being written, which repeats them as deflate requires */
+static void rows_copy(upng_rows *rows, unsigned long distance, unsigned long length)
+{
+	unsigned long to = rows->pos & rows->mask;
+	unsigned long from = (rows->pos - distance) & rows->mask;
+
+	/* common case: neither side wraps, no overlap and the scanline does not complete */
+	if (distance >= length && to + length <= rows->mask + 1 && from + length <= rows->mask + 1 && rows->pos + length < rows->row_end) {
+		memcpy(rows->window + to, rows->window + from, length);
+		rows->pos += length;
+		return;
+	}
+
+	while (length-- > 0) {
+		rows_put(rows, rows->window[(rows->pos - distance) & rows->mask]);
+	}
+}
+
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+static void inflate_huffman(upng_t* upng, upng_rows *out, upng_stream *in, unsigned long *bp, unsigned long inlength, unsigned btype)
 {
 	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
 	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
@@ -485,18 +701,12 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 			done = 1;
 		} else if (code <= 255) {
 			/* literal symbol */
-			if ((*pos) >= outsize) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-
-			/* store output */
-			out[(*pos)++] = (unsigned char)(code);
+			rows_put(out, (unsigned char)(code));
 		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
 			/* part 1: get length base */
 			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
 			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
+			unsigned long numextrabits;
 
 			/* part 2: get extra bits and add the value of that to length */
 			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
@@ -533,28 +743,20 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 
 			distance += read_bits(bp, in, numextrabitsD);
 
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
-
-			if ((*pos) + length >= outsize) {
+			/* back-reference before the start of the output */
+			if (distance > out->pos) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
-			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
-
-				if (backward >= start) {
-					backward = start - distance;
-				}
-			}
+			/*part 5: copy length bytes from distance back in the window. the source may
+			 * overlap the bytes being written, which repeats them as deflate requires */
+			rows_copy(out, distance, length);
 		}
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, upng_rows *out, upng_stream *in, unsigned long *bp, unsigned long inlength)
 {
 	unsigned long p;
 	unsigned len, nlen, n;
@@ -571,9 +773,9 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
+	len = stream_byte(in, p) + 256 * stream_byte(in, p + 1);
 	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
+	nlen = stream_byte(in, p) + 256 * stream_byte(in, p + 1);
 	p += 2;
 
 	/* check if 16-bit nlen is really the one's complement of len */
@@ -582,11 +784,6 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
 	/* read the literal data: len bytes are now stored in the out buffer */
 	if (p + len > inlength) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
@@ -594,20 +791,22 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 	}
 
 	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
+		rows_put(out, stream_byte(in, p++));
 	}
 
 	(*bp) = p * 8;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
+static upng_error uz_inflate_data(upng_t* upng, upng_rows *out, upng_stream *in, unsigned long insize, unsigned long inpos)
 {
 	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
-	unsigned long pos = 0;	/*byte position in the out buffer */
 
 	unsigned done = 0;
 
+	/* from here on offsets are relative to the deflate data */
+	stream_skip(in, inpos);
+
 	while (done == 0) {
 		unsigned btype;
 
@@ -618,17 +817,19 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
 		}
 
 		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
+		done = read_bit(&bp, in);
+		/* two separate reads: the order of operands in a single expression is unspecified */
+		btype = read_bit(&bp, in);
+		btype |= read_bit(&bp, in) << 1;
 
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, out, in, &bp, insize);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, out, in, &bp, insize, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -640,13 +841,17 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
 	return upng->error;
 }
 
-static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize)
+static upng_error uz_inflate(upng_t* upng, upng_rows *out, upng_stream *stream, unsigned long insize)
 {
+	unsigned char in[2];
+
 	/* we require two bytes for the zlib data header */
 	if (insize < 2) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
+	in[0] = stream_byte(stream, 0);
+	in[1] = stream_byte(stream, 1);
 
 	/* 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way */
 	if ((in[0] * 256 + in[1]) % 31 != 0) {
@@ -667,7 +872,7 @@ static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long out
 	}
 
 	/* create output buffer */
-	uz_inflate_data(upng, out, outsize, in, insize, 2);
+	uz_inflate_data(upng, out, stream, insize, 2);
 
 	return upng->error;
 }
@@ -688,6 +893,135 @@ static int paeth_predictor(int a, int b, int c)
 		return c;
 }
 
+#if defined(UPNG_USE_SSE2)
+/* SSE2 unfiltering for 3 and 4 byte pixels. Sub, Average and Paeth depend on
+ * the pixel to the left, so they work one pixel per step with all channels in
+ * one register; Up has no such dependency and runs 16 bytes (32 with AVX2) at
+ * a time. every path produces exactly the bytes of the scalar code. */
+
+/* 3 byte pixels are assembled in a register; going through memory would stall
+ * store forwarding on every pixel */
+static __m128i load_pixel(const unsigned char *p, unsigned long bytewidth)
+{
+	int value;
+	if (bytewidth == 4)
+		memcpy(&value, p, 4);
+	else
+		value = p[0] | (p[1] << 8) | (p[2] << 16);
+	return _mm_cvtsi32_si128(value);
+}
+
+static void store_pixel(unsigned char *p, __m128i pixel, unsigned long bytewidth)
+{
+	int value = _mm_cvtsi128_si32(pixel);
+	if (bytewidth == 4) {
+		memcpy(p, &value, 4);
+	} else {
+		p[0] = (unsigned char)value;
+		p[1] = (unsigned char)(value >> 8);
+		p[2] = (unsigned char)(value >> 16);
+	}
+}
+
+static void unfilter_sub_sse2(unsigned char *recon, const unsigned char *scanline, unsigned long bytewidth, unsigned long length)
+{
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+
+	for (i = 0; i + bytewidth <= length; i += bytewidth) {
+		a = _mm_add_epi8(a, load_pixel(scanline + i, bytewidth));
+		store_pixel(recon + i, a, bytewidth);
+	}
+}
+
+static void unfilter_average_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+
+	for (i = 0; i + bytewidth <= length; i += bytewidth) {
+		__m128i b = load_pixel(precon + i, bytewidth);
+		/* _mm_avg_epu8 rounds up; PNG truncates, so take off the rounding bit */
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(load_pixel(scanline + i, bytewidth), average);
+		store_pixel(recon + i, a, bytewidth);
+	}
+}
+
+static __m128i abs_epi16(__m128i x)
+{
+	__m128i negative = _mm_cmplt_epi16(x, _mm_setzero_si128());
+	return _mm_sub_epi16(_mm_xor_si128(x, negative), negative);
+}
+
+static __m128i select_epi16(__m128i mask, __m128i t, __m128i e)
+{
+	return _mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, e));
+}
+
+static void unfilter_paeth_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero, c = zero;
+	unsigned long i;
+
+	/* channels are widened to 16 bits so the predictor distances cannot overflow */
+	for (i = 0; i + bytewidth <= length; i += bytewidth) {
+		__m128i b = _mm_unpacklo_epi8(load_pixel(precon + i, bytewidth), zero);
+		__m128i pa = _mm_sub_epi16(b, c);		/* p - a */
+		__m128i pb = _mm_sub_epi16(a, c);		/* p - b */
+		__m128i pc = _mm_add_epi16(pa, pb);		/* p - c */
+		__m128i smallest, predictor;
+
+		pa = abs_epi16(pa);
+		pb = abs_epi16(pb);
+		pc = abs_epi16(pc);
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+		/* same tie order as paeth_predictor: a, then b, then c */
+		predictor = select_epi16(_mm_cmpeq_epi16(smallest, pa), a, select_epi16(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		a = _mm_unpacklo_epi8(load_pixel(scanline + i, bytewidth), zero);
+		a = _mm_and_si128(_mm_add_epi16(a, predictor), _mm_set1_epi16(0xFF));
+		store_pixel(recon + i, _mm_packus_epi16(a, a), bytewidth);
+		c = b;
+	}
+}
+
+#if defined(UPNG_USE_AVX2)
+__attribute__((target("avx2")))
+static unsigned long unfilter_up_avx2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i;
+	for (i = 0; i + 32 <= length; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(scanline + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(precon + i));
+		_mm256_storeu_si256((__m256i*)(recon + i), _mm256_add_epi8(x, b));
+	}
+	return i;
+}
+#endif
+
+/* returns how many bytes were done; the scalar loop finishes the tail */
+static unsigned long unfilter_up_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i = 0;
+
+#if defined(UPNG_USE_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		i = unfilter_up_avx2(recon, scanline, precon, length);
+	}
+#endif
+	for (; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(precon + i));
+		_mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+	}
+	return i;
+}
+#endif
+
 static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
 {
 	/*
@@ -699,6 +1033,27 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	 */
 
 	unsigned long i;
+
+#if defined(UPNG_USE_SSE2)
+	if (filterType == 2 && precon) {
+		for (i = unfilter_up_sse2(recon, scanline, precon, length); i < length; i++)
+			recon[i] = scanline[i] + precon[i];
+		return;
+	}
+	if (bytewidth == 3 || bytewidth == 4) {
+		if (filterType == 1) {
+			unfilter_sub_sse2(recon, scanline, bytewidth, length);
+			return;
+		} else if (filterType == 3 && precon) {
+			unfilter_average_sse2(recon, scanline, precon, bytewidth, length);
+			return;
+		} else if (filterType == 4 && precon) {
+			unfilter_paeth_sse2(recon, scanline, precon, bytewidth, length);
+			return;
+		}
+	}
+#endif
+
 	switch (filterType) {
 	case 0:
 		for (i = 0; i < length; i++)
@@ -750,83 +1105,93 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	}
 }
 
-static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
+/* row callback of upng_decode: packs the scanlines into upng->buffer. sub-byte
+ * formats whose scanlines do not end on a byte boundary drop the padding bits,
+ * so the next scanline continues at the following bit */
+static void store_row(void* user, unsigned y, const unsigned char* row, unsigned long size)
 {
-	/*
-	   For PNG filter method 0
-	   this function unfilters a single image (e.g. without interlacing this is called once, with Adam7 it's called 7 times)
-	   out must have enough bytes allocated already, in must have the scanlines + 1 filtertype byte per scanline
-	   w and h are image dimensions or dimensions of reduced image, bpp is bpp per pixel
-	   in and out are allowed to be the same memory address!
-	 */
-
-	unsigned y;
-	unsigned char *prevline = 0;
+	upng_t* upng = (upng_t*)user;
+	unsigned long linebits = (unsigned long)upng->width * upng_get_bpp(upng);
+	unsigned long obp = linebits * y;	/*bit pointer in the output */
+	unsigned long x;
 
-	unsigned long bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
-	unsigned long linebytes = (w * bpp + 7) / 8;
+	if (linebits % 8 == 0) {
+		memcpy(upng->buffer + (unsigned long)y * size, row, size);
+		return;
+	}
 
-	for (y = 0; y < h; y++) {
-		unsigned long outindex = linebytes * y;
-		unsigned long inindex = (1 + linebytes) * y;	/*the extra filterbyte added to each row */
-		unsigned char filterType = in[inindex];
+	for (x = 0; x < linebits; x++) {
+		unsigned char bit = (unsigned char)((row[x >> 3] >> (7 - (x & 0x7))) & 1);
 
-		unfilter_scanline(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes);
-		if (upng->error != UPNG_EOK) {
-			return;
-		}
-
-		prevline = &out[outindex];
+		if (bit == 0)
+			upng->buffer[obp >> 3] &= (unsigned char)(~(1 << (7 - (obp & 0x7))));
+		else
+			upng->buffer[obp >> 3] |= (1 << (7 - (obp & 0x7)));
+		++obp;
 	}
 }
 
-static void remove_padding_bits(unsigned char *out, const unsigned char *in, unsigned long olinebits, unsigned long ilinebits, unsigned h)
+/* sample index of a scanline, reduced to 8 bits: 16-bit samples keep their high
+ * byte and sub-byte samples are scaled up so that the maximum maps to 255 */
+static unsigned char read_sample(const unsigned char* row, unsigned long index, unsigned depth)
 {
-	/*
-	   After filtering there are still padding bpp if scanlines have non multiple of 8 bit amounts. They need to be removed (except at last scanline of (Adam7-reduced) image) before working with pure image buffers for the Adam7 code, the color convert code and the output to the user.
-	   in and out are allowed to be the same buffer, in may also be higher but still overlapping; in must have >= ilinebits*h bpp, out must have >= olinebits*h bpp, olinebits must be <= ilinebits
-	   also used to move bpp after earlier such operations happened, e.g. in a sequence of reduced images from Adam7
-	   only useful if (ilinebits - olinebits) is a value in the range 1..7
-	 */
-	unsigned y;
-	unsigned long diff = ilinebits - olinebits;
-	unsigned long obp = 0, ibp = 0;	/*bit pointers */
-	for (y = 0; y < h; y++) {
-		unsigned long x;
-		for (x = 0; x < olinebits; x++) {
-			unsigned char bit = (unsigned char)((in[(ibp) >> 3] >> (7 - ((ibp) & 0x7))) & 1);
-			ibp++;
-
-			if (bit == 0)
-				out[(obp) >> 3] &= (unsigned char)(~(1 << (7 - ((obp) & 0x7))));
-			else
-				out[(obp) >> 3] |= (1 << (7 - ((obp) & 0x7)));
-			++obp;
-		}
-		ibp += diff;
+	unsigned long bit;
+	unsigned value;
+
+	switch (depth) {
+	case 8:
+		return row[index];
+	case 16:
+		return row[index * 2];
+	default:
+		bit = index * depth;
+		value = (row[bit >> 3] >> (8 - depth - (bit & 0x7))) & ((1u << depth) - 1);
+		return (unsigned char)(value * 255 / ((1u << depth) - 1));
 	}
 }
 
-/*out must be buffer big enough to contain full image, and in must contain the full decompressed data from the IDAT chunks*/
-static void post_process_scanlines(upng_t* upng, unsigned char *out, unsigned char *in, const upng_t* info_png)
+/* row callback of upng_decode_rgba8 */
+static void store_row_rgba8(void* user, unsigned y, const unsigned char* row, unsigned long size)
 {
-	unsigned bpp = upng_get_bpp(info_png);
-	unsigned w = info_png->width;
-	unsigned h = info_png->height;
-
-	if (bpp == 0) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
+	const upng_target* target = (const upng_target*)user;
+	unsigned char* out = target->pixels + (unsigned long)y * target->row_stride;
+	unsigned long pixel_stride = target->pixel_stride;
+	unsigned long width = target->width;
+	unsigned depth = target->depth;
+	unsigned components = target->components;
+	unsigned long x;
+
+	(void)size;
+
+	/* the engine's textures are 8-bit RGBA or RGB; everything else takes the generic path */
+	switch (target->format) {
+	case UPNG_RGBA8:
+		for (x = 0; x < width; x++, out += pixel_stride) {
+			memcpy(out, row + x * 4, 4);
+		}
 		return;
+	case UPNG_RGB8:
+		for (x = 0; x < width; x++, out += pixel_stride) {
+			out[0] = row[x * 3];
+			out[1] = row[x * 3 + 1];
+			out[2] = row[x * 3 + 2];
+			out[3] = 255;
+		}
+		return;
+	default:
+		break;
 	}
 
-	if (bpp < 8 && w * bpp != ((w * bpp + 7) / 8) * 8) {
-		unfilter(upng, in, in, w, h, bpp);
-		if (upng->error != UPNG_EOK) {
-			return;
+	for (x = 0; x < width; x++, out += pixel_stride) {
+		unsigned long first = x * components;
+		if (components >= 3) {
+			out[0] = read_sample(row, first, depth);
+			out[1] = read_sample(row, first + 1, depth);
+			out[2] = read_sample(row, first + 2, depth);
+		} else {
+			out[0] = out[1] = out[2] = read_sample(row, first, depth);
 		}
-		remove_padding_bits(out, in, w * bpp, ((w * bpp + 7) / 8) * 8, h);
-	} else {
-		unfilter(upng, out, in, w, h, bpp);	/*we can immediatly filter into the out buffer, no other steps needed */
+		out[3] = (components == 2 || components == 4) ? read_sample(row, first + components - 1, depth) : 255;
 	}
 }
 
@@ -842,6 +1207,8 @@ static upng_format determine_format(upng_t* upng) {
 			return UPNG_LUMINANCE4;
 		case 8:
 			return UPNG_LUMINANCE8;
+		case 16:
+			return UPNG_LUMINANCE16;
 		default:
 			return UPNG_BADFORMAT;
 		}
@@ -864,6 +1231,8 @@ static upng_format determine_format(upng_t* upng) {
 			return UPNG_LUMINANCE_ALPHA4;
 		case 8:
 			return UPNG_LUMINANCE_ALPHA8;
+		case 16:
+			return UPNG_LUMINANCE_ALPHA16;
 		default:
 			return UPNG_BADFORMAT;
 		}
@@ -883,13 +1252,18 @@ static upng_format determine_format(upng_t* upng) {
 
 static void upng_free_source(upng_t* upng)
 {
-	if (upng->source.owning != 0) {
+	if (upng->source.owning == UPNG_SOURCE_HEAP) {
 		free((void*)upng->source.buffer);
 	}
+#ifdef UPNG_USE_MMAP
+	else if (upng->source.owning == UPNG_SOURCE_MAPPED) {
+		munmap((void*)upng->source.buffer, upng->source.size);
+	}
+#endif
 
 	upng->source.buffer = NULL;
 	upng->source.size = 0;
-	upng->source.owning = 0;
+	upng->source.owning = UPNG_SOURCE_BORROWED;
 }
 
 /*read the information from the header and store it in the upng_Info. return value is error*/
@@ -960,21 +1334,25 @@ upng_error upng_header(upng_t* upng)
 	return upng->error;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-upng_error upng_decode(upng_t* upng)
+upng_error upng_decode_rows(upng_t* upng, upng_row_callback callback, void* user)
 {
 	const unsigned char *chunk;
-	unsigned char* compressed;
-	unsigned char* inflated;
-	unsigned long compressed_size = 0, compressed_index = 0;
-	unsigned long inflated_size;
-	upng_error error;
+	const unsigned char *first_idat = NULL;
+	upng_stream compressed;
+	upng_rows rows;
+	unsigned long compressed_size = 0;
+	unsigned long linebytes, window_size;
 
 	/* if we have an error state, bail now */
 	if (upng->error != UPNG_EOK) {
 		return upng->error;
 	}
 
+	if (callback == NULL) {
+		SET_ERROR(upng, UPNG_EPARAM);
+		return upng->error;
+	}
+
 	/* parse the main header, if necessary */
 	upng_header(upng);
 	if (upng->error != UPNG_EOK) {
@@ -986,13 +1364,6 @@ upng_error upng_decode(upng_t* upng)
 		return upng->error;
 	}
 
-	/* release old result, if any */
-	if (upng->buffer != 0) {
-		free(upng->buffer);
-		upng->buffer = 0;
-		upng->size = 0;
-	}
-
 	/* first byte of the first chunk after the header */
 	chunk = upng->source.buffer + 33;
 
@@ -1000,7 +1371,6 @@ upng_error upng_decode(upng_t* upng)
 	 * verify general well-formed-ness */
 	while (chunk < upng->source.buffer + upng->source.size) {
 		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
 
 		/* make sure chunk header is not larger than the total compressed */
 		if ((unsigned long)(chunk - upng->source.buffer + 12) > upng->source.size) {
@@ -1021,11 +1391,11 @@ upng_error upng_decode(upng_t* upng)
 			return upng->error;
 		}
 
-		/* get pointer to payload */
-		data = chunk + 8;
-
 		/* parse chunks */
 		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
+			if (first_idat == NULL) {
+				first_idat = chunk;
+			}
 			compressed_size += length;
 		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
 			break;
@@ -1037,82 +1407,128 @@ upng_error upng_decode(upng_t* upng)
 		chunk += upng_chunk_length(chunk) + 12;
 	}
 
-	/* allocate enough space for the (compressed and filtered) image data */
-	compressed = (unsigned char*)malloc(compressed_size);
-	if (compressed == NULL) {
+	if (first_idat == NULL) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
+	/* the IDAT payloads are inflated straight out of the source buffer; the
+	 * chunks were validated above, so the stream does not check them again */
+	stream_init(&compressed, first_idat, upng->source.buffer + upng->source.size);
+
+	/* the window must hold the 32k deflate history and the scanline being inflated */
+	linebytes = ((unsigned long)upng->width * upng_get_bpp(upng) + 7) / 8;
+	window_size = 32768;
+	while (window_size < linebytes + 1) {
+		window_size *= 2;
+	}
+
+	rows.upng = upng;
+	rows.window = (unsigned char*)upng_alloc(upng, window_size + 2 * linebytes);
+	if (rows.window == NULL) {
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
 	}
+	rows.mask = window_size - 1;
+	rows.pos = 0;
+	rows.stride = linebytes + 1;
+	rows.row_end = rows.stride;
+	rows.bytewidth = (upng_get_bpp(upng) + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
+	rows.y = 0;
+	rows.height = upng->height;
+	rows.lines[0] = rows.window + window_size;
+	rows.lines[1] = rows.lines[0] + linebytes;
+	rows.callback = callback;
+	rows.user = user;
+
+	/* decompress and unfilter image data */
+	uz_inflate(upng, &rows, &compressed, compressed_size);
+	if (upng->error == UPNG_EOK && rows.y != rows.height) {
+		/* the stream ended before the last scanline */
+		SET_ERROR(upng, UPNG_EMALFORMED);
+	}
+	upng_release(upng, rows.window);
 
-	/* scan through the chunks again, this time copying the values into
-	 * our compressed buffer.  there's no reason to validate anything a second time. */
-	chunk = upng->source.buffer + 33;
-	while (chunk < upng->source.buffer + upng->source.size) {
-		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
+	if (upng->error == UPNG_EOK) {
+		upng->state = UPNG_DECODED;
+	}
 
-		length = upng_chunk_length(chunk);
-		data = chunk + 8;
+	/* we are done with our input buffer; free it if we own it */
+	upng_free_source(upng);
 
-		/* parse chunks */
-		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			memcpy(compressed + compressed_index, data, length);
-			compressed_index += length;
-		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-			break;
-		}
+	return upng->error;
+}
 
-		chunk += upng_chunk_length(chunk) + 12;
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+upng_error upng_decode(upng_t* upng)
+{
+	/* if we have an error state, bail now */
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
 	}
 
-	/* allocate space to store inflated (but still filtered) data */
-	inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
-	inflated = (unsigned char*)malloc(inflated_size);
-	if (inflated == NULL) {
-		free(compressed);
-		SET_ERROR(upng, UPNG_ENOMEM);
+	/* parse the main header, if necessary */
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
 		return upng->error;
 	}
 
-	/* decompress image data */
-	error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
-	if (error != UPNG_EOK) {
-		free(compressed);
-		free(inflated);
+	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
+	if (upng->state != UPNG_HEADER) {
 		return upng->error;
 	}
 
-	/* free the compressed compressed data */
-	free(compressed);
+	/* release old result, if any */
+	if (upng->buffer != 0) {
+		upng_release(upng, upng->buffer);
+		upng->buffer = 0;
+		upng->size = 0;
+	}
 
 	/* allocate final image buffer */
 	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
-	upng->buffer = (unsigned char*)malloc(upng->size);
+	upng->buffer = (unsigned char*)upng_alloc(upng, upng->size);
 	if (upng->buffer == NULL) {
-		free(inflated);
 		upng->size = 0;
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
 	}
 
-	/* unfilter scanlines */
-	post_process_scanlines(upng, upng->buffer, inflated, upng);
-	free(inflated);
+	/* scanlines are unfiltered straight into the final buffer as they are inflated */
+	upng_decode_rows(upng, store_row, upng);
 
 	if (upng->error != UPNG_EOK) {
-		free(upng->buffer);
+		upng_release(upng, upng->buffer);
 		upng->buffer = NULL;
 		upng->size = 0;
-	} else {
-		upng->state = UPNG_DECODED;
 	}
 
-	/* we are done with our input buffer; free it if we own it */
-	upng_free_source(upng);
-
 	return upng->error;
 }
 
+upng_error upng_decode_rgba8(upng_t* upng, unsigned char* target, unsigned long pixel_stride, unsigned long row_stride)
+{
+	upng_target destination;
+
+	if (upng->error == UPNG_EOK && target == NULL) {
+		SET_ERROR(upng, UPNG_EPARAM);
+	}
+
+	/* parse the main header, if necessary */
+	if (upng_header(upng) != UPNG_EOK) {
+		return upng->error;
+	}
+
+	destination.pixels = target;
+	destination.pixel_stride = pixel_stride;
+	destination.row_stride = row_stride;
+	destination.width = upng->width;
+	destination.format = upng->format;
+	destination.depth = upng_get_bitdepth(upng);
+	destination.components = upng_get_components(upng);
+	return upng_decode_rows(upng, store_row_rgba8, &destination);
+}
+
 static upng_t* upng_new(void)
 {
 	upng_t* upng;
@@ -1138,7 +1554,11 @@ static upng_t* upng_new(void)
 
 	upng->source.buffer = NULL;
 	upng->source.size = 0;
-	upng->source.owning = 0;
+	upng->source.owning = UPNG_SOURCE_BORROWED;
+
+	upng->alloc = NULL;
+	upng->release = NULL;
+	upng->alloc_user = NULL;
 
 	return upng;
 }
@@ -1152,17 +1572,21 @@ upng_t* upng_new_from_bytes(const unsigned char* buffer, unsigned long size)
 
 	upng->source.buffer = buffer;
 	upng->source.size = size;
-	upng->source.owning = 0;
+	upng->source.owning = UPNG_SOURCE_BORROWED;
 
 	return upng;
 }
 
+/* reads the file into a heap copy, which stays intact when the file is truncated or rewritten
+ * during the decode, as a watched asset is while being saved; a mapping of it would fault. a file
+ * cut short meanwhile decodes as the truncated or corrupt PNG it then is */
 upng_t* upng_new_from_file(const char *filename)
 {
 	upng_t* upng;
 	unsigned char *buffer;
 	FILE *file;
 	long size;
+	unsigned long length;
 
 	upng = upng_new();
 	if (upng == NULL) {
@@ -1176,10 +1600,19 @@ upng_t* upng_new_from_file(const char *filename)
 	}
 
 	/* get filesize */
-	fseek(file, 0, SEEK_END);
-	size = ftell(file);
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0) {
+		fclose(file);
+		SET_ERROR(upng, UPNG_ENOTFOUND);
+		return upng;
+	}
 	rewind(file);
 
+	/* an empty file leaves the source empty, which upng_header reports as ENOTPNG */
+	if (size == 0) {
+		fclose(file);
+		return upng;
+	}
+
 	/* read contents of the file into the vector */
 	buffer = (unsigned char *)malloc((unsigned long)size);
 	if (buffer == NULL) {
@@ -1187,22 +1620,75 @@ upng_t* upng_new_from_file(const char *filename)
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng;
 	}
-	fread(buffer, 1, (unsigned long)size, file);
+	length = (unsigned long)fread(buffer, 1, (unsigned long)size, file);
 	fclose(file);
 
-	/* set the read buffer as our source buffer, with owning flag set */
+	/* set the read buffer as our source buffer, with owning flag set; only what was read counts */
 	upng->source.buffer = buffer;
-	upng->source.size = size;
-	upng->source.owning = 1;
+	upng->source.size = length;
+	upng->source.owning = UPNG_SOURCE_HEAP;
+
+	return upng;
+}
+
+#ifdef UPNG_USE_MMAP
+/* map the file read-only instead of copying it; the decoder reads the chunks,
+ * IDAT data included, straight out of the page cache */
+upng_t* upng_new_from_file_mapped(const char *filename)
+{
+	upng_t* upng;
+	struct stat info;
+	void *mapping;
+	int fd;
+
+	upng = upng_new();
+	if (upng == NULL) {
+		return NULL;
+	}
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		SET_ERROR(upng, UPNG_ENOTFOUND);
+		return upng;
+	}
+
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(fd);
+		SET_ERROR(upng, UPNG_ENOTFOUND);
+		return upng;
+	}
+
+	/* an empty file leaves the source empty, which upng_header reports as ENOTPNG */
+	if (info.st_size == 0) {
+		close(fd);
+		return upng;
+	}
+
+	mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return upng;
+	}
+
+	upng->source.buffer = (const unsigned char*)mapping;
+	upng->source.size = (unsigned long)info.st_size;
+	upng->source.owning = UPNG_SOURCE_MAPPED;
 
 	return upng;
 }
+#else
+upng_t* upng_new_from_file_mapped(const char *filename)
+{
+	return upng_new_from_file(filename);
+}
+#endif
 
 void upng_free(upng_t* upng)
 {
 	/* deallocate image buffer */
 	if (upng->buffer != NULL) {
-		free(upng->buffer);
+		upng_release(upng, upng->buffer);
 	}
 
 	/* deallocate source buffer, if necessary */
@@ -1212,6 +1698,13 @@ void upng_free(upng_t* upng)
 	free(upng);
 }
 
+void upng_set_allocator(upng_t* upng, upng_alloc_func alloc, upng_free_func release, void* user)
+{
+	upng->alloc = alloc;
+	upng->release = release;
+	upng->alloc_user = user;
+}
+
 upng_error upng_get_error(const upng_t* upng)
 {
 	return upng->error;
@@ -52,17 +52,43 @@ typedef enum upng_format {
 	UPNG_LUMINANCE_ALPHA1,
 	UPNG_LUMINANCE_ALPHA2,
 	UPNG_LUMINANCE_ALPHA4,
-	UPNG_LUMINANCE_ALPHA8
+	UPNG_LUMINANCE_ALPHA8,
+	UPNG_LUMINANCE16,
+	UPNG_LUMINANCE_ALPHA16
 } upng_format;
 
 typedef struct upng_t upng_t;
 
+/* receives one unfiltered scanline in the image's own format, top to bottom.
+ * scanlines of sub-byte formats are padded to a whole byte. the row memory is
+ * only valid for the duration of the call. */
+typedef void (*upng_row_callback)(void* user, unsigned y, const unsigned char* row, unsigned long size);
+
+/* allocator hooks, see upng_set_allocator. release may be NULL for arenas that are reset as a whole */
+typedef void* (*upng_alloc_func)(void* user, unsigned long size);
+typedef void (*upng_free_func)(void* user, void* ptr);
+
 upng_t*		upng_new_from_bytes	(const unsigned char* buffer, unsigned long size);
 upng_t*		upng_new_from_file	(const char* path);
+/* maps the file instead of copying it, where the platform can. only for files
+ * nothing truncates during the decode: a mapping of one that shrinks faults */
+upng_t*		upng_new_from_file_mapped	(const char* path);
 void		upng_free			(upng_t* upng);
 
 upng_error	upng_header			(upng_t* upng);
 upng_error	upng_decode			(upng_t* upng);
+/* streaming decode: scanlines go to the callback as soon as they are inflated
+ * instead of into the image buffer, so scratch memory stays at the 32k deflate
+ * window plus two scanlines regardless of the image height */
+upng_error	upng_decode_rows	(upng_t* upng, upng_row_callback callback, void* user);
+/* decodes any supported format straight into caller memory as 8-bit RGBA, bytes
+ * in R, G, B, A order. pixel (x, y) goes to target + y * row_stride + x * pixel_stride,
+ * so row- and column-major layouts are both one pass. upng_get_buffer stays NULL. */
+upng_error	upng_decode_rgba8	(upng_t* upng, unsigned char* target, unsigned long pixel_stride, unsigned long row_stride);
+
+/* all scratch and result memory of this image comes from alloc/release instead of
+ * malloc/free. set it before decoding; the upng_t itself is still malloc'd */
+void		upng_set_allocator	(upng_t* upng, upng_alloc_func alloc, upng_free_func release, void* user);
 
 upng_error	upng_get_error		(const upng_t* upng);
 unsigned	upng_get_error_line	(const upng_t* upng);
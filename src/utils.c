@@ -1,14 +1,6 @@
 #include "utils.h"
-#include <SDL2/SDL.h>
 #include "constants.h"
 
-void frameWait(int ticks) {
-    int waitTime = FRAME_TIME_LENGTH - (SDL_GetTicks() - ticks);
-    if (waitTime > 0 && waitTime <= FRAME_TIME_LENGTH) {
-        SDL_Delay(waitTime);
-    }
-}
-
 float normalizeAngle(float angle) {
     angle = remainder(angle, 2 * M_PI);
     if (angle < 0) {
@@ -1,7 +1,6 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
-void frameWait(int ticks);
 float normalizeAngle(float angle);
 float distanceBetweenPoints(float x1, float y1, float x2, float y2);
 
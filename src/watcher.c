@@ -0,0 +1,141 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "watcher.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+typedef struct WatchedFile {
+    int watch;
+    char *name;
+    bool changed;
+} WatchedFile;
+
+struct FileWatcher {
+    int fd;
+    WatchedFile *files;
+    int numFiles;
+};
+
+FileWatcher *fileWatcherCreate(void) {
+    FileWatcher *watcher = (FileWatcher*) calloc(1, sizeof(FileWatcher));
+    if (watcher == NULL) {
+        return NULL;
+    }
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        free(watcher);
+        return NULL;
+    }
+    return watcher;
+}
+
+void fileWatcherDestroy(FileWatcher *watcher) {
+    if (watcher == NULL) {
+        return;
+    }
+    for (int i = 0; i < watcher->numFiles; i++) {
+        free(watcher->files[i].name);
+    }
+    free(watcher->files);
+    close(watcher->fd);
+    free(watcher);
+}
+
+int fileWatcherAdd(FileWatcher *watcher, const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash != NULL ? slash + 1 : path;
+    size_t directoryLength = slash != NULL ? (size_t)(slash - path) : 1;
+    char *directory = (char*) malloc(directoryLength + 1);
+    if (directory == NULL) {
+        return -1;
+    }
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else if (directoryLength == 0) {
+        strcpy(directory, "/");
+    } else {
+        memcpy(directory, path, directoryLength);
+        directory[directoryLength] = '\0';
+    }
+
+    // watching the same directory twice returns the same descriptor
+    int watch = inotify_add_watch(watcher->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    free(directory);
+    if (watch < 0) {
+        return -1;
+    }
+
+    WatchedFile *files = (WatchedFile*) realloc(watcher->files, sizeof(WatchedFile) * (watcher->numFiles + 1));
+    if (files == NULL) {
+        return -1;
+    }
+    watcher->files = files;
+    WatchedFile *file = &watcher->files[watcher->numFiles];
+    file->watch = watch;
+    file->changed = false;
+    file->name = (char*) malloc(strlen(name) + 1);
+    if (file->name == NULL) {
+        return -1;
+    }
+    strcpy(file->name, name);
+    return watcher->numFiles++;
+}
+
+int fileWatcherPoll(FileWatcher *watcher, int *changed, int maxChanged) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(watcher->fd, buffer, sizeof(buffer))) > 0) {
+        for (char *next = buffer; next < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event*) next;
+            next += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            for (int i = 0; i < watcher->numFiles; i++) {
+                if (watcher->files[i].watch == event->wd && strcmp(watcher->files[i].name, event->name) == 0) {
+                    watcher->files[i].changed = true;
+                }
+            }
+        }
+    }
+
+    // files beyond maxChanged stay flagged for the next poll
+    int numChanged = 0;
+    for (int i = 0; i < watcher->numFiles && numChanged < maxChanged; i++) {
+        if (watcher->files[i].changed) {
+            watcher->files[i].changed = false;
+            changed[numChanged++] = i;
+        }
+    }
+    return numChanged;
+}
+
+#else
+
+FileWatcher *fileWatcherCreate(void) {
+    return NULL;
+}
+
+void fileWatcherDestroy(FileWatcher *watcher) {
+    (void) watcher;
+}
+
+int fileWatcherAdd(FileWatcher *watcher, const char *path) {
+    (void) watcher;
+    (void) path;
+    return -1;
+}
+
+int fileWatcherPoll(FileWatcher *watcher, int *changed, int maxChanged) {
+    (void) watcher;
+    (void) changed;
+    (void) maxChanged;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _WATCHER_H_
+#define _WATCHER_H_
+
+// reports files that were rewritten or replaced on disk. the directory holding
+// each file is watched rather than the file itself, so editors that save by
+// writing a temporary file and renaming it over the original are noticed too.
+typedef struct FileWatcher FileWatcher;
+
+// returns NULL when the platform has no file change notifications
+FileWatcher *fileWatcherCreate(void);
+void fileWatcherDestroy(FileWatcher *watcher);
+
+// starts watching path and returns the id its changes are reported with, or -1
+int fileWatcherAdd(FileWatcher *watcher, const char *path);
+
+// never blocks: stores the ids of files changed since the last poll, each one
+// once, and returns how many were stored
+int fileWatcherPoll(FileWatcher *watcher, int *changed, int maxChanged);
+
+#endif